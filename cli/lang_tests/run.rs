@@ -28,6 +28,8 @@ fn main() {
             let stdlib = current_dir().unwrap().with_file_name("lib");
             runtime
                 .env("MOSHELL_STD", stdlib)
+                // the tilde expansions do not depend on the user running the tests
+                .env("HOME", tempdir.path())
                 .args([p.to_str().unwrap()])
                 .current_dir(tempdir.path());
             vec![("Run", runtime)]
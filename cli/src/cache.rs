@@ -0,0 +1,177 @@
+use std::fs;
+use std::io::{self, Write};
+use std::path::{Path, PathBuf};
+use std::time::UNIX_EPOCH;
+
+use cli::project_dir;
+use vm::VM;
+
+use crate::pipeline::FileImporter;
+
+/// The version of the cache entries layout, to discard the entries written by other versions.
+const FORMAT_VERSION: u32 = 1;
+
+/// The number of pages of a script entry: the standard library, then the script itself.
+const SCRIPT_PAGES: usize = 2;
+
+/// An on-disk cache of the compiled bytecode of a script and of the standard library it links to.
+///
+/// An entry is keyed by the script path and by the identity of the running executable,
+/// so that a new compiler never loads the bytecode of another one. It is only valid while
+/// each source file that was read to compile it still has the same content hash.
+/// A hit skips the whole pipeline, and the pages are directly mapped into the VM.
+pub struct BytecodeCache {
+    /// The directory of this script's entry.
+    dir: PathBuf,
+
+    /// The compiled pages that have been recorded, in their execution order.
+    pages: Vec<Vec<u8>>,
+
+    /// The source files that the recorded pages have been compiled from.
+    dependencies: Vec<PathBuf>,
+}
+
+/// The failure of a cache entry that was valid, but that could not be registered in the VM.
+#[derive(Debug)]
+pub struct CorruptedEntry;
+
+impl BytecodeCache {
+    /// Gets the cache of the given script, stored in `MOSHELL_CACHE_DIR`
+    /// or in the user's cache directory.
+    pub fn for_script(script: &Path) -> Option<Self> {
+        let root = match std::env::var_os("MOSHELL_CACHE_DIR") {
+            Some(dir) => PathBuf::from(dir),
+            None => project_dir()?.cache_dir().join("bytecode"),
+        };
+        let script = fs::canonicalize(script).ok()?;
+
+        let mut key = Fnv1a::default();
+        key.write(executable_identity()?.as_bytes());
+        key.write(script.as_os_str().as_encoded_bytes());
+        Some(Self {
+            dir: root.join(format!("{:016x}", key.finish())),
+            pages: Vec::with_capacity(SCRIPT_PAGES),
+            dependencies: Vec::new(),
+        })
+    }
+
+    /// Registers the cached pages into the VM, if the entry is up-to-date with its sources.
+    ///
+    /// Returns `Ok(false)` if there is no valid entry, leaving the VM untouched.
+    pub fn load(&self, vm: &mut VM) -> Result<bool, CorruptedEntry> {
+        let Ok(manifest) = fs::read_to_string(self.dir.join("manifest")) else {
+            return Ok(false);
+        };
+        let mut lines = manifest.lines();
+        if lines.next() != Some(format!("moshell bytecode cache {FORMAT_VERSION}").as_str()) {
+            return Ok(false);
+        }
+        for line in lines {
+            let Some((hash, path)) = line.split_once(' ') else {
+                return Ok(false);
+            };
+            match fs::read(path) {
+                Ok(content) if format!("{:016x}", Fnv1a::hash(&content)) == hash => {}
+                _ => return Ok(false),
+            }
+        }
+
+        for page in 0..SCRIPT_PAGES {
+            vm.register_file(&self.page_path(page))
+                .map_err(|_| CorruptedEntry)?;
+        }
+        Ok(true)
+    }
+
+    /// Records a page that has been compiled from the sources of the given importer.
+    ///
+    /// The entry is written once all the pages of the script have been recorded.
+    pub fn record(&mut self, bytes: &[u8], sources: &FileImporter) {
+        self.pages.push(bytes.to_vec());
+        self.dependencies.extend(sources.source_paths());
+        if self.pages.len() == SCRIPT_PAGES {
+            // The cache is only an optimization, a failure must not prevent the script from running
+            if let Err(err) = self.store() {
+                eprintln!(
+                    "Could not write the bytecode cache in {}: {err}",
+                    self.dir.display()
+                );
+            }
+        }
+    }
+
+    fn store(&self) -> io::Result<()> {
+        fs::create_dir_all(&self.dir)?;
+
+        let mut manifest = format!("moshell bytecode cache {FORMAT_VERSION}\n");
+        for path in &self.dependencies {
+            let path = fs::canonicalize(path)?;
+            let content = fs::read(&path)?;
+            let Some(path) = path.to_str() else {
+                return Err(io::Error::new(
+                    io::ErrorKind::InvalidData,
+                    "non UTF-8 source path",
+                ));
+            };
+            manifest.push_str(&format!("{:016x} {path}\n", Fnv1a::hash(&content)));
+        }
+
+        for (page, bytes) in self.pages.iter().enumerate() {
+            write_atomically(&self.page_path(page), bytes)?;
+        }
+        // The manifest is written last, so that it only refers to complete pages
+        write_atomically(&self.dir.join("manifest"), manifest.as_bytes())
+    }
+
+    fn page_path(&self, page: usize) -> PathBuf {
+        self.dir.join(format!("page-{page}.bin"))
+    }
+}
+
+/// Writes a file through a rename, so that the processes that have mapped
+/// the previous file are not affected.
+fn write_atomically(path: &Path, bytes: &[u8]) -> io::Result<()> {
+    let tmp = path.with_extension(format!("tmp{}", std::process::id()));
+    fs::File::create(&tmp)?.write_all(bytes)?;
+    fs::rename(&tmp, path)
+}
+
+/// Identifies the running compiler, by its version and by the build of the executable.
+fn executable_identity() -> Option<String> {
+    let metadata = fs::metadata(std::env::current_exe().ok()?).ok()?;
+    let modified = metadata.modified().ok()?.duration_since(UNIX_EPOCH).ok()?;
+    Some(format!(
+        "{} {} {}",
+        env!("CARGO_PKG_VERSION"),
+        metadata.len(),
+        modified.as_nanos()
+    ))
+}
+
+/// The 64-bit FNV-1a hash, that is stable across Rust versions unlike [`std::hash::DefaultHasher`].
+struct Fnv1a(u64);
+
+impl Default for Fnv1a {
+    fn default() -> Self {
+        Self(0xcbf29ce484222325)
+    }
+}
+
+impl Fnv1a {
+    fn hash(bytes: &[u8]) -> u64 {
+        let mut hasher = Self::default();
+        hasher.write(bytes);
+        hasher.finish()
+    }
+
+    fn write(&mut self, bytes: &[u8]) {
+        for &byte in bytes {
+            self.0 ^= u64::from(byte);
+            self.0 = self.0.wrapping_mul(0x100000001b3);
+        }
+    }
+
+    fn finish(&self) -> u64 {
+        self.0
+    }
+}
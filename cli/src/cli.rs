@@ -15,6 +15,7 @@ use compiler::{compile_reef, CompilerOptions, SourceLineProvider};
 use context::source::ContentId;
 use vm::{VmError, VM};
 
+use crate::cache::BytecodeCache;
 use crate::disassemble::display_bytecode;
 use crate::pipeline::{FileImportError, PipelineStatus, SourceHolder, SourcesCache};
 use crate::report::{display_diagnostic, display_parse_error};
@@ -43,6 +44,10 @@ pub struct Cli {
     #[arg(long = "no-execute")]
     pub(crate) no_execute: bool,
 
+    /// Do not use nor write the compiled bytecode cache
+    #[arg(long = "no-cache")]
+    pub(crate) no_cache: bool,
+
     /// Generate tab-completion scripts for your shell
     #[arg(long = "completions")]
     pub(crate) completions: Option<Shell>,
@@ -103,6 +108,7 @@ pub fn use_pipeline(
     errors: Vec<FileImportError>,
     sources: &SourcesCache,
     config: &Cli,
+    cache: Option<&mut BytecodeCache>,
 ) -> PipelineStatus {
     if errors.is_empty() && analyzer.resolution.engine.is_empty() {
         eprintln!("No module found for entry point {entry_point}");
@@ -196,15 +202,31 @@ pub fn use_pipeline(
         display_bytecode(&bytes);
     }
 
+    if let Some(cache) = cache {
+        cache.record(&bytes, importer);
+    }
+
     if !config.no_execute {
         vm.register(&bytes)
             .expect("compilation created invalid bytecode");
         drop(bytes);
-        match unsafe { vm.run() } {
-            Ok(()) => {}
-            Err(VmError::Panic) => return PipelineStatus::ExecutionFailure,
-            Err(VmError::Internal) => panic!("VM internal error"),
-        }
+        return execute(vm);
     }
     PipelineStatus::Success
 }
+
+/// Executes the bytecode that has been registered in the VM.
+pub fn execute(vm: &mut VM) -> PipelineStatus {
+    match unsafe { vm.run() } {
+        Ok(()) => PipelineStatus::Success,
+        Err(VmError::Panic) => PipelineStatus::ExecutionFailure,
+        Err(VmError::Internal) => panic!("VM internal error"),
+    }
+}
+
+impl Cli {
+    /// Tells if the compiled bytecode of the source may be loaded from and written to the cache.
+    pub(crate) fn use_cache(&self) -> bool {
+        !self.no_cache && !self.disassemble && !self.ast && !self.no_execute
+    }
+}
@@ -119,7 +119,7 @@ fn display_code(
         print!("\t\t#{instruction_address:<instruction_pad$}: {mnemonic:7} ");
 
         match opcode {
-            Opcode::PushInt => print!("<value {}>", read!(cursor, i64)),
+            Opcode::PushInt | Opcode::IntAddConst => print!("<value {}>", read!(cursor, i64)),
             Opcode::PushByte => print!("<value {}>", read!(cursor, u8)),
             Opcode::PushFloat => print!("<value {}>", read!(cursor, f64)),
             Opcode::PushStringRef => {
@@ -132,7 +132,8 @@ fn display_code(
             | Opcode::GetLocalByte
             | Opcode::GetLocalQWord
             | Opcode::SetLocalByte
-            | Opcode::SetLocalQWord => print!("<local @{}>", read!(cursor, u32)),
+            | Opcode::SetLocalQWord
+            | Opcode::GetLocalRefQWord => print!("<local @{}>", read!(cursor, u32)),
 
             Opcode::SetStructQWord
             | Opcode::GetStructQWord
@@ -174,6 +175,14 @@ fn display_code(
             Opcode::IfJump | Opcode::IfNotJump | Opcode::Jump | Opcode::Fork => {
                 print!("<instruction #{}>", read!(cursor, u32))
             }
+            Opcode::IntCompareIfJump | Opcode::IntCompareIfNotJump => {
+                let comparison = Opcode::try_from(read!(cursor, u8)).expect("Unknown opcode");
+                print!(
+                    "<{}> <instruction #{}>",
+                    get_opcode_mnemonic(comparison),
+                    read!(cursor, u32)
+                )
+            }
             _ => {} // Other opcodes do not define parameters
         }
         println!()
@@ -336,5 +345,9 @@ fn get_opcode_mnemonic(opcode: Opcode) -> &'static str {
         Opcode::FloatLessOrEqual => "fle",
         Opcode::FloatGreaterThan => "fgt",
         Opcode::FloatGreaterOrEqual => "fge",
+        Opcode::IntAddConst => "iaddc",
+        Opcode::GetLocalRefQWord => "lrqwget",
+        Opcode::IntCompareIfJump => "icmpjmp",
+        Opcode::IntCompareIfNotJump => "icmpnjmp",
     }
 }
@@ -1,4 +1,5 @@
-use crate::cli::{use_pipeline, Cli};
+use crate::cache::BytecodeCache;
+use crate::cli::{execute, use_pipeline, Cli};
 use crate::pipeline::{ErrorReporter, PipelineStatus, SourcesCache};
 use crate::repl::{code, repl};
 use crate::std::build_std;
@@ -16,6 +17,7 @@ use miette::{Context, IntoDiagnostic, MietteHandlerOpts};
 use nix::sys::signal;
 use vm::VM;
 
+mod cache;
 mod cli;
 mod complete;
 mod disassemble;
@@ -59,14 +61,28 @@ fn main() -> Result<PipelineStatus, miette::Error> {
     let mut externals = Externals::default();
     let mut compiler_externals = CompilerExternals::default();
     let mut sources = SourcesCache::default();
-    let mut vm = VM::new(
-        cli.source
-            .iter()
-            .flat_map(|p| p.to_str())
-            .map(ToOwned::to_owned)
-            .chain(cli.program_arguments.clone())
-            .collect(),
-    );
+    let arguments: Vec<String> = cli
+        .source
+        .iter()
+        .flat_map(|p| p.to_str())
+        .map(ToOwned::to_owned)
+        .chain(cli.program_arguments.clone())
+        .collect();
+    let mut vm = VM::new(arguments.clone());
+
+    let mut cache = cli
+        .source
+        .as_deref()
+        .filter(|_| cli.use_cache())
+        .and_then(BytecodeCache::for_script);
+    if let Some(cache) = &cache {
+        match cache.load(&mut vm) {
+            Ok(true) => return Ok(execute(&mut vm)),
+            Ok(false) => {}
+            // Start over with a fresh VM, the entry will be replaced
+            Err(_) => vm = VM::new(arguments),
+        }
+    }
 
     let current_dir = ::std::env::current_dir()
         .into_diagnostic()
@@ -78,10 +94,19 @@ fn main() -> Result<PipelineStatus, miette::Error> {
         &mut vm,
         &mut sources,
         &cli,
+        cache.as_mut(),
     );
 
     if let Some(source) = &cli.source {
-        return run(source, &cli, sources, externals, compiler_externals, vm);
+        return run(
+            source,
+            &cli,
+            sources,
+            externals,
+            compiler_externals,
+            vm,
+            cache,
+        );
     }
     if let Some(source) = cli.code.clone() {
         return code(
@@ -112,6 +137,7 @@ fn run(
     externals: Externals,
     mut compiler_externals: CompilerExternals,
     mut vm: VM,
+    mut cache: Option<BytecodeCache>,
 ) -> Result<PipelineStatus, miette::Error> {
     let name = Name::new(
         source
@@ -147,5 +173,6 @@ fn run(
         errors,
         &sources,
         cli,
+        cache.as_mut(),
     ))
 }
@@ -165,6 +165,13 @@ impl FileImporter {
         self.redirections.insert(name, path);
     }
 
+    /// Lists the paths of the files that have been imported.
+    pub fn source_paths(&self) -> impl Iterator<Item = PathBuf> + '_ {
+        self.sources
+            .iter()
+            .map(|source| self.root.join(&source.name))
+    }
+
     /// Gets the search path for a given name, by applying any existing redirection.
     fn get_search_path(&self, name: &Name) -> PathBuf {
         if let Some(path) = self.redirections.get(name) {
@@ -151,6 +151,7 @@ fn consume(
             errors,
             sources,
             config,
+            None,
         );
 
         // Remember the successfully injected source, or revert the analysis.
@@ -177,6 +178,7 @@ fn consume(
             importer.take_errors(),
             sources,
             config,
+            None,
         )
     }
 }
@@ -8,6 +8,7 @@ use cli::project_dir;
 use compiler::externals::CompilerExternals;
 use vm::VM;
 
+use crate::cache::BytecodeCache;
 use crate::cli::{use_pipeline, Cli};
 use crate::pipeline::{ErrorReporter, PipelineStatus, SourcesCache};
 
@@ -17,6 +18,7 @@ pub fn build_std(
     vm: &mut VM,
     sources: &mut SourcesCache,
     config: &Cli,
+    cache: Option<&mut BytecodeCache>,
 ) {
     let std_file = find_std();
     sources.register(std_file);
@@ -37,6 +39,7 @@ pub fn build_std(
         importer.take_errors(),
         sources,
         config,
+        cache,
     );
 
     match status {
@@ -0,0 +1,105 @@
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::process::Command;
+use tempfile::TempDir;
+
+/// A directory of scripts, whose compiled bytecode is cached in its own cache directory.
+struct Project {
+    dir: TempDir,
+}
+
+impl Project {
+    fn new(files: &[(&str, &str)]) -> Self {
+        let project = Self {
+            dir: TempDir::new().expect("could not create the project directory"),
+        };
+        for (name, content) in files {
+            project.write(name, content);
+        }
+        project
+    }
+
+    fn write(&self, name: &str, content: &str) {
+        fs::write(self.dir.path().join(name), content).expect("could not write a script");
+    }
+
+    /// Runs `main.msh` with the given standard library, returning its output if it succeeded.
+    fn run_with_std(&self, std: &Path) -> Option<String> {
+        let output = Command::new(env!("CARGO_BIN_EXE_moshell"))
+            .env("MOSHELL_STD", std)
+            .env("MOSHELL_CACHE_DIR", self.dir.path().join("cache"))
+            .arg(self.dir.path().join("main.msh"))
+            .current_dir(self.dir.path())
+            .output()
+            .expect("could not run moshell");
+        output
+            .status
+            .success()
+            .then(|| String::from_utf8(output.stdout).expect("the output is not UTF-8"))
+    }
+
+    /// Runs `main.msh`, compiling it if its cached bytecode is not up-to-date.
+    fn run(&self) -> String {
+        let std = Path::new(env!("CARGO_MANIFEST_DIR")).with_file_name("lib");
+        self.run_with_std(&std).expect("the script did not succeed")
+    }
+
+    /// Runs `main.msh` without any standard library to compile, which only succeeds from the cache.
+    fn run_cached(&self) -> Option<String> {
+        self.run_with_std(&self.dir.path().join("missing-lib"))
+    }
+
+    /// Gets the directory of the only cache entry.
+    fn entry(&self) -> PathBuf {
+        let mut entries = fs::read_dir(self.dir.path().join("cache"))
+            .expect("the cache directory was not created")
+            .map(|entry| entry.expect("could not read the cache directory").path());
+        let entry = entries.next().expect("no cache entry was written");
+        assert_eq!(entries.next(), None, "the script has several cache entries");
+        entry
+    }
+}
+
+#[test]
+fn hit() {
+    let project = Project::new(&[("main.msh", "echo 'first'")]);
+    assert_eq!(project.run(), "first\n");
+    assert_eq!(project.run_cached(), Some("first\n".to_owned()));
+}
+
+#[test]
+fn miss_after_source_edit() {
+    let project = Project::new(&[("main.msh", "echo 'first'")]);
+    assert_eq!(project.run(), "first\n");
+    // the content is hashed, regardless of the modification time
+    project.write("main.msh", "echo 'other'");
+    assert_eq!(project.run_cached(), None);
+    assert_eq!(project.run(), "other\n");
+    assert_eq!(project.run_cached(), Some("other\n".to_owned()));
+}
+
+#[test]
+fn invalidated_by_imported_file() {
+    let project = Project::new(&[
+        ("main.msh", "use reef::greeting::name\necho $name"),
+        ("greeting.msh", "val name = 'first'"),
+    ]);
+    assert_eq!(project.run(), "first\n");
+    assert_eq!(project.run_cached(), Some("first\n".to_owned()));
+    project.write("greeting.msh", "val name = 'other'");
+    assert_eq!(project.run_cached(), None);
+    assert_eq!(project.run(), "other\n");
+}
+
+#[test]
+fn corrupted_entry_is_replaced() {
+    let project = Project::new(&[("main.msh", "echo 'first'")]);
+    assert_eq!(project.run(), "first\n");
+
+    // the manifest is still valid, but the script's page is torn
+    let page = project.entry().join("page-1.bin");
+    let bytes = fs::read(&page).expect("the script's page was not written");
+    fs::write(&page, &bytes[..bytes.len() / 2]).expect("could not corrupt the page");
+    assert_eq!(project.run(), "first\n");
+    assert_eq!(project.run_cached(), Some("first\n".to_owned()));
+}
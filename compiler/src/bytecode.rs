@@ -102,6 +102,12 @@ pub struct Instructions<'a> {
 
     /// Starting byte position in the source code for some instruction pointers
     positions: Vec<InstructionPos>,
+
+    /// Position in the bytecode of the last emitted instruction, if the next one can be fused with it.
+    ///
+    /// It is cleared once the current instruction pointer may be the target of a jump,
+    /// as a jump must not land in the middle of a superinstruction.
+    last_instruction: Option<usize>,
 }
 
 impl<'a> Instructions<'a> {
@@ -110,6 +116,7 @@ impl<'a> Instructions<'a> {
             ip_offset: bytecode.len() as u32,
             bytecode,
             positions: Vec::new(),
+            last_instruction: None,
         }
     }
 
@@ -121,9 +128,58 @@ impl<'a> Instructions<'a> {
     }
 
     pub fn emit_code(&mut self, code: Opcode) {
+        let pos = self.bytecode.len();
+        if let Some(last) = self.last_instruction.take() {
+            if self.fuse_with(last, code) {
+                return;
+            }
+        }
+        self.last_instruction = Some(pos);
         self.bytecode.emit_byte(code as u8)
     }
 
+    /// Rewrites the complete instruction at the given position into the superinstruction
+    /// that performs it followed by the given opcode.
+    ///
+    /// Returns false if there is no such superinstruction.
+    fn fuse_with(&mut self, last: usize, code: Opcode) -> bool {
+        let operands_size = self.bytecode.len() - last - 1;
+        let last_code =
+            Opcode::try_from(self.bytecode.bytes[last]).expect("Unknown emitted opcode");
+        let fused = match (last_code, code) {
+            (Opcode::PushInt, Opcode::IntAdd) if operands_size == size_of::<i64>() => {
+                Opcode::IntAddConst
+            }
+            // reading a local through its reference is reading it
+            (Opcode::PushLocalRef, Opcode::GetRefQWord) if operands_size == size_of::<u32>() => {
+                Opcode::GetLocalQWord
+            }
+            (Opcode::GetLocalQWord, Opcode::GetRefQWord) if operands_size == size_of::<u32>() => {
+                Opcode::GetLocalRefQWord
+            }
+            (comparison, Opcode::IfJump | Opcode::IfNotJump)
+                if comparison.is_int_comparison() && operands_size == 0 =>
+            {
+                let fused = if code == Opcode::IfJump {
+                    Opcode::IntCompareIfJump
+                } else {
+                    Opcode::IntCompareIfNotJump
+                };
+                // the comparison becomes the first operand, followed by the jump address
+                self.bytecode.bytes[last] = fused as u8;
+                self.bytecode.emit_byte(comparison as u8);
+                return true;
+            }
+            _ => return false,
+        };
+        self.bytecode.bytes[last] = fused as u8;
+        if fused == Opcode::GetLocalQWord {
+            // the read local may itself be a captured reference
+            self.last_instruction = Some(last);
+        }
+        true
+    }
+
     pub fn emit_copy_operands(&mut self, count: u32) {
         self.emit_code(Opcode::StructCopyOperands);
         self.bytecode.emit_u32(count);
@@ -150,7 +206,7 @@ impl<'a> Instructions<'a> {
     pub fn push_position(&mut self, pos: usize) {
         self.positions.push(InstructionPos {
             source_code_byte_pos: pos,
-            instruction: self.current_ip(),
+            instruction: self.ip(),
         })
     }
 
@@ -341,8 +397,13 @@ impl<'a> Instructions<'a> {
         self.emit_instruction_pointer(start_idx);
     }
 
-    /// Returns the current instruction pointer
-    pub fn current_ip(&self) -> u32 {
+    /// Returns the current instruction pointer, so that it can be the target of a jump.
+    pub fn current_ip(&mut self) -> u32 {
+        self.last_instruction = None;
+        self.ip()
+    }
+
+    fn ip(&self) -> u32 {
         u32::try_from(self.bytecode.len()).expect("Too much bytecode") - self.ip_offset
     }
 }
@@ -437,4 +498,25 @@ pub enum Opcode {
     FloatLessOrEqual,
     FloatGreaterThan,
     FloatGreaterOrEqual,
+
+    IntAddConst,
+    GetLocalRefQWord,
+    IntCompareIfJump,
+    IntCompareIfNotJump,
+    /// Only rewritten by the VM loader from an invocation followed by a return,
+    /// as it depends on whether the function references its locals.
+    TailInvoke,
+}
+
+impl Opcode {
+    fn is_int_comparison(self) -> bool {
+        matches!(
+            self,
+            Opcode::IntEqual
+                | Opcode::IntLessThan
+                | Opcode::IntLessOrEqual
+                | Opcode::IntGreaterThan
+                | Opcode::IntGreaterOrEqual
+        )
+    }
 }
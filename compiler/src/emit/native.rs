@@ -1,3 +1,4 @@
+use analyzer::types;
 use analyzer::types::engine::FunctionId;
 use analyzer::types::hir::MethodCall;
 use analyzer::types::ty::TypeRef;
@@ -21,6 +22,21 @@ pub(super) const VEC_PUSH: &str = "lang::Vec::push";
 pub(super) const VEC_EXTEND: &str = "lang::Vec::extend";
 pub(super) const VEC_LEN: &str = "lang::Vec::len";
 const VEC_POP_HEAD: &str = "lang::Vec::pop_head";
+const VEC_INDEX_UNBOXED: [&str; 3] = [
+    "lang::Vec::index_int",
+    "lang::Vec::index_float",
+    "lang::Vec::index_byte",
+];
+const VEC_PUSH_UNBOXED: [&str; 3] = [
+    "lang::Vec::push_int",
+    "lang::Vec::push_float",
+    "lang::Vec::push_byte",
+];
+const VEC_INDEX_EQ_UNBOXED: [&str; 3] = [
+    "lang::Vec::index_set_int",
+    "lang::Vec::index_set_float",
+    "lang::Vec::index_set_byte",
+];
 const STRING_SPLIT: &str = "lang::String::split";
 const STRING_BYTES: &str = "lang::String::bytes";
 const GLOB_EXPAND: &str = "lang::glob::expand";
@@ -186,7 +202,10 @@ pub(crate) fn emit_natives(
                 locals,
                 state,
             );
-            instructions.emit_invoke(cp.insert_string(VEC_INDEX));
+            match unboxed_vec_native(receiver_ty, VEC_INDEX_UNBOXED) {
+                Some(native) => instructions.emit_invoke(cp.insert_string(native)),
+                None => instructions.emit_invoke(cp.insert_string(VEC_INDEX)),
+            }
         }
         35 => {
             // vector.push(T)
@@ -194,10 +213,14 @@ pub(crate) fn emit_natives(
                 .first()
                 .expect("Cannot push to a vector without a value");
             emit(first, instructions, ctx, cp, locals, state);
-            if state.use_values {
-                instructions.emit_box_if_primitive(first.ty);
+            if let Some(native) = unboxed_vec_native(first.ty, VEC_PUSH_UNBOXED) {
+                instructions.emit_invoke(cp.insert_string(native));
+            } else {
+                if state.use_values {
+                    instructions.emit_box_if_primitive(first.ty);
+                }
+                instructions.emit_invoke(cp.insert_string(VEC_PUSH));
             }
-            instructions.emit_invoke(cp.insert_string(VEC_PUSH));
         }
         36 => {
             // vector.pop() T
@@ -297,8 +320,12 @@ pub(crate) fn emit_natives(
             for arg in args {
                 emit(arg, instructions, ctx, cp, locals, state);
             }
-            instructions.emit_box_if_primitive(args[1].ty);
-            instructions.emit_invoke(cp.insert_string(VEC_INDEX_EQ));
+            if let Some(native) = unboxed_vec_native(args[1].ty, VEC_INDEX_EQ_UNBOXED) {
+                instructions.emit_invoke(cp.insert_string(native));
+            } else {
+                instructions.emit_box_if_primitive(args[1].ty);
+                instructions.emit_invoke(cp.insert_string(VEC_INDEX_EQ));
+            }
         }
         50 => {
             // Int -> Exitcode
@@ -319,7 +346,9 @@ pub(crate) fn emit_natives(
         id => todo!("Native function with id {id}"),
     };
 
-    let has_generic_return = matches!(native.0, 34 | 36 | 48);
+    // the elements of the unboxed vectors are directly read as primitives
+    let has_generic_return = matches!(native.0, 36 | 48)
+        || (native.0 == 34 && unboxed_vec_native(receiver_ty, VEC_INDEX_UNBOXED).is_none());
     if has_generic_return && !receiver_ty.is_obj() {
         instructions.emit_code(Opcode::Unbox);
     }
@@ -331,3 +360,14 @@ pub(crate) fn emit_natives(
         instructions.emit_pop(ValueStackSize::from(receiver_ty));
     }
 }
+
+/// Selects the variant of a vector native that takes or returns an unboxed value of the given element type,
+/// among the `Int`, `Float` and byte-sized variants.
+fn unboxed_vec_native(element: TypeRef, natives: [&'static str; 3]) -> Option<&'static str> {
+    match element {
+        types::INT => Some(natives[0]),
+        types::FLOAT => Some(natives[1]),
+        types::BOOL | types::EXITCODE => Some(natives[2]),
+        _ => None,
+    }
+}
@@ -0,0 +1,379 @@
+#include "definitions/loader.h"
+#include "definitions/pager.h"
+#include "interpreter.h"
+#include "memory/call_stack.h"
+#include "memory/gc.h"
+#include "opcode.h"
+#include "stdlib_natives.h"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * The state of a VM, whose parts are directly driven by the benchmarks.
+ */
+struct vm_fixture {
+    std::vector<std::string> program_args;
+    msh::loader loader;
+    msh::pager pager;
+    msh::heap heap;
+    CallStack call_stack{10000};
+    msh::gc gc{heap, call_stack, pager, loader};
+    natives_functions_t natives = load_natives();
+    runtime_memory mem{heap, program_args, gc};
+
+    /**
+     * the function of the root frame, whose locals are all object references
+     */
+    function_definition root_def{};
+
+    /**
+     * Pushes a root frame, whose operands and locals are roots for the collector.
+     *
+     * @param refs The number of object references in the locals of the frame.
+     */
+    stack_frame &push_root_frame(size_t refs = 0) {
+        root_def.locals_size = refs * sizeof(msh::obj *);
+        for (size_t i = 0; i < refs; i++) {
+            root_def.obj_ref_offsets.push_back(i * sizeof(msh::obj *));
+        }
+        call_stack.push_frame(root_def);
+        return call_stack.peek_frame();
+    }
+
+    /**
+     * Keeps an object alive through the given local reference of the root frame.
+     */
+    msh::obj &root(msh::obj &obj, size_t ref) {
+        call_stack.peek_frame().locals.set<msh::obj *>(&obj, ref * sizeof(msh::obj *));
+        return obj;
+    }
+};
+
+/**
+ * A function of a hand-assembled bytecode page, written in the bytecode's big endian layout.
+ */
+class assembled_function {
+    std::vector<uint8_t> code;
+
+    template <typename T>
+    void write(T value) {
+        for (size_t i = sizeof(T); i-- > 0;) {
+            code.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8)));
+        }
+    }
+
+public:
+    uint32_t identifier;
+    uint32_t locals_size;
+    uint32_t parameters_size;
+    uint8_t return_size;
+
+    assembled_function(uint32_t identifier, uint32_t locals_size, uint32_t parameters_size = 0, uint8_t return_size = 0)
+        : identifier{identifier}, locals_size{locals_size}, parameters_size{parameters_size}, return_size{return_size} {}
+
+    uint32_t position() const {
+        return static_cast<uint32_t>(code.size());
+    }
+
+    assembled_function &op(Opcode opcode) {
+        code.push_back(opcode);
+        return *this;
+    }
+
+    assembled_function &op(Opcode opcode, uint32_t operand) {
+        code.push_back(opcode);
+        write(operand);
+        return *this;
+    }
+
+    assembled_function &push_int(int64_t value) {
+        code.push_back(OP_PUSH_INT);
+        write(static_cast<uint64_t>(value));
+        return *this;
+    }
+
+    /**
+     * Sets the address of the jump whose operand ends at the given position.
+     */
+    void patch_jump(uint32_t operand_end, uint32_t target) {
+        for (size_t i = 0; i < sizeof(uint32_t); i++) {
+            code[operand_end - 1 - i] = static_cast<uint8_t>(target >> (i * 8));
+        }
+    }
+
+    void encode(std::vector<uint8_t> &out) const {
+        auto write_u32 = [&](uint32_t value) {
+            for (size_t i = sizeof(uint32_t); i-- > 0;) {
+                out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+            }
+        };
+        write_u32(identifier);
+        write_u32(locals_size);
+        write_u32(parameters_size);
+        out.push_back(return_size);
+        write_u32(position());
+        out.insert(out.end(), code.begin(), code.end());
+        write_u32(0); // no object references in the locals
+        out.push_back(0); // no attributes
+    }
+};
+
+/**
+ * Encodes a bytecode unit of a single page, without any dynamic symbol, export nor structure.
+ */
+static std::vector<uint8_t> encode_page(const std::vector<std::string> &constants, const assembled_function &main, const std::vector<assembled_function> &functions) {
+    std::vector<uint8_t> out;
+    auto write = [&](uint64_t value, size_t size) {
+        for (size_t i = size; i-- > 0;) {
+            out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    };
+    write(constants.size(), sizeof(uint32_t));
+    for (const std::string &constant : constants) {
+        write(constant.size(), sizeof(uint64_t));
+        out.insert(out.end(), constant.begin(), constant.end());
+    }
+    write(0, sizeof(uint32_t)); // dynamic symbols
+
+    main.encode(out);
+    write(0, sizeof(uint32_t)); // page size
+    write(0, sizeof(uint32_t)); // exports
+    write(0, sizeof(uint32_t)); // structures
+    write(functions.size(), sizeof(uint32_t));
+    for (const assembled_function &function : functions) {
+        function.encode(out);
+    }
+    return out;
+}
+
+/**
+ * Assembles a main function that counts up to `iterations` in a local, calling `body` at each iteration.
+ */
+template <typename F>
+static assembled_function assemble_loop(uint32_t identifier, int64_t iterations, F body) {
+    assembled_function main(identifier, sizeof(int64_t));
+    main.push_int(0).op(OP_LOCAL_SET_Q_WORD, 0);
+    uint32_t loop = main.position();
+    main.op(OP_LOCAL_GET_Q_WORD, 0).push_int(iterations).op(OP_INT_LT).op(OP_IF_NOT_JUMP, 0);
+    uint32_t exit_jump = main.position();
+    body(main);
+    main.op(OP_LOCAL_GET_Q_WORD, 0).push_int(1).op(OP_INT_ADD).op(OP_LOCAL_SET_Q_WORD, 0).op(OP_JUMP, loop);
+    main.patch_jump(exit_jump, main.position());
+    main.op(OP_RETURN);
+    return main;
+}
+
+/**
+ * Loads the given page in the fixture, and runs its main function at each benchmark iteration.
+ */
+static void run_page(benchmark::State &state, vm_fixture &vm, const std::vector<uint8_t> &bytes, int64_t items_per_run) {
+    vm.loader.load_raw_bytes(reinterpret_cast<const std::byte *>(bytes.data()), bytes.size(), vm.pager, vm.heap);
+    vm.loader.resolve_all(vm.pager, vm.natives);
+    const msh::memory_page &page = *vm.pager.cbegin();
+    for (auto _ : state) {
+        if (!run_unit(vm.call_stack, vm.loader, vm.pager, page, vm.mem, vm.natives)) {
+            state.SkipWithError("the page did not run to completion");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * items_per_run);
+}
+
+static void BM_Dispatch(benchmark::State &state) {
+    vm_fixture vm;
+    int64_t iterations = state.range(0);
+    assembled_function main = assemble_loop(0, iterations, [](assembled_function &f) {
+        // an arithmetic expression whose result is dropped
+        f.op(OP_LOCAL_GET_Q_WORD, 0).op(OP_DUP).op(OP_INT_MUL).op(OP_INT_NEG).op(OP_POP_Q_WORD);
+    });
+    run_page(state, vm, encode_page({"main"}, main, {}), iterations);
+}
+BENCHMARK(BM_Dispatch)->Arg(1 << 16);
+
+static void BM_Invoke(benchmark::State &state) {
+    vm_fixture vm;
+    int64_t iterations = state.range(0);
+    assembled_function main = assemble_loop(0, iterations, [](assembled_function &f) {
+        f.op(OP_LOCAL_GET_Q_WORD, 0).op(OP_INVOKE, 1).op(OP_POP_Q_WORD);
+    });
+    assembled_function identity(1, sizeof(int64_t), sizeof(int64_t), sizeof(int64_t));
+    identity.op(OP_LOCAL_GET_Q_WORD, 0).op(OP_RETURN);
+    run_page(state, vm, encode_page({"main", "identity"}, main, {identity}), iterations);
+}
+BENCHMARK(BM_Invoke)->Arg(1 << 16);
+
+static void BM_OperandStackPushPop(benchmark::State &state) {
+    vm_fixture vm;
+    OperandStack &operands = vm.push_root_frame().operands;
+    for (auto _ : state) {
+        for (int64_t i = 0; i < 64; i++) {
+            operands.push_int(i);
+        }
+        for (int i = 0; i < 64; i++) {
+            benchmark::DoNotOptimize(operands.pop_int());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 128);
+}
+BENCHMARK(BM_OperandStackPushPop);
+
+static void BM_CallStackPushFrame(benchmark::State &state) {
+    vm_fixture vm;
+    function_definition def{};
+    def.locals_size = 4 * sizeof(int64_t);
+    for (auto _ : state) {
+        vm.call_stack.push_frame(def);
+        vm.call_stack.pop_frame();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CallStackPushFrame);
+
+static void BM_HeapInsert(benchmark::State &state) {
+    vm_fixture vm;
+    int64_t count = state.range(0);
+    for (auto _ : state) {
+        for (int64_t i = 0; i < count; i++) {
+            benchmark::DoNotOptimize(&vm.heap.insert(i));
+        }
+        state.PauseTiming();
+        vm.gc.run();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_HeapInsert)->Arg(1 << 12)->Arg(1 << 16);
+
+/**
+ * Times a full collection of a graph of boxed integers, live through a vector held by a root frame.
+ */
+static void BM_GcRun(benchmark::State &state) {
+    vm_fixture vm;
+    vm.push_root_frame(1);
+
+    int64_t count = state.range(0);
+    msh::obj &vec_obj = vm.root(vm.heap.insert(msh::obj_vector()), 0);
+    msh::obj_vector &vec = vec_obj.get<msh::obj_vector>();
+    vec.reserve(count);
+    for (int64_t i = 0; i < count; i++) {
+        vec.push_back(&vm.heap.insert(i));
+    }
+    for (auto _ : state) {
+        vm.gc.run();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_GcRun)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
+
+/**
+ * Times the pause of an incremental collection of the same graph, that is its mark,
+ * and then the slices of the following sweep separately.
+ */
+static void BM_GcIncrementalPause(benchmark::State &state) {
+    vm_fixture vm;
+    vm.push_root_frame(1);
+    vm.gc.set_sweep_budget(1024);
+
+    int64_t count = state.range(0);
+    msh::obj &vec_obj = vm.root(vm.heap.insert(msh::obj_vector()), 0);
+    msh::obj_vector &vec = vec_obj.get<msh::obj_vector>();
+    vec.reserve(count);
+    for (int64_t i = 0; i < count; i++) {
+        vec.push_back(&vm.heap.insert(i));
+    }
+    for (auto _ : state) {
+        vm.gc.run();
+        state.PauseTiming();
+        while (vm.gc.is_sweeping()) {
+            vm.gc.sweep_slice();
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_GcIncrementalPause)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
+
+static void BM_GcSweepSlice(benchmark::State &state) {
+    vm_fixture vm;
+    vm.push_root_frame(1);
+    vm.gc.set_sweep_budget(state.range(0));
+
+    msh::obj &vec_obj = vm.root(vm.heap.insert(msh::obj_vector()), 0);
+    msh::obj_vector &vec = vec_obj.get<msh::obj_vector>();
+    for (int64_t i = 0; i < (1 << 18); i++) {
+        vec.push_back(&vm.heap.insert(i));
+    }
+    for (auto _ : state) {
+        if (!vm.gc.is_sweeping()) {
+            state.PauseTiming();
+            vm.gc.run();
+            state.ResumeTiming();
+        }
+        vm.gc.sweep_slice();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GcSweepSlice)->Arg(256)->Arg(4096);
+
+static void BM_StrConcat(benchmark::State &state) {
+    vm_fixture vm;
+    OperandStack &operands = vm.push_root_frame(2).operands;
+    msh::obj &left = vm.root(vm.heap.insert(std::string(state.range(0), 'a')), 0);
+    msh::obj &right = vm.root(vm.heap.insert(std::string(state.range(0), 'b')), 1);
+    native_function_t concat = vm.natives.at("lang::String::concat").function;
+    for (auto _ : state) {
+        operands.push_reference(left);
+        operands.push_reference(right);
+        concat(operands, vm.mem);
+        benchmark::DoNotOptimize(operands.pop_reference().get_string_length());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StrConcat)->Arg(8)->Arg(256);
+
+static void BM_StrSplit(benchmark::State &state) {
+    vm_fixture vm;
+    OperandStack &operands = vm.push_root_frame(2).operands;
+    std::string line;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        line += "word-" + std::to_string(i) + ' ';
+    }
+    msh::obj &str = vm.root(vm.heap.insert(std::move(line)), 0);
+    msh::obj &delimiter = vm.root(vm.heap.insert(std::string(" ")), 1);
+    native_function_t split = vm.natives.at("lang::String::split").function;
+    for (auto _ : state) {
+        operands.push_reference(str);
+        operands.push_reference(delimiter);
+        split(operands, vm.mem);
+        operands.pop_reference();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StrSplit)->Arg(1 << 10);
+
+static void BM_VecPush(benchmark::State &state) {
+    vm_fixture vm;
+    stack_frame &frame = vm.push_root_frame(2);
+    msh::obj &vec_obj = vm.root(vm.heap.insert(msh::obj_vector()), 0);
+    msh::obj &element = vm.root(vm.heap.insert(std::string("element")), 1);
+    native_function_t push = vm.natives.at("lang::Vec::push").function;
+
+    int64_t count = state.range(0);
+    for (auto _ : state) {
+        for (int64_t i = 0; i < count; i++) {
+            frame.operands.push_reference(vec_obj);
+            frame.operands.push_reference(element);
+            push(frame.operands, vm.mem);
+        }
+        state.PauseTiming();
+        vec_obj.get<msh::obj_vector>().clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_VecPush)->Arg(1 << 12);
+
+BENCHMARK_MAIN();
@@ -1,5 +1,20 @@
 use crate::value::VmValue;
-use crate::{moshell_vm_gc_collect, moshell_vm_gc_run, VmFFI};
+use crate::{
+    moshell_vm_gc_collect, moshell_vm_gc_run, moshell_vm_gc_set_percent,
+    moshell_vm_gc_set_sweep_budget, moshell_vm_gc_set_threads, moshell_vm_gc_stats, VmFFI,
+};
+
+/// Garbage collection statistics of a VM.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct GcStats {
+    pub collections: u64,
+    pub minor_collections: u64,
+    pub total_pause_ns: u64,
+    pub max_pause_ns: u64,
+    /// Number of objects kept alive by the last collection.
+    pub live_objects: u64,
+}
 
 pub struct GC {
     pub(crate) vm: VmFFI,
@@ -10,6 +25,33 @@ impl GC {
         unsafe { moshell_vm_gc_run(self.vm) }
     }
 
+    /// Sets the heap growth, in percent of the objects kept alive by the last collection,
+    /// that triggers the next automatic collection.
+    ///
+    /// A negative value disables the automatic collections.
+    pub fn set_growth_percent(&mut self, percent: i32) {
+        unsafe { moshell_vm_gc_set_percent(self.vm, percent) }
+    }
+
+    /// Sets the number of threads that mark the live objects during the full collections of large heaps.
+    ///
+    /// Zero and one mark the objects on the collecting thread only.
+    pub fn set_mark_threads(&mut self, threads: usize) {
+        unsafe { moshell_vm_gc_set_threads(self.vm, threads) }
+    }
+
+    /// Sets the number of objects swept by each slice of the incremental sweeps.
+    ///
+    /// Full collections then only mark the live objects, and the heap is swept by slices
+    /// before the next allocations. Zero sweeps the heap during the collections.
+    pub fn set_sweep_budget(&mut self, objects: usize) {
+        unsafe { moshell_vm_gc_set_sweep_budget(self.vm, objects) }
+    }
+
+    pub fn stats(&self) -> GcStats {
+        unsafe { moshell_vm_gc_stats(self.vm) }
+    }
+
     pub fn collect(&mut self) -> Vec<VmValue> {
         unsafe {
             let result = moshell_vm_gc_collect(self.vm);
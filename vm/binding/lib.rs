@@ -1,9 +1,12 @@
 use std::ffi;
-use std::ffi::CStr;
+use std::ffi::{CStr, CString};
+use std::os::unix::ffi::OsStrExt;
+use std::path::Path;
 
 use context::source::ContentId;
 
-use crate::gc::GC;
+use crate::gc::{GcStats, GC};
+use crate::value::VmValue;
 
 pub mod gc;
 pub mod value;
@@ -72,6 +75,23 @@ impl VM {
             .ok_or(VmError::Internal)
     }
 
+    /// Appends the bytecode of a compiled file to the VM.
+    ///
+    /// The file is mapped in memory, and its instructions are executed from the mapping when they need no decoding.
+    ///
+    /// # Safety
+    /// An invalid bytecode will almost certainly result in a deterministic error during loading,
+    /// or a non-deterministic error during execution.
+    pub fn register_file(&mut self, path: &Path) -> Result<(), VmError> {
+        if cfg!(miri) {
+            return Ok(()); // Not supported
+        }
+        let path = CString::new(path.as_os_str().as_bytes()).map_err(|_| VmError::Internal)?;
+        unsafe { moshell_vm_register_file(self.ffi, path.as_ptr()) != -1 }
+            .then_some(())
+            .ok_or(VmError::Internal)
+    }
+
     /// Executes the remaining bytecode.
     ///
     /// # Safety
@@ -87,6 +107,24 @@ impl VM {
         }
     }
 
+    /// Creates a new virtual machine in the state of this one, without executing its bytecode again.
+    ///
+    /// The registered bytecode is loaded again and the global variables are copied,
+    /// so that a virtual machine can be warmed up once and cloned for each execution.
+    pub fn try_clone(&self) -> Result<Self, VmError> {
+        if cfg!(miri) {
+            return Ok(Self::default()); // Not supported
+        }
+        let ffi = unsafe { moshell_vm_clone(self.ffi) };
+        if ffi.0.is_null() {
+            return Err(VmError::Internal);
+        }
+        Ok(Self {
+            ffi,
+            gc: GC { vm: ffi },
+        })
+    }
+
     /// Sets the process group ID if running in a terminal.
     ///
     /// Forked processes will be attached to this process group.
@@ -105,6 +143,17 @@ impl VM {
     pub fn get_exported_var(&self, name: &str) -> VmValueFFI {
         unsafe { moshell_vm_get_exported(self.ffi, name.as_ptr().cast(), name.len()) }
     }
+
+    /// Returns whether the instructions of the given function have been verified,
+    /// or `None` if no function has this name.
+    ///
+    /// The functions are verified once the page that loads them is run.
+    pub fn is_function_verified(&self, name: &str) -> Option<bool> {
+        match unsafe { moshell_vm_function_verified(self.ffi, name.as_ptr().cast(), name.len()) } {
+            -1 => None,
+            verified => Some(verified == 1),
+        }
+    }
 }
 
 impl Default for VM {
@@ -121,9 +170,20 @@ impl Drop for VM {
     }
 }
 
+/// The representation of the elements of an array.
+#[repr(C)]
+#[derive(Copy, Clone)]
+#[allow(dead_code)]
+enum VmArrayKind {
+    Obj,
+    Int,
+    Double,
+    Byte,
+}
+
 #[repr(C)]
 #[derive(Copy, Clone)]
-struct VmArrayFFI(usize, *mut VmValueFFI);
+struct VmArrayFFI(usize, VmArrayKind, *const ffi::c_void);
 #[repr(C)]
 #[derive(Copy, Clone)]
 struct VmStructureFFI(usize, *mut ffi::c_char);
@@ -202,13 +262,20 @@ impl VmObjectFFI {
     }
     /// # Safety
     /// The caller must ensure that the value has the correct type.
-    pub unsafe fn get_as_vec(self) -> Vec<VmObjectFFI> {
-        let msh_array = moshell_object_get_as_array(self);
-        let mut vec = Vec::with_capacity(msh_array.0);
-
-        for i in 0..msh_array.0 {
-            let val = *msh_array.1.wrapping_add(i);
-            vec.push(val.get_as_obj())
+    pub unsafe fn get_as_vec(self) -> Vec<VmValue> {
+        let VmArrayFFI(len, kind, data) = moshell_object_get_as_array(self);
+        let mut vec = Vec::with_capacity(len);
+
+        for i in 0..len {
+            // primitive elements are stored unboxed
+            vec.push(match kind {
+                VmArrayKind::Obj => {
+                    VmValue::deduce((*data.cast::<VmValueFFI>().add(i)).get_as_obj())
+                }
+                VmArrayKind::Int => VmValue::Int(*data.cast::<i64>().add(i)),
+                VmArrayKind::Double => VmValue::Double(*data.cast::<f64>().add(i)),
+                VmArrayKind::Byte => VmValue::Byte(*data.cast::<u8>().add(i)),
+            })
         }
         vec
     }
@@ -259,17 +326,31 @@ extern "C" {
 
     fn moshell_vm_register(vm: VmFFI, bytes: *const u8, bytes_count: usize) -> ffi::c_int;
 
+    fn moshell_vm_register_file(vm: VmFFI, path: *const ffi::c_char) -> ffi::c_int;
+
     fn moshell_vm_run(vm: VmFFI) -> ffi::c_int;
 
     fn moshell_set_pgid(vm: VmFFI, pgid: ffi::c_int);
 
     fn moshell_vm_next_page(vm: VmFFI) -> usize;
 
+    fn moshell_vm_clone(vm: VmFFI) -> VmFFI;
+
     fn moshell_vm_free(vm: VmFFI);
 
     fn moshell_vm_get_exported(vm: VmFFI, name: *const ffi::c_char, name_len: usize) -> VmValueFFI;
 
+    fn moshell_vm_function_verified(
+        vm: VmFFI,
+        name: *const ffi::c_char,
+        name_len: usize,
+    ) -> ffi::c_int;
+
     fn moshell_vm_gc_collect(vm: VmFFI) -> VmGcResultFFI;
     fn moshell_vm_gc_run(vm: VmFFI);
+    fn moshell_vm_gc_set_percent(vm: VmFFI, percent: ffi::c_int);
+    fn moshell_vm_gc_set_threads(vm: VmFFI, threads: usize);
+    fn moshell_vm_gc_set_sweep_budget(vm: VmFFI, objects: usize);
+    fn moshell_vm_gc_stats(vm: VmFFI) -> GcStats;
     fn gc_collection_result_free(res: VmGcResultFFI);
 }
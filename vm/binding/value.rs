@@ -48,13 +48,9 @@ impl VmValue {
                 VmObjectType::Double => VmValue::Double(value.unbox().get_as_double()),
                 VmObjectType::Byte => VmValue::Byte(value.unbox().get_as_u8()),
                 VmObjectType::Str => VmValue::String(value.get_as_string()),
-                VmObjectType::Vec => VmValue::Vec(
-                    value
-                        .get_as_vec()
-                        .into_iter()
-                        .map(|v| Some(VmValue::deduce(v)))
-                        .collect(),
-                ),
+                VmObjectType::Vec => {
+                    VmValue::Vec(value.get_as_vec().into_iter().map(Some).collect())
+                }
                 VmObjectType::Struct => {
                     // we have no information about
                     VmValue::Struct(vec![])
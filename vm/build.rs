@@ -11,6 +11,10 @@ fn main() {
         println!("cargo:rustc-link-lib=asan");
     }
 
+    if cfg!(feature = "jit") {
+        config.define("MOSHELL_VM_JIT", "ON");
+    }
+
     // Statically link to the VM library.
     let dst = config.build();
     println!("cargo:rustc-link-search=native={}", dst.display());
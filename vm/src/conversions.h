@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include <bit>
+#include <cstring>
 
 namespace msh {
     /**
@@ -18,4 +20,61 @@ namespace msh {
         std::reverse_copy(bytes, bytes + sizeof(T), reinterpret_cast<std::byte *>(&val));
         return val;
     }
+
+    /**
+     * Write a value to a byte array in network byte order (big endian).
+     *
+     * @tparam T The type of the value to write.
+     * @param bytes The byte array to write to.
+     * @param value The value to write.
+     */
+    template <typename T>
+    void write_big_endian(std::byte *bytes, T value)
+        requires std::is_trivial_v<T>
+    {
+        const std::byte *val = reinterpret_cast<const std::byte *>(&value);
+        std::reverse_copy(val, val + sizeof(T), bytes);
+    }
+
+    /**
+     * Read a value from a possibly unaligned byte array in host byte order.
+     *
+     * @tparam T The type of the value to read.
+     * @param bytes The byte array to read from.
+     * @return The value read.
+     */
+    template <typename T>
+    T read_native_endian(const std::byte *bytes)
+        requires std::is_trivial_v<T>
+    {
+        T val;
+        std::memcpy(&val, bytes, sizeof(T));
+        return val;
+    }
+
+    /**
+     * Write a value to a possibly unaligned byte array in host byte order.
+     *
+     * @tparam T The type of the value to write.
+     * @param bytes The byte array to write to.
+     * @param value The value to write.
+     */
+    template <typename T>
+    void write_native_endian(std::byte *bytes, T value)
+        requires std::is_trivial_v<T>
+    {
+        std::memcpy(bytes, &value, sizeof(T));
+    }
+
+    /**
+     * Convert in place a value stored in network byte order (big endian) to host byte order.
+     *
+     * @param bytes The bytes of the value.
+     * @param size The size of the value.
+     */
+    inline void big_endian_to_native(std::byte *bytes, size_t size) {
+        if constexpr (std::endian::native == std::endian::little) {
+            std::reverse(bytes, bytes + size);
+        }
+    }
 }
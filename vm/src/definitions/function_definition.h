@@ -5,6 +5,10 @@
 #include <string_view>
 #include <vector>
 
+namespace msh {
+    class native_code;
+}
+
 /**
  * Contains all the information about a function
  */
@@ -31,9 +35,10 @@ struct function_definition {
     uint8_t return_byte_count;
 
     /**
-     * Index of the first instruction to execute.
+     * The first instruction to execute.
+     * The instructions are terminated by a return instruction.
      */
-    size_t instructions_start;
+    const std::byte *instructions;
 
     /**
      * Number of instructions in bytes.
@@ -57,4 +62,26 @@ struct function_definition {
      * The vector must be sorted in ascending order by instructions count.
      * */
     std::vector<std::pair<size_t, size_t>> mappings;
+
+    /**
+     * Whether the instructions have been verified at load time,
+     * so that the function can be run without any runtime check.
+     */
+    bool verified = false;
+
+    /**
+     * Maximum size, in bytes, reached by the operand stack of the function's frames.
+     * Only known if the function is verified.
+     */
+    size_t max_stack_size = 0;
+
+    /**
+     * Number of entries and backward jumps of the function's frames, counted until the function is compiled.
+     */
+    mutable uint32_t hotness = 0;
+
+    /**
+     * The native code of the function, once compiled by the JIT.
+     */
+    mutable const msh::native_code *native_code = nullptr;
 };
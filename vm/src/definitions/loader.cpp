@@ -1,13 +1,151 @@
 #include "loader.h"
 
 #include "byte_reader.h"
+#include "conversions.h"
 #include "memory/constant_pool.h"
+#include "opcode.h"
 #include "pager.h"
+#include "peephole.h"
+#include "verifier.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define MAPPINGS_ATTRIBUTE 1
 
 namespace msh {
+    /**
+     * Converts the operands of instructions from network byte order to host byte order,
+     * so that the interpreter reads them without any byte swap.
+     */
+    static void decode_operands(std::byte *instructions, size_t instruction_count) {
+        size_t ip = 0;
+        while (ip < instruction_count) {
+            Opcode opcode = static_cast<Opcode>(instructions[ip]);
+            size_t size = opcode_operands_size(opcode);
+            if (ip + 1 + size > instruction_count) {
+                // a truncated instruction
+                break;
+            }
+            size_t jump_operand = opcode_jump_operand(opcode);
+            if (jump_operand > 1) {
+                // the jump address follows a single byte operand
+                big_endian_to_native(instructions + ip + jump_operand, sizeof(uint32_t));
+            } else if (size > 1) {
+                big_endian_to_native(instructions + ip + 1, size);
+            }
+            ip += 1 + size;
+        }
+    }
+
+    /**
+     * Whether the operands of the given instructions have to be converted to host byte order.
+     */
+    static bool has_encoded_operands(const std::byte *instructions, size_t instruction_count) {
+        if constexpr (std::endian::native == std::endian::big) {
+            return false;
+        }
+        size_t ip = 0;
+        while (ip < instruction_count) {
+            Opcode opcode = static_cast<Opcode>(instructions[ip]);
+            size_t size = opcode_operands_size(opcode);
+            if (ip + 1 + size > instruction_count) {
+                break;
+            }
+            if (size > 1 || opcode_jump_operand(opcode) != 0) {
+                return true;
+            }
+            ip += 1 + size;
+        }
+        return false;
+    }
+
+    /**
+     * Whether the last of the given instructions is a complete return instruction.
+     */
+    static bool ends_with_return(const std::byte *instructions, size_t instruction_count) {
+        Opcode last_opcode = OP_RETURN;
+        size_t ip = 0;
+        while (ip < instruction_count) {
+            last_opcode = static_cast<Opcode>(instructions[ip]);
+            ip += 1 + opcode_operands_size(last_opcode);
+        }
+        return instruction_count != 0 && last_opcode == OP_RETURN && ip == instruction_count;
+    }
+
+    /**
+     * Copies the given instructions, terminated by a return instruction.
+     */
+    static std::unique_ptr<std::byte[]> terminated_copy(const std::byte *instructions, size_t instruction_count) {
+        std::unique_ptr<std::byte[]> copy = std::make_unique_for_overwrite<std::byte[]>(instruction_count + 1);
+        std::memcpy(copy.get(), instructions, instruction_count);
+        copy[instruction_count] = static_cast<std::byte>(OP_RETURN);
+        return copy;
+    }
+
+    loader::~loader() {
+        for (auto [addr, size] : mappings) {
+            munmap(addr, size);
+        }
+    }
+
     void loader::load_raw_bytes(const std::byte *bytes, size_t size, pager &pager, msh::heap &heap) {
+        load_copy(bytes, size, unit_bytes::owned, pager, heap);
+    }
+
+    void loader::load_copy(const std::byte *bytes, size_t size, unit_bytes kind, pager &pager, msh::heap &heap) {
+        std::unique_ptr<std::byte[]> copy = std::make_unique_for_overwrite<std::byte[]>(size);
+        std::memcpy(copy.get(), bytes, size);
+        load(owned_bytes.emplace_back(std::move(copy)).get(), size, kind, pager, heap);
+    }
+
+    void loader::load_mapped_file(const std::string &path, pager &pager, msh::heap &heap) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            throw std::runtime_error("Cannot open bytecode file \"" + path + "\": " + strerror(errno));
+        }
+        struct stat st;
+        int err = fstat(fd, &st) == -1 ? errno : 0;
+        if (err == 0 && (!S_ISREG(st.st_mode) || st.st_size == 0)) {
+            // only a non-empty regular file can be mapped
+            err = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+        }
+        if (err != 0) {
+            close(fd);
+            throw std::runtime_error("Cannot map bytecode file \"" + path + "\": " + strerror(err));
+        }
+        size_t size = st.st_size;
+        // a private mapping, so that the file can be replaced while it is mapped
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        err = errno;
+        close(fd);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("Cannot map bytecode file \"" + path + "\": " + strerror(err));
+        }
+        mappings.emplace_back(addr, size);
+        load(static_cast<const std::byte *>(addr), size, unit_bytes::mapped, pager, heap);
+    }
+
+    void loader::load_units_of(const loader &other, pager &pager, msh::heap &heap) {
+        for (const loaded_unit &unit : other.units) {
+            try {
+                // the functions of an owned unit have been decoded in place
+                load_copy(unit.bytes, unit.size, unit.kind == unit_bytes::mapped ? unit_bytes::owned : unit_bytes::decoded, pager, heap);
+            } catch (const std::exception &) {
+                // the other loader has failed the same way, and kept what it could load of the unit
+            }
+        }
+    }
+
+    void loader::load(const std::byte *bytes, size_t size, unit_bytes kind, pager &pager, msh::heap &heap) {
+        units.push_back({bytes, size, kind});
         ByteReader reader(bytes, size);
 
         ConstantPool tmp_pool = load_constant_pool(reader, heap);
@@ -23,7 +161,7 @@ namespace msh {
         while (reader.position() < size) {
             // Read main function
             {
-                const auto &[identifier, function] = load_function(reader, pool, pool_index);
+                const auto &[identifier, function] = load_function(reader, pool, pool_index, kind);
 
                 // read page exports
                 uint32_t page_size = reader.read<uint32_t>();
@@ -49,7 +187,7 @@ namespace msh {
 
             uint32_t functions_len = reader.read<uint32_t>();
             for (uint32_t i = 0; i < functions_len; ++i) {
-                load_function(reader, pool, pool_index);
+                load_function(reader, pool, pool_index, kind);
             }
         }
     }
@@ -85,10 +223,6 @@ namespace msh {
         return exported.at(name);
     }
 
-    const std::byte *loader::get_instructions(size_t index) const {
-        return concatened_instructions.data() + index;
-    }
-
     std::pair<const std::string &, const msh::struct_definition &> loader::load_structure(ByteReader &reader, const ConstantPool &pool) {
         constant_index id_idx = reader.read<constant_index>();
         const std::string &identifier = pool.get_string(id_idx);
@@ -109,7 +243,7 @@ namespace msh {
         return *structures.insert_or_assign(identifier, def).first;
     }
 
-    std::pair<const std::string &, const function_definition &> loader::load_function(ByteReader &reader, const ConstantPool &pool, size_t pool_index) {
+    std::pair<const std::string &, const function_definition &> loader::load_function(ByteReader &reader, const ConstantPool &pool, size_t pool_index, unit_bytes kind) {
         constant_index id_idx = reader.read<constant_index>();
         const std::string &identifier = pool.get_string(id_idx);
 
@@ -119,8 +253,56 @@ namespace msh {
         uint32_t instruction_count = reader.read<uint32_t>();
 
         const std::byte *instructions = reader.read_n<std::byte>(instruction_count);
-        size_t effective_address = concatened_instructions.size();
-        std::copy(instructions, instructions + instruction_count, std::back_inserter(concatened_instructions));
+
+        // the operands are converted to host byte order, so that the interpreter reads them without any byte swap:
+        // in place in an owned unit, and in a copy of the function for a mapped one, if it has any operand to convert
+        std::unique_ptr<std::byte[]> copy;
+        if (kind == unit_bytes::owned) {
+            // the owned units are writable
+            decode_operands(const_cast<std::byte *>(instructions), instruction_count);
+        } else if (kind == unit_bytes::mapped && has_encoded_operands(instructions, instruction_count)) {
+            copy = terminated_copy(instructions, instruction_count);
+            decode_operands(copy.get(), instruction_count);
+            instructions = copy.get();
+        }
+
+        // find invocation and instantiation sites, to bind them once all the functions and structures are loaded
+        size_t ip = 0;
+        while (ip < instruction_count) {
+            Opcode opcode = static_cast<Opcode>(instructions[ip++]);
+            if (opcode == OP_INVOKE && ip + sizeof(constant_index) <= instruction_count) {
+                constant_index callee_idx = read_native_endian<constant_index>(instructions + ip);
+                if (callee_idx >= pool.get_size()) {
+                    throw InvalidBytecodeError("Invalid function identifier index " + std::to_string(callee_idx) + " in function " + identifier);
+                }
+                unresolved_calls.push({pool_index, callee_idx});
+            } else if (opcode == OP_STRUCT_NEW && ip + sizeof(constant_index) <= instruction_count) {
+                constant_index structure_idx = read_native_endian<constant_index>(instructions + ip);
+                if (structure_idx >= pool.get_size()) {
+                    throw InvalidBytecodeError("Invalid structure identifier index " + std::to_string(structure_idx) + " in function " + identifier);
+                }
+                unresolved_structures.push({pool_index, structure_idx});
+            }
+            ip += opcode_operands_size(opcode);
+        }
+
+        std::vector<uint32_t> relocations;
+        std::vector<std::byte> fused = fuse_instructions(instructions, instruction_count, relocations);
+
+        // the instructions must be terminated by a return instruction, so that the interpreter does not have to
+        // check if the instruction pointer reached the end of the function on every instruction,
+        // otherwise they are executed where they have been loaded
+        if (!fused.empty()) {
+            copy = terminated_copy(fused.data(), fused.size());
+            instructions = copy.get();
+            instruction_count = fused.size();
+        } else if (!copy && !ends_with_return(instructions, instruction_count)) {
+            copy = terminated_copy(instructions, instruction_count);
+            instructions = copy.get();
+        }
+        if (copy) {
+            owned_bytes.emplace_back(std::move(copy));
+        }
 
         uint32_t offsets_count = reader.read<uint32_t>();
         std::vector<uint32_t> offsets;
@@ -134,7 +316,7 @@ namespace msh {
             locals_byte_count,
             parameters_byte_count,
             return_byte_count,
-            effective_address,
+            instructions,
             instruction_count,
             pool_index,
             offsets,
@@ -155,6 +337,9 @@ namespace msh {
                 for (uint32_t i = 0; i < mappings_count; i++) {
                     size_t instruction_start = reader.read<uint32_t>();
                     size_t line = reader.read<uint32_t>();
+                    if (!relocations.empty()) {
+                        instruction_start = relocations[std::min(instruction_start, relocations.size() - 1)];
+                    }
                     def.mappings.push_back({instruction_start, line});
                 }
                 break;
@@ -164,10 +349,25 @@ namespace msh {
             }
         }
 
-        return *functions.insert_or_assign(identifier, def).first;
+        auto [it, inserted] = functions.insert_or_assign(identifier, def);
+        redefined |= !inserted;
+        unverified.push_back(&it->second);
+        return *it;
+    }
+
+    call_target loader::resolve_call(const std::string &identifier, const natives_functions_t &natives) const {
+        auto function_it = functions.find(identifier);
+        if (function_it != functions.end()) {
+            return {&function_it->second, nullptr};
+        }
+        auto native_it = natives.find(identifier);
+        if (native_it != natives.end()) {
+            return {nullptr, &native_it->native};
+        }
+        return {nullptr, nullptr};
     }
 
-    void loader::resolve_all(pager &pager) {
+    void loader::resolve_all(pager &pager, const natives_functions_t &natives) {
         while (!unresolved.empty()) {
             auto [pool_index, index, name] = unresolved.top();
             unresolved.pop();
@@ -177,5 +377,38 @@ namespace msh {
             }
             pager.bind(pool_index, index, it->second);
         }
+
+        while (!unresolved_calls.empty()) {
+            auto [pool_index, identifier_idx] = unresolved_calls.top();
+            unresolved_calls.pop();
+            const std::string &identifier = pager.get_pool(pool_index).get_string(identifier_idx);
+            pager.bind_call(pool_index, identifier_idx, resolve_call(identifier, natives));
+        }
+
+        while (!unresolved_structures.empty()) {
+            auto [pool_index, identifier_idx] = unresolved_structures.top();
+            unresolved_structures.pop();
+            auto it = structures.find(pager.get_pool(pool_index).get_string(identifier_idx));
+            if (it != structures.end()) {
+                pager.bind_structure(pool_index, identifier_idx, &it->second);
+            }
+        }
+
+        if (redefined) {
+            // the stack effect of a redefined function may differ from the verified invocations of the previous one
+            unverified.clear();
+            for (auto &[identifier, def] : functions) {
+                // the native code assumed the previous stack effects too
+                def.native_code = nullptr;
+                def.hotness = 0;
+                unverified.push_back(&def);
+            }
+            redefined = false;
+        }
+        for (function_definition *def : unverified) {
+            size_t pool_index = def->constant_pool_index;
+            verify_function(*def, pager.get_pool(pool_index), pager.get_dynsym_count(pool_index), pager.get_call_targets(pool_index));
+        }
+        unverified.clear();
     }
 }
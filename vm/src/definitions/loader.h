@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
 #include <stack>
 #include <string>
 #include <unordered_map>
@@ -10,11 +11,13 @@
 #include "definitions/struct_definition.h"
 #include "memory/constant_pool.h"
 #include "memory/heap.h"
+#include "stdlib_natives.h"
 
 class ByteReader;
 
 namespace msh {
     class pager;
+    struct call_target;
 
     struct unresolved_variable {
         size_t pool_index;
@@ -22,6 +25,16 @@ namespace msh {
         std::string symbol_name;
     };
 
+    struct unresolved_call {
+        size_t pool_index;
+        constant_index identifier_idx;
+    };
+
+    struct unresolved_structure {
+        size_t pool_index;
+        constant_index identifier_idx;
+    };
+
     /**
      * The effective location in the virtual memory for a given exported symbol.
      */
@@ -42,6 +55,30 @@ namespace msh {
         bool is_obj_ref;
     };
 
+    /**
+     * How the bytes of a loaded unit are stored.
+     */
+    enum class unit_bytes {
+        /**
+         * A read-only mapping of a bytecode file, whose functions are copied if they have to be decoded.
+         */
+        mapped,
+        /**
+         * A copy owned by the loader, whose functions are decoded in place.
+         */
+        owned,
+        /**
+         * A copy of an owned unit whose functions have already been decoded.
+         */
+        decoded,
+    };
+
+    struct loaded_unit {
+        const std::byte *bytes;
+        size_t size;
+        unit_bytes kind;
+    };
+
     class loader {
         using function_map = std::unordered_map<std::string, function_definition>;
         using structure_map = std::unordered_map<std::string, struct_definition>;
@@ -63,21 +100,69 @@ namespace msh {
         exported_variable_map exported;
 
         /**
-         * The instructions bytes that have been loaded and concatenated.
+         * The bytecode buffers owned by the loader, that the functions' instructions point into.
+         */
+        std::vector<std::unique_ptr<std::byte[]>> owned_bytes;
+
+        /**
+         * The bytecode files mapped in memory, with their size.
+         */
+        std::vector<std::pair<void *, size_t>> mappings;
+
+        /**
+         * The bytes of each loaded unit, in loading order, that are either owned or mapped.
          */
-        std::vector<std::byte> concatened_instructions;
+        std::vector<loaded_unit> units;
 
         /**
          * The unresolved symbols that have been found and need to be resolved.
          */
         std::stack<unresolved_variable> unresolved;
 
-        std::pair<const std::string &, const function_definition &> load_function(ByteReader &reader, const ConstantPool &pool, size_t pool_index);
+        /**
+         * The function invocation sites that have been found and need to be bound to their target.
+         */
+        std::stack<unresolved_call> unresolved_calls;
+
+        /**
+         * The structure instantiation sites that have been found and need to be bound to their definition.
+         */
+        std::stack<unresolved_structure> unresolved_structures;
+
+        /**
+         * The functions that have been loaded and need to be verified once their invocation sites are bound.
+         */
+        std::vector<function_definition *> unverified;
+
+        /**
+         * Whether a loaded function did replace a previous definition,
+         * in which case the functions that invoke it need to be verified again.
+         */
+        bool redefined = false;
+
+        /**
+         * Loads the given bytes, that must outlive the loader.
+         */
+        void load(const std::byte *bytes, size_t size, unit_bytes kind, pager &pager, msh::heap &heap);
+
+        /**
+         * Loads a copy of the given bytes, that is owned by the loader.
+         */
+        void load_copy(const std::byte *bytes, size_t size, unit_bytes kind, pager &pager, msh::heap &heap);
+
+        std::pair<const std::string &, const function_definition &> load_function(ByteReader &reader, const ConstantPool &pool, size_t pool_index, unit_bytes kind);
         std::pair<const std::string &, const struct_definition &> load_structure(ByteReader &reader, const ConstantPool &pool);
 
     public:
+        loader() = default;
+        loader(const loader &) = delete;
+        loader &operator=(const loader &) = delete;
+        ~loader();
+
         /**
          * Loads the given bytes and init the pager without running any function.
+         * The bytes are copied once, so they can be freed after this call,
+         * and the functions are decoded to host byte order in place in the copy.
          *
          * @param bytes The bytes to load.
          * @param size The array size of the bytes.
@@ -86,6 +171,30 @@ namespace msh {
          */
         void load_raw_bytes(const std::byte *bytes, size_t size, pager &pager, msh::heap &heap);
 
+        /**
+         * Maps the given compiled bytecode file in memory and loads it.
+         *
+         * The instructions of the functions that need no decoding to host byte order nor any rewrite
+         * are executed from the mapping, which is only paged in when they are reached,
+         * and whose pages are shared with the other processes mapping the file.
+         *
+         * @param path The path of the bytecode file.
+         * @param pager The pager where to initialize the memory.
+         * @param heap The heap heap where to store the constant strings.
+         * @throws std::runtime_error If the file cannot be mapped.
+         */
+        void load_mapped_file(const std::string &path, pager &pager, msh::heap &heap);
+
+        /**
+         * Loads a copy of all the units loaded by another loader, in the same order,
+         * so that the pages, exports and definitions of this loader are laid out as those of the other one.
+         *
+         * @param other The loader whose units to load.
+         * @param pager The pager where to initialize the memory.
+         * @param heap The heap heap where to store the constant strings.
+         */
+        void load_units_of(const loader &other, pager &pager, msh::heap &heap);
+
         /**
          * Gets the function definition for the given name.
          *
@@ -125,19 +234,27 @@ namespace msh {
         const exported_variable &get_exported(const std::string &name) const;
 
         /**
-         * Gets the instructions bytes for the given index.
+         * Resolves all the unresolved symbols, binds the invocation and instantiation sites to their target,
+         * then verifies the loaded functions.
          *
-         * @param index The index of the instructions.
-         * @return The instructions bytes.
+         * Moshell functions have priority against native functions.
+         * Invocation sites that does not refer to any known function are left unbound,
+         * and will be resolved by the interpreter if they are ever reached.
+         * So are the instantiation sites of structures that are not loaded yet.
+         *
+         * @param pager The pager where to resolve the symbols.
+         * @param natives The native functions that can be bound.
+         * @throws std::runtime_error If any symbol cannot be resolved.
          */
-        const std::byte *get_instructions(size_t index) const;
+        void resolve_all(pager &pager, const natives_functions_t &natives);
 
         /**
-         * Resolves all the unresolved symbols.
+         * Resolves the invocation target of the given function identifier.
          *
-         * @param pager The pager where to resolve the symbols.
-         * @throws std::runtime_error If any symbol cannot be resolved.
+         * @param identifier The function identifier.
+         * @param natives The native functions that can be bound.
+         * @return The invocation target, whose fields are both null if no function is found.
          */
-        void resolve_all(pager &pager);
+        call_target resolve_call(const std::string &identifier, const natives_functions_t &natives) const;
     };
 }
@@ -10,7 +10,9 @@ namespace msh {
     size_t pager::push_pool(ConstantPool pool, size_t dynsym_size) {
         size_t index = pools.size();
         pools.push_back(std::move(pool));
-        indexes.emplace_back(dynsym_size, dynsym{static_cast<void *>(nullptr)});
+        dynsym_slots.emplace_back(dynsym_size, nullptr);
+        calls.emplace_back(pools.back().get_size(), call_target{nullptr, nullptr});
+        structures.emplace_back(pools.back().get_size(), nullptr);
         return index;
     }
 
@@ -35,8 +37,31 @@ namespace msh {
     }
 
     void pager::bind(size_t pool_index, size_t dynsym_id, exported_variable value) {
-        void *ptr = &pages.at(value.page).bytes.at(value.offset);
-        indexes.at(pool_index).at(dynsym_id) = ptr;
+        dynsym_slots.at(pool_index).at(dynsym_id) = &pages.at(value.page).bytes.at(value.offset);
+    }
+
+    void pager::bind_call(size_t pool_index, constant_index identifier_idx, call_target target) {
+        calls.at(pool_index).at(identifier_idx) = target;
+    }
+
+    call_target *pager::get_call_targets(size_t pool_index) {
+        return calls.at(pool_index).data();
+    }
+
+    void pager::bind_structure(size_t pool_index, constant_index identifier_idx, const struct_definition *definition) {
+        structures.at(pool_index).at(identifier_idx) = definition;
+    }
+
+    const struct_definition **pager::get_structure_targets(size_t pool_index) {
+        return structures.at(pool_index).data();
+    }
+
+    char *const *pager::get_dynsym_slots(size_t pool_index) const {
+        return dynsym_slots.at(pool_index).data();
+    }
+
+    size_t pager::get_dynsym_count(size_t pool_index) const {
+        return dynsym_slots.at(pool_index).size();
     }
 
     size_t pager::size() const {
@@ -3,14 +3,30 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
-#include <variant>
 #include <vector>
 
 #include "loader.h"
 #include "memory/constant_pool.h"
+#include "stdlib_natives.h"
 
 namespace msh {
-    using dynsym = std::variant<void *, function_definition *>;
+    /**
+     * A function invocation target, pre-resolved from the function identifier string constant
+     * so that the interpreter can invoke it without any string lookup.
+     *
+     * At most one of the two fields is set; if both are null, the target is not yet resolved.
+     */
+    struct call_target {
+        /**
+         * The moshell function to invoke, if any.
+         */
+        const function_definition *function;
+
+        /**
+         * The native function to invoke, if any.
+         */
+        const native_function *native;
+    };
 
     class gc;
 
@@ -38,7 +54,11 @@ namespace msh {
     class pager {
         using page_vector = std::vector<memory_page>;
 
-        using index_vector = std::vector<dynsym>;
+        using slot_vector = std::vector<char *>;
+
+        using call_vector = std::vector<call_target>;
+
+        using structure_vector = std::vector<const struct_definition *>;
 
         /**
          * The pages of memory that have been loaded.
@@ -53,9 +73,21 @@ namespace msh {
         std::vector<ConstantPool> pools;
 
         /**
-         * The dynamic symbols that have been loaded.
+         * The dynamic symbols of each constant pool, bound to the address of the variable they refer to.
+         */
+        std::vector<slot_vector> dynsym_slots;
+
+        /**
+         * The pre-resolved invocation targets of each constant pool, indexed by
+         * the constant index of the function identifier.
+         */
+        std::vector<call_vector> calls;
+
+        /**
+         * The pre-resolved instantiated structures of each constant pool, indexed by
+         * the constant index of the structure identifier.
          */
-        std::vector<index_vector> indexes;
+        std::vector<structure_vector> structures;
 
         friend gc;
 
@@ -112,37 +144,65 @@ namespace msh {
         void bind(size_t pool_index, size_t dynsym_id, exported_variable value);
 
         /**
-         * Gets the value of the given exported variable.
+         * Binds the given function identifier constant to an invocation target.
          *
-         * @tparam T The type of the value to get.
-         * @param exported The exported variable to get.
-         * @return The value of the exported variable.
+         * @param pool_index The index of the pool containing the function identifier.
+         * @param identifier_idx The constant index of the function identifier.
+         * @param target The resolved invocation target.
          */
-        template <typename T>
-        T get(size_t pool_index, size_t dynsym_index) const {
-            dynsym location = indexes.at(pool_index).at(dynsym_index);
-            if (std::holds_alternative<void *>(location)) {
-                return *((T *)std::get<void *>(location));
-            }
-            throw std::runtime_error("Cannot get function as variable");
-        }
+        void bind_call(size_t pool_index, constant_index identifier_idx, call_target target);
+
+        /**
+         * Gets the invocation targets table of the given pool.
+         *
+         * The returned table can be directly indexed by the constant index of a function identifier.
+         * The table stays valid as long as this pager exists.
+         *
+         * @param pool_index The index of the pool.
+         * @return The invocation targets of the pool.
+         */
+        call_target *get_call_targets(size_t pool_index);
 
         /**
-         * Sets the value of the given exported variable.
+         * Binds the given structure identifier constant to its definition.
          *
-         * @tparam T The type of the value to set.
-         * @param exported The exported variable to set.
-         * @param value The value to set.
+         * @param pool_index The index of the pool containing the structure identifier.
+         * @param identifier_idx The constant index of the structure identifier.
+         * @param definition The structure definition.
          */
-        template <typename T>
-        void set(size_t pool_index, size_t dynsym_index, T value) const {
-            dynsym location = indexes.at(pool_index).at(dynsym_index);
-            if (std::holds_alternative<void *>(location)) {
-                *((T *)std::get<void *>(location)) = value;
-                return;
-            }
-            throw std::runtime_error("Cannot get function as variable");
-        }
+        void bind_structure(size_t pool_index, constant_index identifier_idx, const struct_definition *definition);
+
+        /**
+         * Gets the structure definitions table of the given pool.
+         *
+         * The returned table can be directly indexed by the constant index of a structure identifier,
+         * where the structures that are not bound yet are null.
+         * The table stays valid as long as this pager exists.
+         *
+         * @param pool_index The index of the pool.
+         * @return The structure definitions of the pool.
+         */
+        const struct_definition **get_structure_targets(size_t pool_index);
+
+        /**
+         * Gets the dynamic symbols table of the given pool.
+         *
+         * The returned table can be directly indexed by a dynamic symbol index, where each symbol is
+         * the address of the bound variable. All the symbols are bound once the loader has resolved them.
+         * The table stays valid as long as this pager exists.
+         *
+         * @param pool_index The index of the pool.
+         * @return The dynamic symbols of the pool.
+         */
+        char *const *get_dynsym_slots(size_t pool_index) const;
+
+        /**
+         * Gets the number of dynamic symbols of the given pool.
+         *
+         * @param pool_index The index of the pool.
+         * @return The number of dynamic symbols.
+         */
+        size_t get_dynsym_count(size_t pool_index) const;
 
         /**
          * Gets the number of pages in this pager.
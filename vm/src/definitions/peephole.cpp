@@ -0,0 +1,120 @@
+#include "peephole.h"
+
+#include "conversions.h"
+#include "opcode.h"
+
+#include <algorithm>
+
+namespace msh {
+    static bool is_int_comparison(Opcode code) {
+        return code >= OP_INT_EQ && code <= OP_INT_GE;
+    }
+
+    /**
+     * Gets the superinstruction that performs the given sequence of two instructions.
+     *
+     * @return false if the sequence cannot be fused
+     */
+    static bool fuse(Opcode first, Opcode second, Opcode &fused) {
+        if (first == OP_PUSH_INT && second == OP_INT_ADD) {
+            fused = OP_INT_ADD_CONST;
+        } else if (first == OP_PUSH_LOCAL_REF && second == OP_REF_GET_Q_WORD) {
+            // reading a local through its reference is reading it
+            fused = OP_LOCAL_GET_Q_WORD;
+        } else if (first == OP_LOCAL_GET_Q_WORD && second == OP_REF_GET_Q_WORD) {
+            fused = OP_LOCAL_REF_GET_Q_WORD;
+        } else if (is_int_comparison(first) && second == OP_IF_JUMP) {
+            fused = OP_INT_COMPARE_IF_JUMP;
+        } else if (is_int_comparison(first) && second == OP_IF_NOT_JUMP) {
+            fused = OP_INT_COMPARE_IF_NOT_JUMP;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<std::byte> fuse_instructions(const std::byte *instructions, size_t instruction_count, std::vector<uint32_t> &relocations) {
+        relocations.clear();
+
+        // find the instructions boundaries, then the jump targets
+        std::vector<bool> boundaries(instruction_count + 1);
+        // the frame of a function that references its own locals must outlive its invocations
+        bool references_locals = false;
+        size_t ip = 0;
+        while (ip < instruction_count) {
+            boundaries[ip] = true;
+            references_locals |= static_cast<Opcode>(instructions[ip]) == OP_PUSH_LOCAL_REF;
+            ip += 1 + opcode_operands_size(static_cast<Opcode>(instructions[ip]));
+        }
+        if (ip != instruction_count) {
+            return {};
+        }
+        boundaries[instruction_count] = true;
+
+        std::vector<bool> targets(instruction_count + 1);
+        for (ip = 0; ip < instruction_count; ip += 1 + opcode_operands_size(static_cast<Opcode>(instructions[ip]))) {
+            size_t operand = opcode_jump_operand(static_cast<Opcode>(instructions[ip]));
+            if (operand != 0) {
+                uint32_t target = read_native_endian<uint32_t>(instructions + ip + operand);
+                if (target > instruction_count || !boundaries[target]) {
+                    // the jumps could not be relocated
+                    return {};
+                }
+                targets[target] = true;
+            }
+        }
+
+        std::vector<std::byte> fused;
+        fused.reserve(instruction_count);
+        relocations.resize(instruction_count + 1);
+        bool any_fused = false;
+        ip = 0;
+        while (ip < instruction_count) {
+            Opcode first = static_cast<Opcode>(instructions[ip]);
+            size_t next = ip + 1 + opcode_operands_size(first);
+            size_t end = next;
+            Opcode fused_opcode;
+            if (next < instruction_count && !targets[next] && fuse(first, static_cast<Opcode>(instructions[next]), fused_opcode)) {
+                Opcode second = static_cast<Opcode>(instructions[next]);
+                end = next + 1 + opcode_operands_size(second);
+                std::fill(relocations.begin() + ip, relocations.begin() + end, fused.size());
+                fused.push_back(static_cast<std::byte>(fused_opcode));
+                if (fused_opcode == OP_INT_COMPARE_IF_JUMP || fused_opcode == OP_INT_COMPARE_IF_NOT_JUMP) {
+                    // the comparison, then the jump address
+                    fused.push_back(static_cast<std::byte>(first));
+                    fused.insert(fused.end(), instructions + next + 1, instructions + end);
+                } else {
+                    // the operands of the first instruction
+                    fused.insert(fused.end(), instructions + ip + 1, instructions + next);
+                }
+                any_fused = true;
+            } else if (first == OP_INVOKE && !references_locals && (next == instruction_count || static_cast<Opcode>(instructions[next]) == OP_RETURN)) {
+                // the return is kept, for the invocations that cannot replace the current frame
+                // (the loader appends a return to the functions that do not end with one)
+                std::fill(relocations.begin() + ip, relocations.begin() + end, fused.size());
+                fused.push_back(static_cast<std::byte>(OP_TAIL_INVOKE));
+                fused.insert(fused.end(), instructions + ip + 1, instructions + end);
+                any_fused = true;
+            } else {
+                std::fill(relocations.begin() + ip, relocations.begin() + end, fused.size());
+                fused.insert(fused.end(), instructions + ip, instructions + end);
+            }
+            ip = end;
+        }
+        relocations[instruction_count] = fused.size();
+
+        if (!any_fused) {
+            relocations.clear();
+            return {};
+        }
+
+        for (ip = 0; ip < fused.size(); ip += 1 + opcode_operands_size(static_cast<Opcode>(fused[ip]))) {
+            size_t operand = opcode_jump_operand(static_cast<Opcode>(fused[ip]));
+            if (operand != 0) {
+                uint32_t target = read_native_endian<uint32_t>(fused.data() + ip + operand);
+                write_native_endian<uint32_t>(fused.data() + ip + operand, relocations[target]);
+            }
+        }
+        return fused;
+    }
+}
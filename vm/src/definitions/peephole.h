@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace msh {
+    /**
+     * Rewrites the common sequences of instructions of a function into superinstructions,
+     * so that the pages compiled without them also benefit from them.
+     *
+     * A sequence is only fused if none of its inner instructions is the target of a jump.
+     * The jump addresses of the fused instructions are relocated.
+     * The invocations in tail position, that are followed by a return, become tail invocations.
+     *
+     * @param instructions The instructions of the function, whose operands are in host byte order.
+     * @param instruction_count The number of instructions in bytes.
+     * @param relocations Filled with the new position of each instruction byte, and of the end of the instructions.
+     * @return The fused instructions, or an empty vector if no sequence could be fused.
+     */
+    std::vector<std::byte> fuse_instructions(const std::byte *instructions, size_t instruction_count, std::vector<uint32_t> &relocations);
+}
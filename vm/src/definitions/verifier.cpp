@@ -0,0 +1,308 @@
+#include "verifier.h"
+
+#include "conversions.h"
+#include "memory/constant_pool.h"
+#include "opcode.h"
+#include "pager.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace msh {
+    /**
+     * The number of bytes popped then pushed by an instruction.
+     */
+    struct stack_effect {
+        size_t pops;
+        size_t pushes;
+    };
+
+    /**
+     * The operand stack size of an instruction that has not been reached yet.
+     */
+    constexpr size_t UNREACHED = SIZE_MAX;
+
+    bool verify_function(function_definition &def, const ConstantPool &pool, size_t dynsym_count, const call_target *call_targets) {
+        def.verified = false;
+        def.max_stack_size = 0;
+
+        const std::byte *instructions = def.instructions;
+        size_t instruction_count = def.instruction_count;
+
+        // find the instructions boundaries
+        std::vector<bool> boundaries(instruction_count + 1);
+        Opcode last_opcode = OP_RETURN;
+        size_t ip = 0;
+        while (ip < instruction_count) {
+            boundaries[ip] = true;
+            last_opcode = static_cast<Opcode>(instructions[ip]);
+            ip += 1 + opcode_operands_size(last_opcode);
+        }
+        if (ip != instruction_count) {
+            // the last instruction is truncated
+            return false;
+        }
+        size_t end = instruction_count;
+        if (instruction_count == 0 || last_opcode != OP_RETURN) {
+            // the loader has appended a return instruction
+            boundaries[instruction_count] = true;
+            end++;
+        }
+
+        std::vector<size_t> sizes(end, UNREACHED);
+        std::vector<size_t> pending;
+        size_t max_size = 0;
+
+        // binds a reached instruction to the operand stack size it is reached with
+        auto reach = [&](size_t target, size_t size) {
+            if (target >= end || !boundaries[target]) {
+                return false;
+            }
+            max_size = std::max(max_size, size);
+            if (sizes[target] == UNREACHED) {
+                sizes[target] = size;
+                pending.push_back(target);
+                return true;
+            }
+            return sizes[target] == size;
+        };
+
+        reach(0, 0);
+        while (!pending.empty()) {
+            ip = pending.back();
+            pending.pop_back();
+            size_t size = sizes[ip];
+
+            Opcode opcode = static_cast<Opcode>(instructions[ip]);
+            const std::byte *operand = instructions + ip + 1;
+            size_t next = ip + 1 + opcode_operands_size(opcode);
+            uint32_t immediate = 0;
+            if (opcode_operands_size(opcode) == sizeof(uint32_t)) {
+                immediate = read_native_endian<uint32_t>(operand);
+            } else if (opcode_jump_operand(opcode) != 0) {
+                immediate = read_native_endian<uint32_t>(instructions + ip + opcode_jump_operand(opcode));
+            }
+
+            stack_effect effect;
+            switch (opcode) {
+            case OP_PUSH_INT:
+            case OP_PUSH_FLOAT:
+                effect = {0, sizeof(int64_t)};
+                break;
+            case OP_PIPE:
+                effect = {0, 2 * sizeof(int64_t)};
+                break;
+            case OP_PUSH_BYTE:
+                effect = {0, 1};
+                break;
+            case OP_PUSH_STRING_REF:
+                if (immediate >= pool.get_size()) {
+                    return false;
+                }
+                effect = {0, sizeof(msh::obj *)};
+                break;
+            case OP_PUSH_LOCAL_REF:
+                // the reference ops may read or write a quad-word through the reference
+                if (static_cast<size_t>(immediate) + sizeof(int64_t) > def.locals_size) {
+                    return false;
+                }
+                effect = {0, sizeof(msh::obj *)};
+                break;
+            case OP_LOCAL_GET_BYTE:
+            case OP_LOCAL_SET_BYTE:
+            case OP_LOCAL_GET_Q_WORD:
+            case OP_LOCAL_SET_Q_WORD:
+            case OP_LOCAL_REF_GET_Q_WORD: {
+                size_t value_size = opcode == OP_LOCAL_GET_BYTE || opcode == OP_LOCAL_SET_BYTE ? 1 : sizeof(int64_t);
+                if (static_cast<size_t>(immediate) + value_size > def.locals_size) {
+                    return false;
+                }
+                if (opcode == OP_LOCAL_GET_BYTE || opcode == OP_LOCAL_GET_Q_WORD || opcode == OP_LOCAL_REF_GET_Q_WORD) {
+                    effect = {0, value_size};
+                } else {
+                    effect = {value_size, 0};
+                }
+                break;
+            }
+            case OP_FETCH_BYTE:
+            case OP_FETCH_Q_WORD:
+            case OP_STORE_BYTE:
+            case OP_STORE_Q_WORD:
+                if (immediate >= dynsym_count) {
+                    return false;
+                }
+                if (opcode == OP_FETCH_BYTE) {
+                    effect = {0, 1};
+                } else if (opcode == OP_FETCH_Q_WORD) {
+                    effect = {0, sizeof(int64_t)};
+                } else {
+                    effect = {opcode == OP_STORE_BYTE ? 1 : sizeof(int64_t), 0};
+                }
+                break;
+            case OP_STRUCT_NEW:
+                if (immediate >= pool.get_size()) {
+                    return false;
+                }
+                effect = {0, sizeof(msh::obj *)};
+                break;
+            case OP_STRUCT_COPY_N:
+                // the structure reference is pushed back once the bytes are copied
+                effect = {sizeof(msh::obj *) + immediate, sizeof(msh::obj *)};
+                break;
+            case OP_INVOKE:
+            case OP_TAIL_INVOKE: {
+                if (immediate >= pool.get_size()) {
+                    return false;
+                }
+                const call_target &target = call_targets[immediate];
+                if (target.function != nullptr) {
+                    effect = {target.function->parameters_byte_count, target.function->return_byte_count};
+                } else if (target.native != nullptr) {
+                    effect = {target.native->parameters_byte_count, target.native->return_byte_count};
+                } else {
+                    // the function may only be resolved when it is reached
+                    return false;
+                }
+                break;
+            }
+            case OP_BOX_Q_WORD:
+            case OP_REF_GET_Q_WORD:
+            case OP_STRUCT_GET_Q_WORD:
+            case OP_OPEN:
+            case OP_READ:
+            case OP_INT_NEG:
+            case OP_FLOAT_NEG:
+            case OP_INT_ADD_CONST:
+                effect = {sizeof(int64_t), sizeof(int64_t)};
+                break;
+            case OP_BOX_BYTE:
+            case OP_BYTE_TO_INT:
+                effect = {1, sizeof(int64_t)};
+                break;
+            case OP_REF_GET_BYTE:
+            case OP_STRUCT_GET_BYTE:
+            case OP_WAIT:
+            case OP_INT_TO_BYTE:
+                effect = {sizeof(int64_t), 1};
+                break;
+            case OP_REF_SET_BYTE:
+            case OP_STRUCT_SET_BYTE:
+                effect = {sizeof(msh::obj *) + 1, 0};
+                break;
+            case OP_REF_SET_Q_WORD:
+            case OP_STRUCT_SET_Q_WORD:
+            case OP_WRITE:
+                effect = {sizeof(msh::obj *) + sizeof(int64_t), 0};
+                break;
+            case OP_EXEC:
+            case OP_CLOSE:
+            case OP_POP_Q_WORD:
+                effect = {sizeof(int64_t), 0};
+                break;
+            case OP_SETUP_REDIRECT:
+            case OP_REDIRECT:
+            case OP_INT_ADD:
+            case OP_INT_SUB:
+            case OP_INT_MUL:
+            case OP_INT_DIV:
+            case OP_INT_MOD:
+            case OP_FLOAT_ADD:
+            case OP_FLOAT_SUB:
+            case OP_FLOAT_MUL:
+            case OP_FLOAT_DIV:
+                effect = {2 * sizeof(int64_t), sizeof(int64_t)};
+                break;
+            case OP_INT_EQ:
+            case OP_INT_LT:
+            case OP_INT_LE:
+            case OP_INT_GT:
+            case OP_INT_GE:
+            case OP_FLOAT_EQ:
+            case OP_FLOAT_LT:
+            case OP_FLOAT_LE:
+            case OP_FLOAT_GT:
+            case OP_FLOAT_GE:
+                effect = {2 * sizeof(int64_t), 1};
+                break;
+            case OP_DUP:
+                effect = {sizeof(int64_t), 2 * sizeof(int64_t)};
+                break;
+            case OP_DUP_BYTE:
+                effect = {1, 2};
+                break;
+            case OP_SWAP:
+                effect = {2 * sizeof(int64_t), 2 * sizeof(int64_t)};
+                break;
+            case OP_SWAP_2:
+                effect = {3 * sizeof(int64_t), 3 * sizeof(int64_t)};
+                break;
+            case OP_BYTE_XOR:
+                effect = {2, 1};
+                break;
+            case OP_POP_BYTE:
+            case OP_IF_JUMP:
+            case OP_IF_NOT_JUMP:
+            case OP_EXIT:
+                effect = {1, 0};
+                break;
+            case OP_FORK:
+            case OP_POP_REDIRECT:
+            case OP_JUMP:
+                effect = {0, 0};
+                break;
+            case OP_RETURN:
+                effect = {def.return_byte_count, 0};
+                break;
+            case OP_INT_COMPARE_IF_JUMP:
+            case OP_INT_COMPARE_IF_NOT_JUMP: {
+                Opcode comparison = static_cast<Opcode>(*operand);
+                if (comparison < OP_INT_EQ || comparison > OP_INT_GE) {
+                    return false;
+                }
+                effect = {2 * sizeof(int64_t), 0};
+                break;
+            }
+            default:
+                // unknown opcodes and unboxing
+                return false;
+            }
+
+            if (size < effect.pops) {
+                return false;
+            }
+            size = size - effect.pops + effect.pushes;
+
+            bool reached;
+            switch (opcode) {
+            case OP_RETURN:
+            case OP_EXIT:
+                reached = true;
+                break;
+            case OP_JUMP:
+                reached = reach(immediate, size);
+                break;
+            case OP_IF_JUMP:
+            case OP_IF_NOT_JUMP:
+            case OP_INT_COMPARE_IF_JUMP:
+            case OP_INT_COMPARE_IF_NOT_JUMP:
+                reached = reach(immediate, size) && reach(next, size);
+                break;
+            case OP_FORK:
+                // the child continues with the next instruction, and the parent jumps with the child's pid
+                reached = reach(next, size) && reach(immediate, size + sizeof(int64_t));
+                break;
+            default:
+                reached = reach(next, size);
+                break;
+            }
+            if (!reached) {
+                return false;
+            }
+        }
+
+        def.verified = true;
+        def.max_stack_size = max_size;
+        return true;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+#include "definitions/function_definition.h"
+
+class ConstantPool;
+
+namespace msh {
+    struct call_target;
+
+    /**
+     * Verifies the instructions of a function, so that they can be run without any runtime check.
+     *
+     * The verification proves that each instruction is known and complete, that the jumps land on an instruction,
+     * that the constants, dynamic symbols and locals accessed are in range, and that the operand stack never underflows,
+     * with the same size at each instruction whatever the path that reaches it.
+     * The invoked functions must be bound, as their effect on the operand stack is known from their definition.
+     *
+     * Unboxing a value is not verified, as the size of the unboxed value is only known at runtime.
+     *
+     * @param def The function to verify, whose `verified` and `max_stack_size` fields are updated.
+     * @param pool The constant pool of the function.
+     * @param dynsym_count The number of dynamic symbols of the function's pool.
+     * @param call_targets The invocation targets of the function's pool.
+     * @return true if the function is verified.
+     */
+    bool verify_function(function_definition &def, const ConstantPool &pool, size_t dynsym_count, const call_target *call_targets);
+}
@@ -0,0 +1,284 @@
+#include "glob_walker.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <iterator>
+#include <mutex>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+namespace msh {
+    namespace {
+        /**
+         * A component of a glob pattern, between two slashes.
+         */
+        struct glob_component {
+            enum kind_t {
+                LITERAL,
+                WILDCARD,
+                RECURSIVE,
+            };
+
+            kind_t kind;
+
+            /**
+             * the name of a literal component without its escapes, or the pattern of a wildcard component
+             */
+            std::string text;
+        };
+
+        /**
+         * A directory to walk, matching the pattern from a given component.
+         */
+        struct glob_task {
+            std::string path;
+            size_t component;
+        };
+
+        /**
+         * Replaces a leading `~` or `~user` by the home directory, keeping the pattern if it is unknown.
+         */
+        std::string expand_tilde(const std::string &pattern) {
+            if (pattern.empty() || pattern[0] != '~') {
+                return pattern;
+            }
+            size_t end = std::min(pattern.find('/'), pattern.size());
+            std::string user = pattern.substr(1, end - 1);
+            const char *home = nullptr;
+            if (user.empty()) {
+                home = getenv("HOME");
+                if (home == nullptr) {
+                    const passwd *pw = getpwuid(getuid());
+                    home = pw == nullptr ? nullptr : pw->pw_dir;
+                }
+            } else {
+                const passwd *pw = getpwnam(user.c_str());
+                home = pw == nullptr ? nullptr : pw->pw_dir;
+            }
+            return home == nullptr ? pattern : home + pattern.substr(end);
+        }
+
+        glob_component parse_component(const std::string &text) {
+            if (text == "**") {
+                return {glob_component::RECURSIVE, text};
+            }
+            std::string literal;
+            for (size_t i = 0; i < text.size(); i++) {
+                char c = text[i];
+                if (c == '*' || c == '?' || c == '[') {
+                    return {glob_component::WILDCARD, text};
+                }
+                if (c == '\\' && i + 1 < text.size()) {
+                    c = text[++i];
+                }
+                literal.push_back(c);
+            }
+            return {glob_component::LITERAL, std::move(literal)};
+        }
+
+        std::string join(const std::string &directory, const char *name) {
+            if (directory.empty()) {
+                return name;
+            }
+            if (directory.back() == '/') {
+                return directory + name;
+            }
+            return directory + '/' + name;
+        }
+
+        /**
+         * Walks the directories of a pattern, with a shared queue of directories to read.
+         */
+        class glob_walker {
+            std::vector<glob_component> components;
+
+            /**
+             * whether the pattern ends with a slash, that only matches the directories
+             */
+            bool only_directories = false;
+
+            size_t max_threads;
+
+            std::mutex lock;
+            std::condition_variable work_available;
+            std::vector<glob_task> tasks;
+
+            /**
+             * the number of threads that are walking a directory, and may queue new ones
+             */
+            size_t busy = 0;
+
+            std::vector<std::thread> helpers;
+            std::vector<std::string> matches;
+
+        public:
+            glob_walker(const std::string &pattern, size_t max_threads) : max_threads{std::max<size_t>(max_threads, 1)} {
+                std::string root;
+                size_t start = 0;
+                if (!pattern.empty() && pattern[0] == '/') {
+                    root = "/";
+                    start = 1;
+                }
+                while (start < pattern.size()) {
+                    size_t end = std::min(pattern.find('/', start), pattern.size());
+                    if (end > start) {
+                        components.push_back(parse_component(pattern.substr(start, end - start)));
+                    }
+                    start = end + 1;
+                }
+                only_directories = !components.empty() && pattern.back() == '/';
+                if (!components.empty() && components.back().kind == glob_component::RECURSIVE && !only_directories) {
+                    // a trailing `**` matches everything below, as would `**/*`
+                    components.push_back({glob_component::WILDCARD, "*"});
+                }
+                if (!components.empty() || !root.empty()) {
+                    tasks.push_back({std::move(root), 0});
+                }
+            }
+
+            std::vector<std::string> run() {
+                work();
+                for (std::thread &helper : helpers) {
+                    helper.join();
+                }
+                std::sort(matches.begin(), matches.end());
+                // the nested `**` can reach the same paths several times
+                matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+                return std::move(matches);
+            }
+
+        private:
+            /**
+             * Takes the directories of the queue until all the threads are idle and the queue is empty.
+             */
+            void work() {
+                std::vector<std::string> found;
+                std::vector<glob_task> queued;
+                std::unique_lock<std::mutex> guard(lock);
+                while (true) {
+                    work_available.wait(guard, [this] { return !tasks.empty() || busy == 0; });
+                    if (tasks.empty()) {
+                        break;
+                    }
+                    glob_task task = std::move(tasks.back());
+                    tasks.pop_back();
+                    busy++;
+                    guard.unlock();
+
+                    walk(std::move(task), queued, found);
+
+                    guard.lock();
+                    busy--;
+                    std::move(queued.begin(), queued.end(), std::back_inserter(tasks));
+                    queued.clear();
+                    if (tasks.size() > 1 && helpers.size() + 1 < max_threads) {
+                        spawn_helper();
+                    }
+                    if (!tasks.empty() || busy == 0) {
+                        work_available.notify_all();
+                    }
+                }
+                std::move(found.begin(), found.end(), std::back_inserter(matches));
+            }
+
+            void spawn_helper() {
+                try {
+                    helpers.emplace_back([this] { work(); });
+                } catch (const std::system_error &) {
+                    // the current threads walk the remaining directories
+                }
+            }
+
+            /**
+             * Matches the components of the pattern from the task's component, in the task's directory.
+             *
+             * The literal components are appended without reading any directory,
+             * the wildcards read the directory once, and queue the matching subdirectories.
+             */
+            void walk(glob_task task, std::vector<glob_task> &queued, std::vector<std::string> &found) {
+                std::string &path = task.path;
+                size_t index = task.component;
+                while (index < components.size() && components[index].kind == glob_component::LITERAL) {
+                    path = join(path, components[index].text.c_str());
+                    index++;
+                }
+                if (index == components.size()) {
+                    struct stat st;
+                    if (lstat(path.c_str(), &st) == 0) {
+                        record(std::move(path), found);
+                    }
+                    return;
+                }
+
+                const glob_component &component = components[index];
+                bool recursive = component.kind == glob_component::RECURSIVE;
+                if (recursive) {
+                    // no directory at all
+                    queued.push_back({path, index + 1});
+                }
+                DIR *dir = opendir(path.empty() ? "." : path.c_str());
+                if (dir == nullptr) {
+                    return;
+                }
+                bool last = index + 1 == components.size();
+                while (const dirent *entry = readdir(dir)) {
+                    const char *name = entry->d_name;
+                    if (recursive) {
+                        if (name[0] != '.' && is_directory(dir, entry, false)) {
+                            queued.push_back({join(path, name), index});
+                        }
+                        continue;
+                    }
+                    if (fnmatch(component.text.c_str(), name, FNM_PERIOD) != 0) {
+                        continue;
+                    }
+                    if (last) {
+                        record(join(path, name), found);
+                    } else if (is_directory(dir, entry, true)) {
+                        queued.push_back({join(path, name), index + 1});
+                    }
+                }
+                closedir(dir);
+            }
+
+            /**
+             * Tests whether an entry is a directory, from its type if the file system gives it.
+             */
+            static bool is_directory(DIR *dir, const dirent *entry, bool follow_links) {
+                if (entry->d_type == DT_DIR) {
+                    return true;
+                }
+                if (entry->d_type != DT_UNKNOWN && (entry->d_type != DT_LNK || !follow_links)) {
+                    return false;
+                }
+                struct stat st;
+                int flags = follow_links ? 0 : AT_SYMLINK_NOFOLLOW;
+                return fstatat(dirfd(dir), entry->d_name, &st, flags) == 0 && S_ISDIR(st.st_mode);
+            }
+
+            void record(std::string path, std::vector<std::string> &found) const {
+                if (only_directories) {
+                    struct stat st;
+                    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                        return;
+                    }
+                    if (path.back() != '/') {
+                        path.push_back('/');
+                    }
+                }
+                found.push_back(std::move(path));
+            }
+        };
+    }
+
+    std::vector<std::string> expand_glob(const std::string &pattern, size_t threads) {
+        return glob_walker(expand_tilde(pattern), threads).run();
+    }
+}
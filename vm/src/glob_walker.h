@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace msh {
+    /**
+     * The number of threads that walk the directories of a glob, up to the number of hardware threads.
+     */
+    constexpr size_t MAX_GLOB_THREADS = 8;
+
+    /**
+     * Expands a glob pattern into the paths that it matches, sorted by byte order.
+     *
+     * A pattern component can contain the `*`, `?` and `[...]` wildcards, that do not match a leading dot.
+     * A `**` component matches any number of nested directories, without following the symbolic links;
+     * as the last component, it matches all the files and directories below.
+     * A leading `~` or `~user` is replaced by the home directory.
+     *
+     * The directories are walked by several threads once more than one is yet to be read.
+     * The directories that cannot be read are ignored.
+     *
+     * @param pattern The glob pattern.
+     * @param threads The maximum number of threads that walk the directories.
+     * @return The matching paths, empty if there is no match.
+     */
+    std::vector<std::string> expand_glob(const std::string &pattern, size_t threads);
+}
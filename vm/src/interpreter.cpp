@@ -7,8 +7,14 @@
 #include "memory/constant_pool.h"
 #include "memory/gc.h"
 #include "memory/nix.h"
+#include "opcode.h"
+#include "profiler.h"
 #include "vm.h"
 
+#ifdef MOSHELL_JIT
+#include "jit.h"
+#endif
+
 #include <array>
 #include <cerrno>
 #include <cstdlib>
@@ -16,105 +22,31 @@
 #include <fcntl.h>
 #include <iostream>
 #include <memory>
+#include <signal.h>
+#include <spawn.h>
+#include <stdexcept>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
 
-enum Opcode {
-    OP_PUSH_INT,        // with 8 byte int value, pushes an int onto the operand stack
-    OP_PUSH_BYTE,       // with 1 byte value, pushes a byte onto the operand stack
-    OP_PUSH_FLOAT,      // with 8 byte float value, pushes a float onto the operand stack
-    OP_PUSH_STRING_REF, // with 8 byte string index in constant pool, pushes a reference to the string constant onto the operand stack
-    OP_PUSH_LOCAL_REF,  // with 4 bytes locals index, pushes a reference to the locals address onto the stack
-
-    OP_BOX_Q_WORD, // pops an int, and push it as a new reference
-    OP_BOX_BYTE,   // pops an int, and push it as a new reference
-    OP_UNBOX,      // pops a reference, and convert it to a value
-
-    OP_LOCAL_GET_BYTE,   // pops last reference and pushes its byte value onto the operands
-    OP_LOCAL_SET_BYTE,   // pops last reference, pops a byte value then sets the reference's value with byte value
-    OP_LOCAL_GET_Q_WORD, // pops last reference and pushes its qword value onto the operands
-    OP_LOCAL_SET_Q_WORD, // pops last reference, pops a qword value then sets the reference's value with qword value
-
-    OP_REF_GET_BYTE,   // pops last reference and pushes its byte value onto the operands
-    OP_REF_SET_BYTE,   // pops last reference, pops a byte value then sets the reference's value with byte value
-    OP_REF_GET_Q_WORD, // pops last reference and pushes its qword value onto the operands
-    OP_REF_SET_Q_WORD, // pops last reference, pops a qword value then sets the reference's value with qword value
-
-    OP_STRUCT_GET_BYTE,   // pops last reference and pushes byte value at given index onto the operands
-    OP_STRUCT_SET_BYTE,   // pops last reference, pops new byte value and set byte value at given index in the struct
-    OP_STRUCT_GET_Q_WORD, // pops last reference and pushes qword value at given index onto the operands
-    OP_STRUCT_SET_Q_WORD, // pops last reference, pops new qword value and set sword value at given index in the struct
-
-    OP_FETCH_BYTE,   // with 4 byte external index in constant pool, pushes given external value onto the operand stack
-    OP_FETCH_Q_WORD, // with 4 byte external index in constant pool, pushes given external value onto the operand stack
-    OP_STORE_BYTE,   // with 4 byte external index in constant pool, set given external value from value popped from the operand stack
-    OP_STORE_Q_WORD, // with 4 byte external index in constant pool, set given external value from value popped from the operand stack
-
-    OP_STRUCT_NEW,    // with 4 byte external index in constant pool, instantiates on the heap the given structure
-    OP_STRUCT_COPY_N, // with 4 byte uint32 pops structure ref, and pop given amount of bytes from the operands to copy them on the given structure, starting at index 0
-
-    OP_INVOKE,         // with 4 byte function ref string in constant pool, pops parameters from operands then pushes invoked function return in operand stack (if non-void)
-    OP_FORK,           // forks a new process, pushes the pid onto the operand stack of the parent and jumps to the given address in the parent
-    OP_EXEC,           // pops the arguments array and replaces the current program
-    OP_WAIT,           // pops a pid from the operand stack and waits for it to finish
-    OP_OPEN,           // opens a file with the name popped from the stack, pushes the file descriptor onto the operand stack
-    OP_CLOSE,          // pops a file descriptor from the operand stack and closes the file
-    OP_SETUP_REDIRECT, // peek the fd from the operand stack, pop the source fd from the operand stack, and performs a cancelable redirection
-    OP_REDIRECT,       // duplicates the file descriptor popped from the operand stack and leave the source fd on the stack
-    OP_POP_REDIRECT,   // pops a file descriptor from the operand stack and closes it
-    OP_PIPE,           // creates a pipe, pushes the read and write file descriptors onto the operand stack
-    OP_READ,           // pops a file descriptor to read all the data from, pushes the data onto the stack
-    OP_WRITE,          // pops a file descriptor to write the data to, pops the data to write from the stack
-    OP_EXIT,           // exits the current process with the popped exit code
-
-    OP_DUP,        // duplicates the last value on the operand stack
-    OP_DUP_BYTE,   // duplicates the last byte on the operand stack
-    OP_SWAP,       // swaps the last two values on the operand stack
-    OP_SWAP_2,     // swaps the last two values on the operand stack with the one before that
-    OP_POP_BYTE,   // pops one byte from operand stack
-    OP_POP_Q_WORD, // pops 8 bytes from operand stack
-
-    OP_IF_JUMP,     // with 1 byte opcode for 'then' branch, jumps only if value popped from operand stack is 0
-    OP_IF_NOT_JUMP, // with 1 byte opcode for where to jump, jumps only if value popped from operand stack is not 0
-    OP_JUMP,        // with 1 byte opcode for where to jump
-
-    OP_RETURN, // stops frame interpretation
-
-    OP_BYTE_TO_INT, // replaces last value of operand stack from byte to int
-    OP_INT_TO_BYTE, // replaces last value of operand stack from int to byte
-
-    OP_BYTE_XOR,  // pops last two bytes, apply xor operation then push the resulting byte
-    OP_INT_ADD,   // pops two ints, adds them, and pushes the resulting integer
-    OP_INT_SUB,   // pops two ints, subtracts them, and pushes the resulting integer
-    OP_INT_MUL,   // pops two ints, multiplies them, and pushes the resulting integer
-    OP_INT_DIV,   // pops two ints, divides them, and pushes the resulting integer
-    OP_INT_MOD,   // pops two ints, mods them, and pushes the resulting integer
-    OP_INT_NEG,   // pops an int, negates it, and pushes the resulting integer
-    OP_FLOAT_ADD, // pops two floats, adds them, and pushes the resulting float
-    OP_FLOAT_SUB, // pops two floats, subtracts them, and pushes the resulting float
-    OP_FLOAT_MUL, // pops two floats, multiplies them, and pushes the resulting float
-    OP_FLOAT_DIV, // pops two floats, divides them, and pushes the resulting float
-    OP_FLOAT_NEG, // pops a float, negates it, and pushes the resulting float
-
-    OP_INT_EQ, // pops two ints, checks if they are equal, and pushes the resulting byte
-    OP_INT_LT, // pops two ints, checks if the first is less than the second, and pushes the resulting byte
-    OP_INT_LE, // pops two ints, checks if the first is less than or equal to the second, and pushes the resulting byte
-    OP_INT_GT, // pops two ints, checks if the first is greater than the second, and pushes the resulting byte
-    OP_INT_GE, // pops two ints, checks if the first is greater than or equal to the second, and pushes the resulting byte
-
-    OP_FLOAT_EQ, // pops two floats, checks if they are equal, and pushes the resulting byte
-    OP_FLOAT_LT, // pops two floats, checks if the first is less than the second, and pushes the resulting byte
-    OP_FLOAT_LE, // pops two floats, checks if the first is less than or equal to the second, and pushes the resulting byte
-    OP_FLOAT_GT, // pops two floats, checks if the first is greater than the second, and pushes the resulting byte
-    OP_FLOAT_GE, // pops two floats, checks if the first is greater than or equal to the second, and pushes the resulting byte
-};
+#if defined(MOSHELL_THREADED_DISPATCH) && defined(__GNUC__)
+// Labels as values are a GNU extension, supported by GCC and Clang.
+// Other compilers fall back to the switch based dispatch.
+#define MOSHELL_COMPUTED_GOTO
+#endif
 
 /**
  * set to true if this process is the main vm's process
  */
 bool is_master = true;
 
+extern char **environ;
+
+/**
+ * The permissions of the files created by a redirection
+ */
+constexpr mode_t OPEN_MODE = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+
 /**
  * contains values needed during runtime interpretation
  */
@@ -142,31 +74,32 @@ struct runtime_state {
      * If zero, the process shouldn't be put in a process group.
      */
     pid_t pgid;
+
+    /**
+     * The profiler of the execution, or null if it is not profiled.
+     */
+    msh::profiler *profiler;
+
+    /**
+     * The compiler of the hot verified functions, or null if they are only interpreted.
+     */
+    msh::jit *jit;
 };
 
 RuntimeException::RuntimeException(std::string msg)
     : std::runtime_error(msg) {}
 
-// run GC every n objects allocated
-#define GC_HEAP_CYCLE 5
-
 runtime_memory::runtime_memory(msh::heap &heap, std::vector<std::string> &program_arguments, msh::gc &gc)
-    : heap{heap}, gc{gc}, pargs{program_arguments}, last_gc_heap_size{heap.size()} {}
+    : heap{heap}, gc{gc}, pargs{program_arguments} {}
 
 void runtime_memory::run_gc() {
     gc.run();
-    last_gc_heap_size = heap.size();
 }
 
 std::vector<std::string> &runtime_memory::program_arguments() {
     return pargs;
 }
 
-msh::obj &runtime_memory::emplace(msh::obj_data &&data) {
-    if (heap.size() >= last_gc_heap_size + GC_HEAP_CYCLE)
-        run_gc();
-    return this->heap.insert(data);
-}
 
 /**
  * Apply an arithmetic operation to two integers
@@ -187,8 +120,18 @@ inline int64_t apply_arithmetic(Opcode code, int64_t a, int64_t b) {
         if (b == 0) {
             throw RuntimeException("Attempted to divide " + std::to_string(a) + " by zero.");
         }
+        if (b == -1) {
+            // the hardware division traps on the overflow of the minimum integer, that wraps to itself
+            return static_cast<int64_t>(0 - static_cast<uint64_t>(a));
+        }
         return a / b;
     case OP_INT_MOD:
+        if (b == 0) {
+            throw RuntimeException("Attempted to divide " + std::to_string(a) + " by zero.");
+        }
+        if (b == -1) {
+            return 0;
+        }
         return a % b;
     default:
         throw InvalidBytecodeError("Unknown opcode");
@@ -304,14 +247,15 @@ enum class frame_status {
     RETURNED,
 
     /**
-     * The frame has been interrupted by a new frame.
+     * The frame has been interrupted by a panic.
      */
-    NEW_FRAME,
+    ABORT,
 
     /**
-     * The frame has been interrupted by a panic.
+     * The frame on top of the call stack is not run by the same interpreter,
+     * as it changes whether its function is verified or not.
      */
-    ABORT
+    SWITCHED
 };
 
 /**
@@ -320,667 +264,1159 @@ enum class frame_status {
  * and native functions.
  * Moshell functions have priority against native functions.
  *
- * if given function identifier refers to a moshell function, the called function's frame will
+ * if given target refers to a moshell function, the called function's frame will
  * be pushed in the call stack, which will cause the current frame to interrupt.
  * if a native function is referenced, then the function is directly run by this
  * function and then the frame can simply continue without interruption.
+ * If the target has not been bound at link time, it is resolved by its identifier and bound for the next invocations.
+ * A tail invocation of a moshell function that returns as many bytes as the caller replaces the caller's frame,
+ * so that the recursions in tail position run in constant stack space.
+ * @param target the pre-resolved invocation target
  * @param callee_identifier_idx constant index to the function identifier to invoke
+ * @param pool the constant pool of the caller
  * @param state the runtime state, passed to native function invocation
  * @param caller_operands caller's operands
  * @param call_stack the call stack
+ * @param tail true if the invocation is directly followed by a return of the caller
  * @throws FunctionNotFoundError if given callee identifier does not points to a moshell or native function.
- * @return true if a new moshell function has been pushed onto the stack.
+ * @return true if a new moshell function has been pushed onto the stack, or has replaced the caller's frame.
  */
-inline bool handle_function_invocation(const std::string &callee_identifier,
+template <bool profiled>
+inline bool handle_function_invocation(msh::call_target &target,
+                                       constant_index callee_identifier_idx,
+                                       const ConstantPool &pool,
                                        runtime_state &state,
                                        runtime_memory &mem,
                                        OperandStack &caller_operands,
-                                       CallStack &call_stack) {
+                                       CallStack &call_stack,
+                                       bool tail) {
 
-    auto callee_def_it = state.loader.find_function(callee_identifier);
-
-    if (callee_def_it == state.loader.functions_cend()) {
-        auto native_function_it = state.native_functions.find(callee_identifier);
-        if (native_function_it == state.native_functions.end()) {
+    if (target.function == nullptr && target.native == nullptr) {
+        const std::string &callee_identifier = pool.get_string(callee_identifier_idx);
+        target = state.loader.resolve_call(callee_identifier, state.native_functions);
+        if (target.function == nullptr && target.native == nullptr) {
             throw FunctionNotFoundError("Could not find function " + callee_identifier);
         }
+    }
 
-        auto native_function = native_function_it->second;
-        native_function(caller_operands, mem);
-
+    if (target.native != nullptr) {
+        if constexpr (profiled) {
+            // the native is left as soon as it returns, exceptions abort the whole execution
+            state.profiler->enter_native(*target.native);
+            target.native->function(caller_operands, mem);
+            state.profiler->leave();
+        } else {
+            target.native->function(caller_operands, mem);
+        }
         return false;
     }
 
-    const function_definition &callee_def = callee_def_it->second;
-
-    call_stack.push_frame(callee_def);
+    if (tail && target.function->return_byte_count == call_stack.peek_frame().function.return_byte_count) {
+        call_stack.replace_frame(*target.function);
+        if constexpr (profiled) {
+            // the caller returns as the callee is entered
+            state.profiler->leave();
+        }
+    } else {
+        call_stack.push_frame(*target.function);
+    }
+    if constexpr (profiled) {
+        state.profiler->enter_function(*target.function);
+    }
     return true;
 }
 
 /**
- * Will run a frame until it returns or pushes a new method inside the call_stack
- * @return the frame status
+ * Replays the instructions of a forked child as the file actions of a `posix_spawn` call.
+ *
+ * A process call is compiled as a fork whose child applies its redirections and then executes the
+ * argument vector left on the operand stack. When the child's instructions only consist of such redirections,
+ * the command is directly spawned, which spares the copy of the whole VM's address space by `fork`.
  */
-frame_status run_frame(runtime_state &state, stack_frame &frame, CallStack &call_stack, const std::byte *instructions, size_t instruction_count, runtime_memory &mem) {
-    size_t pool_index = frame.function.constant_pool_index;
-    const ConstantPool &pool = state.pager.get_pool(pool_index);
-
-    // the instruction pointer
-    size_t &ip = frame.instruction_pointer;
-    OperandStack &operands = frame.operands;
-    Locals &locals = frame.locals;
-
-    auto implement_fetch = [&]<typename T>() mutable {
-        uint32_t dynsym_index = msh::read_big_endian<uint32_t>(instructions + ip);
-        ip += 4;
-        T value = state.pager.get<T>(pool_index, dynsym_index);
-        operands.push<T>(value);
+class spawn_plan {
+    /**
+     * A file opened by the child, that is only opened by the spawn at its first redirection.
+     */
+    struct opened_file {
+        const std::string &path;
+        int flags;
+
+        /**
+         * The descriptor the file has been opened at, or -1 if it is not opened yet.
+         */
+        int fd;
     };
 
-    auto implement_store = [&]<typename T>() mutable {
-        uint32_t dynsym_index = msh::read_big_endian<uint32_t>(instructions + ip);
-        ip += 4;
-        T value = operands.pop<T>();
-        state.pager.set<T>(pool_index, dynsym_index, value);
+    /**
+     * A quad-word pushed by the child, or a reference to one of its opened files.
+     */
+    struct operand {
+        int64_t value;
+        int file;
     };
 
-    while (ip < instruction_count) {
-        // Read the opcode
-        Opcode opcode = static_cast<Opcode>(instructions[ip++]);
-        switch (opcode) {
-        case OP_PUSH_INT: {
-            // Read the 8 byte int value
-            int64_t value = msh::read_big_endian<int64_t>(instructions + ip);
-            ip += 8;
-            // Push the value onto the stack
-            operands.push_int(value);
-            break;
-        }
-        case OP_PUSH_BYTE: {
-            std::byte value = *(instructions + ip);
-            ip++;
-            operands.push_byte(static_cast<int8_t>(value));
-            break;
-        }
-        case OP_PUSH_FLOAT: {
-            // Read the 8 byte float value
-            int64_t value = msh::read_big_endian<int64_t>(instructions + ip);
-            ip += 8;
-            // Push the value onto the stack
-            operands.push_double(reinterpret_cast<double &>(value));
-            break;
-        }
-        case OP_PUSH_STRING_REF: {
-            // Read the string reference
-            constant_index index = msh::read_big_endian<constant_index>(instructions + ip);
-            ip += sizeof(constant_index);
-
-            // Push the string index onto the stack
-            msh::obj &ref = const_cast<msh::obj &>(pool.get_ref(index));
-            operands.push_reference(ref); // Promise not to modify the string
-            break;
-        }
-        case OP_PUSH_LOCAL_REF: {
-            // Read the locals address
-            int32_t local_index = msh::read_big_endian<int32_t>(instructions + ip);
-            ip += sizeof(int32_t);
+    static constexpr int NO_FILE = -1;
 
-            uint8_t *ref = &locals.reference(local_index);
+    OperandStack &parent_operands;
+    size_t parent_offset = 0;
+    std::vector<operand> operands;
+    std::vector<opened_file> files;
+    posix_spawn_file_actions_t actions;
 
-            // Push the local reference onto the stack
-            operands.push_unchecked_reference(ref);
-            break;
+    /**
+     * Pops an operand of the child, that is a parent operand if the child did not push it.
+     * @return false if the parent operand stack is empty
+     */
+    bool pop(operand &op) {
+        if (!operands.empty()) {
+            op = operands.back();
+            operands.pop_back();
+            return true;
         }
-        case OP_STRUCT_GET_BYTE: {
-            int32_t struct_index = msh::read_big_endian<int32_t>(instructions + ip);
-            ip += sizeof(int32_t);
-
-            msh::obj_struct &structure = operands.pop_reference().get<msh::obj_struct>();
-            int8_t byte = structure.bytes[struct_index];
-            operands.push_byte(byte);
-            break;
+        if (parent_offset + sizeof(int64_t) > parent_operands.size()) {
+            return false;
         }
-        case OP_STRUCT_SET_BYTE: {
-            int32_t struct_index = msh::read_big_endian<int32_t>(instructions + ip);
-            ip += sizeof(int32_t);
-
-            int8_t byte = operands.pop_byte();
-            msh::obj &obj = operands.pop_reference();
-            msh::obj_struct &structure = obj.get<msh::obj_struct>();
-            structure.bytes[struct_index] = byte;
-            break;
+        parent_offset += sizeof(int64_t);
+        op = {parent_operands.peek<int64_t>(parent_offset), NO_FILE};
+        return true;
+    }
+
+    bool redirect(const operand &source, int target) {
+        // a descriptor that is overwritten by the redirection no longer refers to its opened file
+        for (opened_file &file : files) {
+            if (file.fd == target && (source.file == NO_FILE || &file != &files[source.file])) {
+                file.fd = -2;
+            }
         }
-        case OP_STRUCT_GET_Q_WORD: {
-            int32_t struct_index = msh::read_big_endian<int32_t>(instructions + ip);
-            ip += sizeof(int32_t);
-
-            msh::obj &obj = operands.pop_reference();
-            msh::obj_struct &structure = obj.get<msh::obj_struct>();
-            uint64_t qword = *(uint64_t *)(structure.bytes.data() + struct_index);
-            operands.push_int(qword);
-            break;
+        if (source.file == NO_FILE) {
+            return posix_spawn_file_actions_adddup2(&actions, static_cast<int>(source.value), target) == 0;
         }
-        case OP_STRUCT_SET_Q_WORD: {
-            int32_t struct_index = msh::read_big_endian<int32_t>(instructions + ip);
-            ip += sizeof(int32_t);
-
-            int64_t qword = operands.pop_int();
-            msh::obj &obj = operands.pop_reference();
-            msh::obj_struct &structure = obj.get<msh::obj_struct>();
-            *(int64_t *)(structure.bytes.data() + struct_index) = qword;
-            break;
+        opened_file &file = files[source.file];
+        if (file.fd == -1) {
+            file.fd = target;
+            return posix_spawn_file_actions_addopen(&actions, target, file.path.c_str(), file.flags, OPEN_MODE) == 0;
         }
-        case OP_BOX_Q_WORD: {
-            // Pop the value
-            int64_t value = operands.pop_int();
+        return file.fd >= 0 && posix_spawn_file_actions_adddup2(&actions, file.fd, target) == 0;
+    }
 
-            // Push the reference onto the stack
-            operands.push_reference(mem.emplace(value));
-            break;
-        }
-        case OP_BOX_BYTE: {
-            // Pop the value
-            int8_t value = operands.pop_byte();
+public:
+    explicit spawn_plan(OperandStack &parent_operands) : parent_operands{parent_operands} {
+        posix_spawn_file_actions_init(&actions);
+    }
 
-            // Push the reference onto the stack
-            operands.push_reference(mem.emplace(value));
-            break;
-        }
-        case OP_UNBOX: {
-            // Pop the reference
-            msh::obj &ref = operands.pop_reference();
-
-            // Push the value onto the stack
-            std::visit([&](auto &&arg) {
-                using T = std::decay_t<decltype(arg)>;
-                if constexpr (std::is_same_v<T, int64_t>) {
-                    operands.push_int(arg);
-                } else if constexpr (std::is_same_v<T, double>) {
-                    operands.push_double(arg);
-                } else if constexpr (std::is_same_v<T, int8_t>) {
-                    operands.push_byte(arg);
-                } else {
-                    throw InvalidBytecodeError("Cannot unbox unknown type");
+    spawn_plan(const spawn_plan &) = delete;
+    spawn_plan &operator=(const spawn_plan &) = delete;
+
+    ~spawn_plan() {
+        posix_spawn_file_actions_destroy(&actions);
+    }
+
+    /**
+     * Spawns the command that the child instructions would execute.
+     *
+     * @param instructions the child's instructions, that follows the fork instruction
+     * @param pgid the process group to put the process in, or zero
+     * @return the pid of the spawned process, or -1 if the instructions cannot be replayed or if the spawn failed.
+     *         The process call must then be forked, which also lets the child report its error.
+     */
+    pid_t spawn(const std::byte *instructions, const ConstantPool &pool, const Locals &locals, pid_t pgid) {
+        size_t ip = 0;
+        operand a{}, b{};
+        while (true) {
+            switch (static_cast<Opcode>(instructions[ip++])) {
+            case OP_PUSH_INT:
+                operands.push_back({msh::read_native_endian<int64_t>(instructions + ip), NO_FILE});
+                ip += sizeof(int64_t);
+                break;
+            case OP_PUSH_STRING_REF: {
+                const msh::obj &ref = pool.get_ref(msh::read_native_endian<constant_index>(instructions + ip));
+                operands.push_back({reinterpret_cast<int64_t>(&ref), NO_FILE});
+                ip += sizeof(constant_index);
+                break;
+            }
+            case OP_LOCAL_GET_Q_WORD:
+                operands.push_back({locals.get_q_word(msh::read_native_endian<int32_t>(instructions + ip)), NO_FILE});
+                ip += sizeof(int32_t);
+                break;
+            case OP_OPEN: {
+                if (!pop(a) || a.file != NO_FILE) {
+                    return -1;
+                }
+                const std::string &path = reinterpret_cast<msh::obj *>(a.value)->get_string();
+                files.push_back({path, static_cast<int>(msh::read_native_endian<int32_t>(instructions + ip)), -1});
+                operands.push_back({0, static_cast<int>(files.size() - 1)});
+                ip += sizeof(int32_t);
+                break;
+            }
+            case OP_REDIRECT:
+                if (!pop(b) || !pop(a) || b.file != NO_FILE || !redirect(a, static_cast<int>(b.value))) {
+                    return -1;
+                }
+                operands.push_back(a);
+                break;
+            case OP_CLOSE:
+                if (!pop(a)) {
+                    return -1;
                 }
-            },
-                       ref.get_data());
-            break;
+                if (a.file == NO_FILE) {
+                    posix_spawn_file_actions_addclose(&actions, static_cast<int>(a.value));
+                } else if (files[a.file].fd == -1) {
+                    // the file is only opened for its side effects
+                    return -1;
+                }
+                break;
+            case OP_POP_Q_WORD:
+                if (!pop(a)) {
+                    return -1;
+                }
+                break;
+            case OP_EXEC:
+                if (!pop(a) || a.file != NO_FILE) {
+                    return -1;
+                }
+                return spawn_command(reinterpret_cast<msh::obj *>(a.value)->get<msh::obj_vector>(), pgid);
+            default:
+                return -1;
+            }
         }
-        case OP_STRUCT_NEW: {
-            constant_index identifier_idx = msh::read_big_endian<constant_index>(instructions + ip);
-            ip += sizeof(constant_index);
-            const std::string &identifier = pool.get_string(identifier_idx);
-
-            auto struct_def_it = state.loader.find_structure(identifier);
+    }
 
-            if (struct_def_it == state.loader.structures_cend()) {
-                throw InvalidBytecodeError("Unknown structure `" + identifier + "`");
-                return frame_status::ABORT;
+private:
+    pid_t spawn_command(const msh::obj_vector &args, pid_t pgid) {
+        std::vector<const char *> argv(args.size() + 1);
+        std::transform(args.begin(), args.end(), argv.begin(), [](msh::obj *arg) {
+            return arg->get_string().c_str();
+        });
+
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        if (pgid != 0) {
+            // Put the process into the process group, with the default handling of job control signals
+            sigset_t defaults;
+            sigemptyset(&defaults);
+            for (int sig : {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU}) {
+                sigaddset(&defaults, sig);
             }
+            posix_spawnattr_setpgroup(&attr, pgid);
+            posix_spawnattr_setsigdefault(&attr, &defaults);
+            posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF);
+        }
+        pid_t pid;
+        int err = posix_spawnp(&pid, argv[0], &actions, &attr, const_cast<char *const *>(argv.data()), environ);
+        posix_spawnattr_destroy(&attr);
+        return err == 0 ? pid : -1;
+    }
+};
 
-            const msh::struct_definition &struct_def = struct_def_it->second;
+#ifdef MOSHELL_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
 
-            msh::obj &obj = mem.emplace(msh::obj_struct{
-                &struct_def,
-                std::vector<char>(struct_def.heap_size)});
+/**
+ * Will run the frames of the call stack until the root frame returns.
+ *
+ * Function invocations and returns are handled in place: the interpreter switches
+ * to the callee (or caller) frame without leaving the dispatch loop.
+ * The frames of verified functions run without checking their operands, locals, constants and dynamic symbols accesses,
+ * the interpreter is left as soon as the next frame to run is not of the same kind.
+ * @tparam verified whether the interpreter runs the frames of verified functions
+ * @tparam profiled whether the executed instructions and the calls are recorded by the state's profiler
+ * @return the status of the root frame, or SWITCHED if the frame on top of the call stack is of the other kind
+ */
+template <bool verified, bool profiled>
+frame_status run_frames(runtime_state &state, CallStack &call_stack, runtime_memory &mem) {
+    constexpr bool checked = !verified;
+
+    stack_frame *frame;
+    const std::byte *instructions;
+    size_t pool_index;
+    const ConstantPool *pool;
+    msh::call_target *call_targets;
+    const msh::struct_definition **structure_targets;
+    char *const *dynsym_slots;
+    OperandStack *operands;
+    Locals *locals;
+
+    // the instruction pointer of the current frame,
+    // only stored back in the frame when leaving it or when an exception is raised
+    size_t ip;
+    Opcode opcode;
+
+    // binds the interpreter state to the frame on top of the call stack,
+    // returns false if the frame must be run by the interpreter of the other kind
+    auto enter_frame = [&]() {
+        frame = &call_stack.peek_frame();
+        const function_definition &def = frame->function;
+        instructions = def.instructions;
+        pool_index = def.constant_pool_index;
+        pool = &state.pager.get_pool(pool_index);
+        call_targets = state.pager.get_call_targets(pool_index);
+        structure_targets = state.pager.get_structure_targets(pool_index);
+        dynsym_slots = state.pager.get_dynsym_slots(pool_index);
+        operands = &frame->operands;
+        locals = &frame->locals;
+        ip = frame->instruction_pointer;
+        return def.verified == verified;
+    };
 
-            operands.push_reference(obj);
-            break;
+    // the unverified frames can jump anywhere, but only up to the return instruction that ends their function
+    auto jump_destination = [&](size_t destination) {
+        if constexpr (checked) {
+            if (destination > frame->function.instruction_count) {
+                throw InvalidBytecodeError("Jump destination " + std::to_string(destination) + " is out of range.");
+            }
         }
-        case OP_STRUCT_COPY_N: {
-            uint32_t count = msh::read_big_endian<uint32_t>(instructions + ip);
-            ip += sizeof(uint32_t);
-
-            msh::obj &obj = operands.pop_reference();
-            msh::obj_struct &structure = obj.get<msh::obj_struct>();
-            const std::byte *bytes = operands.pop_bytes(count);
-            memcpy(structure.bytes.data(), bytes, count);
-            operands.push_reference(obj);
-            break;
+        return destination;
+    };
+
+    // gets the address of the variable bound to the dynamic symbol operand
+    auto dynsym_slot = [&]() {
+        uint32_t dynsym_index = msh::read_native_endian<uint32_t>(instructions + ip);
+        ip += 4;
+        if constexpr (checked) {
+            if (dynsym_index >= state.pager.get_dynsym_count(pool_index)) {
+                throw std::out_of_range("Dynamic symbol " + std::to_string(dynsym_index) + " is out of range.");
+            }
         }
-        case OP_INVOKE: {
-            constant_index identifier_idx = msh::read_big_endian<constant_index>(instructions + ip);
-            ip += sizeof(constant_index);
+        return dynsym_slots[dynsym_index];
+    };
 
-            const std::string &function_identifier = pool.get_string(identifier_idx);
+    auto implement_fetch = [&]<typename T>() mutable {
+        T value;
+        std::memcpy(&value, dynsym_slot(), sizeof(T));
+        operands->push<T, checked>(value);
+    };
+
+    auto implement_store = [&]<typename T>() mutable {
+        char *slot = dynsym_slot();
+        T value = operands->pop<T, checked>();
+        std::memcpy(slot, &value, sizeof(T));
+    };
 
-            if (handle_function_invocation(function_identifier, state, mem, operands, call_stack)) {
-                // terminate this frame interpretation if a new frame has been pushed in the stack
-                // (natives functions are directly run thus no need to return if no moshell function is to execute)
-                return frame_status::NEW_FRAME;
+#ifdef MOSHELL_JIT
+    // runs the native code of the current function from the instruction pointer, once the function is hot enough.
+    // The native code leaves the operands and locals as the interpreter would, and gives back the next instruction to run
+    auto run_native_code = [&]() {
+        const function_definition &def = frame->function;
+        if (def.native_code == nullptr) {
+            uint32_t threshold = state.jit->get_threshold();
+            if (def.hotness > threshold || ++def.hotness < threshold) {
+                return;
+            }
+            def.native_code = state.jit->compile(def, state.pager);
+            if (def.native_code == nullptr) {
+                // the function is never compiled again
+                def.hotness = UINT32_MAX;
+                return;
             }
-            break;
         }
-        case OP_FORK: {
-            uint32_t parent_jump = msh::read_big_endian<uint32_t>(instructions + ip);
-            ip += sizeof(uint32_t);
-            pid_t pid = fork();
-            switch (pid) {
-            case -1:
-                panic(strerror(errno), call_stack);
-                return frame_status::ABORT;
-            case 0:
-                // Child process
-                is_master = false;
-                if (state.pgid != 0) {
-                    // Put the process into the process group
-                    pid = getpid();
-                    setpgid(pid, state.pgid);
-
-                    // Set the handling for job control signals back to the default
-                    signal(SIGINT, SIG_DFL);
-                    signal(SIGQUIT, SIG_DFL);
-                    signal(SIGTSTP, SIG_DFL);
-                    signal(SIGTTIN, SIG_DFL);
-                    signal(SIGTTOU, SIG_DFL);
+        msh::jit_exit exit = def.native_code->run(operands->top(), locals->data(), ip);
+        operands->set_top(exit.top);
+        ip = exit.ip;
+    };
+#endif
+
+#ifdef MOSHELL_COMPUTED_GOTO
+    // the label of each opcode's implementation, unknown opcodes are bound to the fallback label.
+    // The table is only bound once, as the interpreter is entered again on each switch between verified and unverified frames.
+    static std::array<void *, 256> dispatch_table;
+    static bool dispatch_table_bound = false;
+    if (!dispatch_table_bound) {
+        dispatch_table.fill(&&op_unknown);
+#define BIND_TARGET(op) dispatch_table[op] = &&op_##op
+        BIND_TARGET(OP_PUSH_INT);
+        BIND_TARGET(OP_PUSH_BYTE);
+        BIND_TARGET(OP_PUSH_FLOAT);
+        BIND_TARGET(OP_PUSH_STRING_REF);
+        BIND_TARGET(OP_PUSH_LOCAL_REF);
+        BIND_TARGET(OP_BOX_Q_WORD);
+        BIND_TARGET(OP_BOX_BYTE);
+        BIND_TARGET(OP_UNBOX);
+        BIND_TARGET(OP_LOCAL_GET_BYTE);
+        BIND_TARGET(OP_LOCAL_SET_BYTE);
+        BIND_TARGET(OP_LOCAL_GET_Q_WORD);
+        BIND_TARGET(OP_LOCAL_SET_Q_WORD);
+        BIND_TARGET(OP_REF_GET_BYTE);
+        BIND_TARGET(OP_REF_SET_BYTE);
+        BIND_TARGET(OP_REF_GET_Q_WORD);
+        BIND_TARGET(OP_REF_SET_Q_WORD);
+        BIND_TARGET(OP_STRUCT_GET_BYTE);
+        BIND_TARGET(OP_STRUCT_SET_BYTE);
+        BIND_TARGET(OP_STRUCT_GET_Q_WORD);
+        BIND_TARGET(OP_STRUCT_SET_Q_WORD);
+        BIND_TARGET(OP_FETCH_BYTE);
+        BIND_TARGET(OP_FETCH_Q_WORD);
+        BIND_TARGET(OP_STORE_BYTE);
+        BIND_TARGET(OP_STORE_Q_WORD);
+        BIND_TARGET(OP_STRUCT_NEW);
+        BIND_TARGET(OP_STRUCT_COPY_N);
+        BIND_TARGET(OP_INVOKE);
+        BIND_TARGET(OP_FORK);
+        BIND_TARGET(OP_EXEC);
+        BIND_TARGET(OP_WAIT);
+        BIND_TARGET(OP_OPEN);
+        BIND_TARGET(OP_CLOSE);
+        BIND_TARGET(OP_SETUP_REDIRECT);
+        BIND_TARGET(OP_REDIRECT);
+        BIND_TARGET(OP_POP_REDIRECT);
+        BIND_TARGET(OP_PIPE);
+        BIND_TARGET(OP_READ);
+        BIND_TARGET(OP_WRITE);
+        BIND_TARGET(OP_EXIT);
+        BIND_TARGET(OP_DUP);
+        BIND_TARGET(OP_DUP_BYTE);
+        BIND_TARGET(OP_SWAP);
+        BIND_TARGET(OP_SWAP_2);
+        BIND_TARGET(OP_POP_BYTE);
+        BIND_TARGET(OP_POP_Q_WORD);
+        BIND_TARGET(OP_IF_JUMP);
+        BIND_TARGET(OP_IF_NOT_JUMP);
+        BIND_TARGET(OP_JUMP);
+        BIND_TARGET(OP_RETURN);
+        BIND_TARGET(OP_BYTE_TO_INT);
+        BIND_TARGET(OP_INT_TO_BYTE);
+        BIND_TARGET(OP_BYTE_XOR);
+        BIND_TARGET(OP_INT_ADD);
+        BIND_TARGET(OP_INT_SUB);
+        BIND_TARGET(OP_INT_MUL);
+        BIND_TARGET(OP_INT_DIV);
+        BIND_TARGET(OP_INT_MOD);
+        BIND_TARGET(OP_INT_NEG);
+        BIND_TARGET(OP_FLOAT_ADD);
+        BIND_TARGET(OP_FLOAT_SUB);
+        BIND_TARGET(OP_FLOAT_MUL);
+        BIND_TARGET(OP_FLOAT_DIV);
+        BIND_TARGET(OP_FLOAT_NEG);
+        BIND_TARGET(OP_INT_EQ);
+        BIND_TARGET(OP_INT_LT);
+        BIND_TARGET(OP_INT_LE);
+        BIND_TARGET(OP_INT_GT);
+        BIND_TARGET(OP_INT_GE);
+        BIND_TARGET(OP_FLOAT_EQ);
+        BIND_TARGET(OP_FLOAT_LT);
+        BIND_TARGET(OP_FLOAT_LE);
+        BIND_TARGET(OP_FLOAT_GT);
+        BIND_TARGET(OP_FLOAT_GE);
+        BIND_TARGET(OP_INT_ADD_CONST);
+        BIND_TARGET(OP_LOCAL_REF_GET_Q_WORD);
+        BIND_TARGET(OP_INT_COMPARE_IF_JUMP);
+        BIND_TARGET(OP_INT_COMPARE_IF_NOT_JUMP);
+        BIND_TARGET(OP_TAIL_INVOKE);
+#undef BIND_TARGET
+        dispatch_table_bound = true;
+    }
+
+#define TARGET(op) op_##op:
+#define DISPATCH()                                       \
+    do {                                                 \
+        opcode = static_cast<Opcode>(instructions[ip++]); \
+        if constexpr (profiled) {                        \
+            state.profiler->count_instruction(opcode);   \
+        }                                                \
+        goto *dispatch_table[opcode];                    \
+    } while (0)
+#define UNKNOWN_TARGET op_unknown:
+#else
+#define TARGET(op) case op:
+#define DISPATCH() continue
+#define UNKNOWN_TARGET default:
+#endif
+
+#ifdef MOSHELL_JIT
+// the native code is entered at the start of the functions, and at the start of their loops
+#define ENTER_NATIVE_CODE()                    \
+    do {                                       \
+        if constexpr (verified && !profiled) { \
+            if (state.jit != nullptr) {        \
+                run_native_code();             \
+            }                                  \
+        }                                      \
+    } while (0)
+#define JUMP_TO(destination)                \
+    do {                                    \
+        size_t source = ip;                 \
+        ip = jump_destination(destination); \
+        if (ip < source) {                  \
+            ENTER_NATIVE_CODE();            \
+        }                                   \
+    } while (0)
+#else
+#define ENTER_NATIVE_CODE() \
+    do {                    \
+    } while (0)
+#define JUMP_TO(destination) ip = jump_destination(destination)
+#endif
+
+    enter_frame();
+    try {
+#ifdef MOSHELL_COMPUTED_GOTO
+        DISPATCH();
+        {
+#else
+        while (true) {
+            // Read the opcode
+            opcode = static_cast<Opcode>(instructions[ip++]);
+            if constexpr (profiled) {
+                state.profiler->count_instruction(opcode);
+            }
+            switch (opcode) {
+#endif
+            TARGET(OP_PUSH_INT) {
+                // Read the 8 byte int value
+                int64_t value = msh::read_native_endian<int64_t>(instructions + ip);
+                ip += 8;
+                // Push the value onto the stack
+                operands->push_int<checked>(value);
+                DISPATCH();
+            }
+            TARGET(OP_PUSH_BYTE) {
+                std::byte value = *(instructions + ip);
+                ip++;
+                operands->push_byte<checked>(static_cast<int8_t>(value));
+                DISPATCH();
+            }
+            TARGET(OP_PUSH_FLOAT) {
+                // Read the 8 byte float value
+                double value = msh::read_native_endian<double>(instructions + ip);
+                ip += 8;
+                // Push the value onto the stack
+                operands->push_double<checked>(value);
+                DISPATCH();
+            }
+            TARGET(OP_PUSH_STRING_REF) {
+                // Read the string reference
+                constant_index index = msh::read_native_endian<constant_index>(instructions + ip);
+                ip += sizeof(constant_index);
+
+                // Push the string index onto the stack
+                msh::obj &ref = const_cast<msh::obj &>(pool->get_ref<checked>(index));
+                operands->push_reference<checked>(ref); // Promise not to modify the string
+                DISPATCH();
+            }
+            TARGET(OP_PUSH_LOCAL_REF) {
+                // Read the locals address
+                int32_t local_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+
+                uint8_t *ref = &locals->reference<checked>(local_index);
+
+                // Push the local reference onto the stack
+                operands->push_unchecked_reference<checked>(ref);
+                DISPATCH();
+            }
+            TARGET(OP_STRUCT_GET_BYTE) {
+                int32_t struct_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+
+                msh::obj_struct &structure = operands->pop_reference<checked>().template get<msh::obj_struct>();
+                int8_t byte = structure.data()[struct_index];
+                operands->push_byte<checked>(byte);
+                DISPATCH();
+            }
+            TARGET(OP_STRUCT_SET_BYTE) {
+                int32_t struct_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+
+                int8_t byte = operands->pop_byte<checked>();
+                msh::obj &obj = operands->pop_reference<checked>();
+                msh::obj_struct &structure = obj.get<msh::obj_struct>();
+                structure.data()[struct_index] = byte;
+                DISPATCH();
+            }
+            TARGET(OP_STRUCT_GET_Q_WORD) {
+                int32_t struct_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+
+                msh::obj &obj = operands->pop_reference<checked>();
+                msh::obj_struct &structure = obj.get<msh::obj_struct>();
+                uint64_t qword = *(uint64_t *)(structure.data() + struct_index);
+                operands->push_int<checked>(qword);
+                DISPATCH();
+            }
+            TARGET(OP_STRUCT_SET_Q_WORD) {
+                int32_t struct_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+
+                int64_t qword = operands->pop_int<checked>();
+                msh::obj &obj = operands->pop_reference<checked>();
+                msh::obj_struct &structure = obj.get<msh::obj_struct>();
+                *(int64_t *)(structure.data() + struct_index) = qword;
+                mem.write_barrier(obj);
+                DISPATCH();
+            }
+            TARGET(OP_BOX_Q_WORD) {
+                // Pop the value
+                int64_t value = operands->pop_int<checked>();
+
+                // Push the reference onto the stack
+                operands->push_reference<checked>(mem.emplace(value));
+                DISPATCH();
+            }
+            TARGET(OP_BOX_BYTE) {
+                // Pop the value
+                int8_t value = operands->pop_byte<checked>();
+
+                // Push the reference onto the stack
+                operands->push_reference<checked>(mem.emplace(value));
+                DISPATCH();
+            }
+            TARGET(OP_UNBOX) {
+                // Pop the reference
+                msh::obj &ref = operands->pop_reference<checked>();
+
+                // Push the value onto the stack
+                std::visit([&](auto &&arg) {
+                    using T = std::decay_t<decltype(arg)>;
+                    if constexpr (std::is_same_v<T, int64_t>) {
+                        operands->push_int<checked>(arg);
+                    } else if constexpr (std::is_same_v<T, double>) {
+                        operands->push_double<checked>(arg);
+                    } else if constexpr (std::is_same_v<T, int8_t>) {
+                        operands->push_byte<checked>(arg);
+                    } else {
+                        throw InvalidBytecodeError("Cannot unbox unknown type");
+                    }
+                },
+                           ref.get_data());
+                DISPATCH();
+            }
+            TARGET(OP_STRUCT_NEW) {
+                constant_index identifier_idx = msh::read_native_endian<constant_index>(instructions + ip);
+                ip += sizeof(constant_index);
+                const msh::struct_definition *struct_def = structure_targets[identifier_idx];
+                if (struct_def == nullptr) {
+                    // the structure was not loaded yet when the function was linked
+                    const std::string &identifier = pool->get_string(identifier_idx);
+                    auto struct_def_it = state.loader.find_structure(identifier);
+                    if (struct_def_it == state.loader.structures_cend()) {
+                        throw InvalidBytecodeError("Unknown structure `" + identifier + "`");
+                    }
+                    struct_def = &struct_def_it->second;
+                    structure_targets[identifier_idx] = struct_def;
+                }
+
+                msh::obj &obj = mem.emplace(msh::obj_struct(struct_def));
+
+                operands->push_reference<checked>(obj);
+                DISPATCH();
+            }
+            TARGET(OP_STRUCT_COPY_N) {
+                uint32_t count = msh::read_native_endian<uint32_t>(instructions + ip);
+                ip += sizeof(uint32_t);
+
+                msh::obj &obj = operands->pop_reference<checked>();
+                msh::obj_struct &structure = obj.get<msh::obj_struct>();
+                const std::byte *bytes = operands->pop_bytes<checked>(count);
+                memcpy(structure.data(), bytes, count);
+                mem.write_barrier(obj);
+                operands->push_reference<checked>(obj);
+                DISPATCH();
+            }
+            TARGET(OP_INVOKE) {
+                constant_index identifier_idx = msh::read_native_endian<constant_index>(instructions + ip);
+                ip += sizeof(constant_index);
+
+                frame->instruction_pointer = ip;
+                if (handle_function_invocation<profiled>(call_targets[identifier_idx], identifier_idx, *pool, state, mem, *operands, call_stack, false)) {
+                    // continue the interpretation in the callee frame if a new frame has been pushed in the stack
+                    // (natives functions are directly run thus the current frame simply continues)
+                    if (!enter_frame()) {
+                        return frame_status::SWITCHED;
+                    }
+                    ENTER_NATIVE_CODE();
+                }
+                DISPATCH();
+            }
+            TARGET(OP_TAIL_INVOKE) {
+                constant_index identifier_idx = msh::read_native_endian<constant_index>(instructions + ip);
+                ip += sizeof(constant_index);
+
+                frame->instruction_pointer = ip;
+                // the frame is either replaced by the callee's frame,
+                // or continues with the return that follows the invocation
+                if (handle_function_invocation<profiled>(call_targets[identifier_idx], identifier_idx, *pool, state, mem, *operands, call_stack, true)) {
+                    if (!enter_frame()) {
+                        return frame_status::SWITCHED;
+                    }
+                    ENTER_NATIVE_CODE();
+                }
+                DISPATCH();
+            }
+            TARGET(OP_FORK) {
+                uint32_t parent_jump = msh::read_native_endian<uint32_t>(instructions + ip);
+                ip += sizeof(uint32_t);
+                pid_t pid = spawn_plan(*operands).spawn(instructions + ip, *pool, *locals, state.pgid);
+                if (pid == -1) {
+                    pid = fork();
                 }
+                switch (pid) {
+                case -1:
+                    throw RuntimeException(strerror(errno));
+                case 0:
+                    // Child process
+                    is_master = false;
+                    children.clear();
+                    if (state.pgid != 0) {
+                        // Put the process into the process group
+                        pid = getpid();
+                        setpgid(pid, state.pgid);
+
+                        // Set the handling for job control signals back to the default
+                        signal(SIGINT, SIG_DFL);
+                        signal(SIGQUIT, SIG_DFL);
+                        signal(SIGTSTP, SIG_DFL);
+                        signal(SIGTTIN, SIG_DFL);
+                        signal(SIGTTOU, SIG_DFL);
+                    }
 #ifndef NDEBUG
-                msh::disable_gc_debug();
+                    msh::disable_gc_debug();
 #endif
-                break;
-            default:
-                // Parent process
-                ip = parent_jump;
-                operands.push_int(static_cast<int>(pid));
-                if (state.pgid != 0) {
-                    // Add the child process to the process group of the terminal
-                    setpgid(pid, state.pgid);
+                    break;
+                default:
+                    // Parent process
+                    ip = parent_jump;
+                    children.forget(pid);
+                    operands->push_int<checked>(static_cast<int>(pid));
+                    if (state.pgid != 0) {
+                        // Add the child process to the process group of the terminal
+                        setpgid(pid, state.pgid);
+                    }
+                    break;
                 }
-                break;
+                DISPATCH();
             }
-            break;
-        }
-        case OP_EXEC: {
-            // Read the 1 byte stack size
-            const msh::obj_vector &args = operands.pop_reference().get<msh::obj_vector>();
-
-            // Create argv of the given frame_size, and create a new string for each arg with a null byte after each string
-            std::vector<const char *> argv(args.size() + 1);
-            std::transform(args.begin(), args.end(), argv.begin(), [](const msh::obj *arg) {
-                return arg->get<const std::string>().c_str();
-            });
-
-            // Replace the current process with a new process image
-            if (execvp(argv[0], const_cast<char *const *>(argv.data())) == -1) {
-                std::string command = argv[0];
-                panic("Unable to execute command \"" + command + "\": " + std::string(strerror(errno)), call_stack);
-                return frame_status::ABORT;
-            }
-            break;
-        }
-        case OP_WAIT: {
-            // Pop the pid
-            pid_t pid = static_cast<pid_t>(operands.pop_int());
-
-            int status = 0;
-            // Wait for the process to finish
-            if (waitpid(pid, &status, 0) == -1) {
-                panic(strerror(errno), call_stack);
-                return frame_status::ABORT;
+            TARGET(OP_EXEC) {
+                // Read the 1 byte stack size
+                const msh::obj_vector &args = operands->pop_reference<checked>().template get<msh::obj_vector>();
+
+                // Create argv of the given frame_size, and create a new string for each arg with a null byte after each string
+                std::vector<const char *> argv(args.size() + 1);
+                std::transform(args.begin(), args.end(), argv.begin(), [](msh::obj *arg) {
+                    return arg->get_string().c_str();
+                });
+
+                // Replace the current process with a new process image
+                if (execvp(argv[0], const_cast<char *const *>(argv.data())) == -1) {
+                    std::string command = argv[0];
+                    throw RuntimeException("Unable to execute command \"" + command + "\": " + std::string(strerror(errno)));
+                }
+                DISPATCH();
             }
-            status = WEXITSTATUS(status) & 0xFF;
+            TARGET(OP_WAIT) {
+                // Pop the pid
+                pid_t pid = static_cast<pid_t>(operands->pop_int<checked>());
+
+                int status = 0;
+                // Wait for the process to finish
+                if (children.wait(pid, status) == -1) {
+                    throw RuntimeException(strerror(errno));
+                }
+                status = WEXITSTATUS(status) & 0xFF;
 
-            // Add the exit status to the stack
-            if (status == MOSHELL_PANIC) {
-                call_stack.clear();
-                return frame_status::ABORT;
+                // Add the exit status to the stack
+                if (status == MOSHELL_PANIC) {
+                    call_stack.clear();
+                    return frame_status::ABORT;
+                }
+                operands->push_byte<checked>(status);
+                DISPATCH();
             }
-            operands.push_byte(status);
-            break;
-        }
-        case OP_OPEN: {
-            // Pop the path
-            const std::string &path = operands.pop_reference().get<const std::string>();
+            TARGET(OP_OPEN) {
+                // Pop the path
+                const std::string &path = operands->pop_reference<checked>().get_string();
+
+                // Read the flags
+                int flags = static_cast<int>(msh::read_native_endian<int32_t>(instructions + ip));
 
-            // Read the flags
-            int flags = static_cast<int>(msh::read_big_endian<int32_t>(instructions + ip));
+                // Open the file
+                int fd = open(path.c_str(), flags, OPEN_MODE);
+                if (fd == -1) {
+                    throw RuntimeException("Cannot open file \"" + path + "\": " + std::string(strerror(errno)));
+                }
 
-            // Open the file
-            int fd = open(path.c_str(), flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-            if (fd == -1) {
-                panic("Cannot open file \"" + path + "\": " + std::string(strerror(errno)), call_stack);
-                return frame_status::ABORT;
+                // Push the file descriptor onto the stack
+                operands->push_int<checked>(fd);
+                ip += sizeof(int);
+                DISPATCH();
             }
+            TARGET(OP_CLOSE) {
+                // Pop the file descriptor
+                int fd = static_cast<int>(operands->pop_int<checked>());
 
-            // Push the file descriptor onto the stack
-            operands.push_int(fd);
-            ip += sizeof(int);
-            break;
-        }
-        case OP_CLOSE: {
-            // Pop the file descriptor
-            int fd = static_cast<int>(operands.pop_int());
+                // Close the file
+                close(fd);
+                DISPATCH();
+            }
+            TARGET(OP_SETUP_REDIRECT) {
+                // Pop the file descriptors
+                int fd2 = static_cast<int>(operands->pop_int<checked>());
+                int fd1 = static_cast<int>(operands->pop_int<checked>());
+
+                // Redirect the file descriptors
+                if (state.table.push_redirection(fd1, fd2) == -1) {
+                    throw RuntimeException("Unable to redirect " + std::to_string(fd1) + " to " + std::to_string(fd2) + ": " + strerror(errno));
+                }
+                operands->push_int<checked>(fd1);
+                DISPATCH();
+            }
+            TARGET(OP_REDIRECT) {
+                // Pop the file descriptors
+                int fd2 = operands->pop_int<checked>();
+                int fd1 = operands->pop_int<checked>();
+
+                // Redirect the file descriptors
+                if (dup2(fd1, fd2) == -1) {
+                    throw RuntimeException("Unable to redirect " + std::to_string(fd1) + " to " + std::to_string(fd2) + ": " + strerror(errno));
+                }
+                operands->push_int<checked>(fd1);
+                DISPATCH();
+            }
+            TARGET(OP_POP_REDIRECT) {
+                state.table.pop_redirection();
+                DISPATCH();
+            }
+            TARGET(OP_PIPE) {
+                // Create the pipe
+                int pipefd[2];
+                if (pipe(pipefd) == -1) {
+                    throw RuntimeException("Cannot create pipeline : " + std::string(strerror(errno)));
+                }
 
-            // Close the file
-            close(fd);
-            break;
-        }
-        case OP_SETUP_REDIRECT: {
-            // Pop the file descriptors
-            int fd2 = static_cast<int>(operands.pop_int());
-            int fd1 = static_cast<int>(operands.pop_int());
-
-            // Redirect the file descriptors
-            if (state.table.push_redirection(fd1, fd2) == -1) {
-                panic("Unable to redirect " + std::to_string(fd1) + " to " + std::to_string(fd2) + ": " + strerror(errno), call_stack);
-                return frame_status::ABORT;
-            }
-            operands.push_int(fd1);
-            break;
-        }
-        case OP_REDIRECT: {
-            // Pop the file descriptors
-            int fd2 = operands.pop_int();
-            int fd1 = operands.pop_int();
-
-            // Redirect the file descriptors
-            if (dup2(fd1, fd2) == -1) {
-                panic("Unable to redirect " + std::to_string(fd1) + " to " + std::to_string(fd2) + ": " + strerror(errno), call_stack);
-                return frame_status::ABORT;
-            }
-            operands.push_int(fd1);
-            break;
-        }
-        case OP_POP_REDIRECT: {
-            state.table.pop_redirection();
-            break;
-        }
-        case OP_PIPE: {
-            // Create the pipe
-            int pipefd[2];
-            if (pipe(pipefd) == -1) {
-                panic("Cannot create pipeline : " + std::string(strerror(errno)), call_stack);
-                return frame_status::ABORT;
-            }
-
-            // Push the file descriptors onto the stack
-            operands.push_int(pipefd[0]);
-            operands.push_int(pipefd[1]);
-            break;
-        }
-        case OP_READ: {
-            // Pop the file descriptor
-            int fd = static_cast<int>(operands.pop_int());
-
-            std::string out;
-            std::array<char, 4096> buffer;
-            ssize_t r;
-            do {
-                r = read(fd, buffer.data(), buffer.size());
-                if (r == -1) {
-                    if (errno != EAGAIN && errno != EINTR) {
-                        panic(strerror(errno), call_stack);
-                        return frame_status::ABORT;
-                    }
+                // Push the file descriptors onto the stack
+                operands->push_int<checked>(pipefd[0]);
+                operands->push_int<checked>(pipefd[1]);
+                DISPATCH();
+            }
+            TARGET(OP_READ) {
+                // Pop the file descriptor
+                int fd = static_cast<int>(operands->pop_int<checked>());
+
+                std::string out;
+                if (read_all(fd, out) == -1) {
+                    throw RuntimeException(strerror(errno));
                 }
-                if (r > 0) {
-                    out.append(buffer.data(), r);
+
+                // Remove trailing `\n`
+                if (!out.empty() && out.back() == '\n') {
+                    out.pop_back();
                 }
-            } while (r != 0);
 
-            // Remove trailing `\n`
-            if (!out.empty() && out.back() == '\n') {
-                out.pop_back();
+                // Push the string onto the stack
+                msh::obj &str = mem.emplace(std::move(out));
+                operands->push_reference<checked>(str);
+                DISPATCH();
+            }
+            TARGET(OP_WRITE) {
+                // Pop the string reference
+                std::string_view str = operands->pop_reference<checked>().get_string_view();
+                // Pop the file descriptor
+                int fd = static_cast<int>(operands->pop_int<checked>());
+
+                // Write the string to the file
+                if (write_all(fd, str.data(), str.length()) == -1) {
+                    close(fd);
+                    throw RuntimeException("Cannot write in fd " + std::to_string(fd) + ": " + strerror(errno));
+                }
+                close(fd);
+                DISPATCH();
+            }
+            TARGET(OP_EXIT) {
+                // Pop the exit code
+                char exit_code = operands->pop_byte<checked>();
+                exit(static_cast<int>(exit_code));
+            }
+            TARGET(OP_REF_GET_BYTE) {
+                char value = (char &)operands->pop_reference<checked>();
+                operands->push_byte<checked>(value);
+                DISPATCH();
+            }
+            TARGET(OP_REF_SET_BYTE) {
+                char &value = (char &)operands->pop_reference<checked>();
+                value = operands->pop_byte<checked>();
+                DISPATCH();
+            }
+            TARGET(OP_REF_GET_Q_WORD) {
+                int64_t value = (int64_t &)operands->pop_reference<checked>();
+                operands->push_int<checked>(value);
+                DISPATCH();
+            }
+            TARGET(OP_REF_SET_Q_WORD) {
+                int64_t &value = (int64_t &)operands->pop_reference<checked>();
+                value = operands->pop_int<checked>();
+                DISPATCH();
+            }
+            TARGET(OP_LOCAL_GET_BYTE) {
+                int32_t local_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+                operands->push_byte<checked>(locals->get_byte<checked>(local_index));
+                DISPATCH();
+            }
+            TARGET(OP_LOCAL_SET_BYTE) {
+                int32_t local_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+                locals->set_byte<checked>(operands->pop_byte<checked>(), local_index);
+                DISPATCH();
+            }
+            TARGET(OP_LOCAL_GET_Q_WORD) {
+                int32_t local_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+                int64_t value = locals->get_q_word<checked>(local_index);
+                operands->push_int<checked>(value);
+                DISPATCH();
+            }
+            TARGET(OP_LOCAL_SET_Q_WORD) {
+                int32_t local_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+                locals->set_q_word<checked>(operands->pop_int<checked>(), local_index);
+                DISPATCH();
+            }
+            TARGET(OP_LOCAL_REF_GET_Q_WORD) {
+                int32_t local_index = msh::read_native_endian<int32_t>(instructions + ip);
+                ip += sizeof(int32_t);
+                int64_t *ref = reinterpret_cast<int64_t *>(locals->get_q_word<checked>(local_index));
+                operands->push_int<checked>(*ref);
+                DISPATCH();
+            }
+            TARGET(OP_FETCH_BYTE) {
+                implement_fetch.template operator()<uint8_t>();
+                DISPATCH();
+            }
+            TARGET(OP_FETCH_Q_WORD) {
+                implement_fetch.template operator()<int64_t>();
+                DISPATCH();
+            }
+            TARGET(OP_STORE_BYTE) {
+                implement_store.template operator()<uint8_t>();
+                DISPATCH();
+            }
+            TARGET(OP_STORE_Q_WORD) {
+                implement_store.template operator()<int64_t>();
+                DISPATCH();
+            }
+            TARGET(OP_BYTE_TO_INT) {
+                char value = operands->pop_byte<checked>();
+                operands->push_int<checked>(value);
+                DISPATCH();
+            }
+            TARGET(OP_INT_TO_BYTE) {
+                int64_t i = operands->pop_int<checked>();
+                operands->push_byte<checked>(static_cast<int8_t>(i));
+                DISPATCH();
+            }
+            TARGET(OP_IF_NOT_JUMP)
+            TARGET(OP_IF_JUMP) {
+                char value = operands->pop_byte<checked>();
+                uint32_t then_branch = msh::read_native_endian<uint32_t>(instructions + ip);
+                // test below means "test is true if value is 1 and we are in a if-jump,
+                //                    or if value is not 1 and we are in a if-not-jump operation"
+                if (value == (opcode == OP_IF_JUMP)) {
+                    JUMP_TO(then_branch);
+                } else {
+                    // the length of branch destination
+                    ip += sizeof(uint32_t);
+                }
+                DISPATCH();
+            }
+            TARGET(OP_INT_COMPARE_IF_NOT_JUMP)
+            TARGET(OP_INT_COMPARE_IF_JUMP) {
+                Opcode comparison = static_cast<Opcode>(instructions[ip]);
+                int64_t b = operands->pop_int<checked>();
+                int64_t a = operands->pop_int<checked>();
+                if (apply_comparison(comparison, a, b) == (opcode == OP_INT_COMPARE_IF_JUMP)) {
+                    JUMP_TO(msh::read_native_endian<uint32_t>(instructions + ip + 1));
+                } else {
+                    // the length of the comparison and of the branch destination
+                    ip += sizeof(uint8_t) + sizeof(uint32_t);
+                }
+                DISPATCH();
+            }
+            TARGET(OP_JUMP) {
+                uint32_t destination = msh::read_native_endian<uint32_t>(instructions + ip);
+                JUMP_TO(destination);
+                DISPATCH();
+            }
+            TARGET(OP_DUP) {
+                operands->dup_qword<checked>();
+                DISPATCH();
+            }
+            TARGET(OP_DUP_BYTE) {
+                char value = operands->pop_byte<checked>();
+                operands->push_byte<checked>(value);
+                operands->push_byte<checked>(value);
+                DISPATCH();
+            }
+            TARGET(OP_SWAP) {
+                operands->swap_upper_qwords<checked>();
+                DISPATCH();
+            }
+            TARGET(OP_SWAP_2) {
+                operands->swap_upper_three_qwords<checked>();
+                DISPATCH();
+            }
+            TARGET(OP_POP_BYTE) {
+                operands->pop_byte<checked>();
+                DISPATCH();
+            }
+            TARGET(OP_POP_Q_WORD) {
+                operands->pop_bytes<checked>(8);
+                DISPATCH();
+            }
+            TARGET(OP_BYTE_XOR) {
+                char a = operands->pop_byte<checked>();
+                char b = operands->pop_byte<checked>();
+                operands->push_byte<checked>(a ^ b);
+                DISPATCH();
+            }
+            TARGET(OP_INT_ADD)
+            TARGET(OP_INT_SUB)
+            TARGET(OP_INT_MUL)
+            TARGET(OP_INT_DIV)
+            TARGET(OP_INT_MOD) {
+                int64_t b = operands->pop_int<checked>();
+                int64_t a = operands->pop_int<checked>();
+                int64_t res = apply_arithmetic(opcode, a, b);
+                operands->push_int<checked>(res);
+                DISPATCH();
+            }
+            TARGET(OP_INT_ADD_CONST) {
+                int64_t b = msh::read_native_endian<int64_t>(instructions + ip);
+                ip += sizeof(int64_t);
+                int64_t a = operands->pop_int<checked>();
+                operands->push_int<checked>(a + b);
+                DISPATCH();
             }
+            TARGET(OP_INT_NEG) {
+                int64_t a = operands->pop_int<checked>();
+                operands->push_int<checked>(-a);
+                DISPATCH();
+            }
+            TARGET(OP_FLOAT_ADD)
+            TARGET(OP_FLOAT_SUB)
+            TARGET(OP_FLOAT_MUL)
+            TARGET(OP_FLOAT_DIV) {
+                double b = operands->pop_double<checked>();
+                double a = operands->pop_double<checked>();
+                double res = apply_arithmetic(opcode, a, b);
+                operands->push_double<checked>(res);
+                DISPATCH();
+            }
+            TARGET(OP_FLOAT_NEG) {
+                double a = operands->pop_double<checked>();
+                operands->push_double<checked>(-a);
+                DISPATCH();
+            }
+            TARGET(OP_INT_EQ)
+            TARGET(OP_INT_LT)
+            TARGET(OP_INT_LE)
+            TARGET(OP_INT_GT)
+            TARGET(OP_INT_GE) {
+                int64_t b = operands->pop_int<checked>();
+                int64_t a = operands->pop_int<checked>();
+                char res = apply_comparison(opcode, a, b);
+                operands->push_byte<checked>(res);
+                DISPATCH();
+            }
+            TARGET(OP_FLOAT_EQ)
+            TARGET(OP_FLOAT_LT)
+            TARGET(OP_FLOAT_LE)
+            TARGET(OP_FLOAT_GT)
+            TARGET(OP_FLOAT_GE) {
+                double b = operands->pop_double<checked>();
+                double a = operands->pop_double<checked>();
+                char res = apply_comparison(opcode, a, b);
+                operands->push_byte<checked>(res);
+                DISPATCH();
+            }
+            TARGET(OP_RETURN) {
+                // the returned values are transferred to the caller once the frame is popped
+                OperandStack returned_operands = *operands;
+                int8_t returned_byte_count = frame->function.return_byte_count;
 
-            // Push the string onto the stack
-            msh::obj &str = mem.emplace(std::move(out));
-            operands.push_reference(str);
-            break;
-        }
-        case OP_WRITE: {
-            // Pop the string reference
-            const std::string &str = operands.pop_reference().get<const std::string>();
-            // Pop the file descriptor
-            int fd = static_cast<int>(operands.pop_int());
-
-            // Write the string to the file
-            if (write(fd, str.data(), str.length()) == -1) {
-                panic("Cannot write in fd " + std::to_string(fd) + ": " + strerror(errno), call_stack);
-                return frame_status::ABORT;
-            }
-            close(fd);
-            break;
-        }
-        case OP_EXIT: {
-            // Pop the exit code
-            char exit_code = operands.pop_byte();
-            exit(static_cast<int>(exit_code));
-        }
-        case OP_REF_GET_BYTE: {
-            char value = (char &)operands.pop_reference();
-            operands.push_byte(value);
-            break;
-        }
-        case OP_REF_SET_BYTE: {
-            char &value = (char &)operands.pop_reference();
-            value = operands.pop_byte();
-            break;
-        }
-        case OP_REF_GET_Q_WORD: {
-            int64_t value = (int64_t &)operands.pop_reference();
-            operands.push_int(value);
-            break;
-        }
-        case OP_REF_SET_Q_WORD: {
-            int64_t &value = (int64_t &)operands.pop_reference();
-            value = operands.pop_int();
-            break;
-        }
-        case OP_LOCAL_GET_BYTE: {
-            int32_t local_index = msh::read_big_endian<int32_t>(instructions + ip);
-            ip += sizeof(int32_t);
-            operands.push_byte(locals.get_byte(local_index));
-            break;
-        }
-        case OP_LOCAL_SET_BYTE: {
-            int32_t local_index = msh::read_big_endian<int32_t>(instructions + ip);
-            ip += sizeof(int32_t);
-            locals.set_byte(operands.pop_byte(), local_index);
-            break;
-        }
-        case OP_LOCAL_GET_Q_WORD: {
-            int32_t local_index = msh::read_big_endian<int32_t>(instructions + ip);
-            ip += sizeof(int32_t);
-            int64_t value = locals.get_q_word(local_index);
-            operands.push_int(value);
-            break;
-        }
-        case OP_LOCAL_SET_Q_WORD: {
-            int32_t local_index = msh::read_big_endian<int32_t>(instructions + ip);
-            ip += sizeof(int32_t);
-            locals.set_q_word(operands.pop_int(), local_index);
-            break;
-        }
-        case OP_FETCH_BYTE: {
-            implement_fetch.template operator()<uint8_t>();
-            break;
-        }
-        case OP_FETCH_Q_WORD: {
-            implement_fetch.template operator()<int64_t>();
-            break;
-        }
-        case OP_STORE_BYTE: {
-            implement_store.template operator()<uint8_t>();
-            break;
-        }
-        case OP_STORE_Q_WORD: {
-            implement_store.template operator()<int64_t>();
-            break;
-        }
-        case OP_BYTE_TO_INT: {
-            char value = operands.pop_byte();
-            operands.push_int(value);
-            break;
-        }
-        case OP_INT_TO_BYTE: {
-            int64_t i = operands.pop_int();
-            operands.push_byte(static_cast<int8_t>(i));
-            break;
-        }
-        case OP_IF_NOT_JUMP:
-        case OP_IF_JUMP: {
-            char value = operands.pop_byte();
-            uint32_t then_branch = msh::read_big_endian<uint32_t>(instructions + ip);
-            // test below means "test is true if value is 1 and we are in a if-jump,
-            //                    or if value is not 1 and we are in a if-not-jump operation"
-            if (value == (opcode == OP_IF_JUMP)) {
-                ip = then_branch;
-            } else {
-                // the length of branch destination
-                ip += sizeof(uint32_t);
+                call_stack.pop_frame();
+                if constexpr (profiled) {
+                    state.profiler->leave();
+                }
+                if (call_stack.is_empty()) {
+                    // the root method has returned
+                    return frame_status::RETURNED;
+                }
+                bool same_kind = enter_frame();
+                operands->transfer(returned_operands, returned_byte_count);
+                if (!same_kind) {
+                    return frame_status::SWITCHED;
+                }
+                DISPATCH();
             }
-            break;
-        }
-        case OP_JUMP: {
-            uint32_t destination = msh::read_big_endian<uint32_t>(instructions + ip);
-            ip = destination;
-            break;
-        }
-        case OP_DUP: {
-            operands.dup_qword();
-            break;
-        }
-        case OP_DUP_BYTE: {
-            char value = operands.pop_byte();
-            operands.push_byte(value);
-            operands.push_byte(value);
-            break;
-        }
-        case OP_SWAP: {
-            operands.swap_upper_qwords();
-            break;
-        }
-        case OP_SWAP_2: {
-            operands.swap_upper_three_qwords();
-            break;
-        }
-        case OP_POP_BYTE: {
-            operands.pop_byte();
-            break;
-        }
-        case OP_POP_Q_WORD: {
-            operands.pop_bytes(8);
-            break;
-        }
-        case OP_BYTE_XOR: {
-            char a = operands.pop_byte();
-            char b = operands.pop_byte();
-            operands.push_byte(a ^ b);
-            break;
-        }
-        case OP_INT_ADD:
-        case OP_INT_SUB:
-        case OP_INT_MUL:
-        case OP_INT_DIV:
-        case OP_INT_MOD: {
-            int64_t b = operands.pop_int();
-            int64_t a = operands.pop_int();
-            int64_t res = apply_arithmetic(opcode, a, b);
-            operands.push_int(res);
-            break;
-        }
-        case OP_INT_NEG: {
-            int64_t a = operands.pop_int();
-            operands.push_int(-a);
-            break;
-        }
-        case OP_FLOAT_ADD:
-        case OP_FLOAT_SUB:
-        case OP_FLOAT_MUL:
-        case OP_FLOAT_DIV: {
-            double b = operands.pop_double();
-            double a = operands.pop_double();
-            double res = apply_arithmetic(opcode, a, b);
-            operands.push_double(res);
-            break;
-        }
-        case OP_FLOAT_NEG: {
-            double a = operands.pop_double();
-            operands.push_double(-a);
-            break;
-        }
-        case OP_INT_EQ:
-        case OP_INT_LT:
-        case OP_INT_LE:
-        case OP_INT_GT:
-        case OP_INT_GE: {
-            int64_t b = operands.pop_int();
-            int64_t a = operands.pop_int();
-            char res = apply_comparison(opcode, a, b);
-            operands.push_byte(res);
-            break;
-        }
-        case OP_FLOAT_EQ:
-        case OP_FLOAT_LT:
-        case OP_FLOAT_LE:
-        case OP_FLOAT_GT:
-        case OP_FLOAT_GE: {
-            double b = operands.pop_double();
-            double a = operands.pop_double();
-            char res = apply_comparison(opcode, a, b);
-            operands.push_byte(res);
-            break;
-        }
-        case OP_RETURN:
-            return frame_status::RETURNED;
 
-        default: {
+            UNKNOWN_TARGET {
 #ifdef NDEBUG
 #ifdef __GNUC__
-            __builtin_unreachable();
+                __builtin_unreachable();
 #else
-            __assume(false);
+                __assume(false);
 #endif
 #else
-            throw InvalidBytecodeError("Unknown opcode " + std::to_string(opcode));
+                throw InvalidBytecodeError("Unknown opcode " + std::to_string(opcode));
+#endif
+            }
+#ifndef MOSHELL_COMPUTED_GOTO
+            }
 #endif
         }
+    } catch (...) {
+        // keep track of where the current frame did stop, for the panic stack trace
+        if (!call_stack.is_empty()) {
+            call_stack.peek_frame().instruction_pointer = ip;
         }
+        throw;
     }
-    return frame_status::RETURNED; // this frame has returned
+
+#undef TARGET
+#undef DISPATCH
+#undef UNKNOWN_TARGET
+#undef ENTER_NATIVE_CODE
+#undef JUMP_TO
 }
 
-bool run_unit(CallStack &call_stack, const msh::loader &loader, msh::pager &pager, const msh::memory_page &current_page, runtime_memory mem, const natives_functions_t &natives, pid_t pgid) {
+#ifdef MOSHELL_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+/**
+ * Will run the frames of the call stack until the root frame returns,
+ * switching between the interpreters of verified and unverified frames.
+ * @return the status of the root frame
+ */
+template <bool profiled>
+frame_status run_all_frames(runtime_state &state, CallStack &call_stack, runtime_memory &mem) {
+    frame_status status;
+    do {
+        if (call_stack.peek_frame().function.verified) {
+            status = run_frames<true, profiled>(state, call_stack, mem);
+        } else {
+            status = run_frames<false, profiled>(state, call_stack, mem);
+        }
+    } while (status == frame_status::SWITCHED);
+    return status;
+}
+
+bool run_unit(CallStack &call_stack, const msh::loader &loader, msh::pager &pager, const msh::memory_page &current_page, runtime_memory mem, const natives_functions_t &natives, pid_t pgid, msh::profiler *profiler, msh::jit *jit) {
     fd_table table;
-    runtime_state state{table, loader, pager, natives, pgid};
+    runtime_state state{table, loader, pager, natives, pgid, profiler, jit};
 
     // prepare the call stack, containing the given root function on top of the stack
     const function_definition &root_def = loader.get_function(current_page.init_function_name);
     call_stack.push_frame(root_def);
 
+    bool returned = false;
     try {
-        while (!call_stack.is_empty()) {
-            stack_frame &current_frame = call_stack.peek_frame();
-            const function_definition &current_def = current_frame.function;
-
-            const std::byte *instructions = loader.get_instructions(current_def.instructions_start);
-            frame_status status = run_frame(state, current_frame, call_stack, instructions, current_def.instruction_count, mem);
-
-            switch (status) {
-            case frame_status::RETURNED: {
-                int8_t returned_byte_count = current_def.return_byte_count;
-
-                // pop the current frame.
-                call_stack.pop_frame();
-
-                if (call_stack.is_empty()) {
-                    // the root method has returned
-                    break;
-                }
-                stack_frame &caller_frame = call_stack.peek_frame();
-                caller_frame.operands.transfer(current_frame.operands, returned_byte_count);
-                break;
-            }
-            case frame_status::ABORT: {
-                return false;
-            }
-            case frame_status::NEW_FRAME: {
-                // continue
-            }
-            }
+        if (profiler != nullptr) {
+            profiler->enter_function(root_def);
+            returned = run_all_frames<true>(state, call_stack, mem) == frame_status::RETURNED;
+        } else {
+            returned = run_all_frames<false>(state, call_stack, mem) == frame_status::RETURNED;
         }
-        return true;
     } catch (const VirtualMachineError &e) {
         panic("An unexpected Virtual Machine Error occurred.\n" + std::string(e.name()) + " : " + e.what(), call_stack);
     } catch (const RuntimeException &e) {
@@ -988,5 +1424,8 @@ bool run_unit(CallStack &call_stack, const msh::loader &loader, msh::pager &page
     } catch (const std::exception &e) {
         panic("An unexpected internal error occurred.\nwhat : " + std::string(e.what()), call_stack);
     }
-    return false;
+    if (profiler != nullptr) {
+        profiler->leave_all();
+    }
+    return returned;
 }
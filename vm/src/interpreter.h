@@ -1,13 +1,15 @@
 #pragma once
 
 #include "memory/call_stack.h"
+#include "memory/gc.h"
 #include "memory/heap.h"
 #include "stdlib_natives.h"
 
 namespace msh {
     class loader;
     class pager;
-    class gc;
+    class profiler;
+    class jit;
     struct memory_page;
 }
 
@@ -16,8 +18,6 @@ class runtime_memory {
     msh::gc &gc;
     std::vector<std::string> &pargs;
 
-    size_t last_gc_heap_size;
-
 public:
     runtime_memory(msh::heap &heap, std::vector<std::string> &program_arguments, msh::gc &gc);
 
@@ -25,7 +25,33 @@ public:
 
     std::vector<std::string> &program_arguments();
 
-    msh::obj &emplace(msh::obj_data &&data);
+    /**
+     * Allocates a new object in the heap, running a garbage collection
+     * or a slice of the pending incremental sweep beforehand if needed.
+     * @param value the value of the object, that the object is directly constructed from
+     */
+    template <typename T>
+    msh::obj &emplace(T &&value) {
+        if (gc.should_run())
+            gc.run_minor();
+        else if (gc.is_sweeping())
+            gc.sweep_slice();
+        return heap.insert(std::forward<T>(value));
+    }
+
+    /**
+     * Must be called after writing a reference into the given object
+     */
+    void write_barrier(msh::obj &container) {
+        heap.write_barrier(container);
+    }
+
+    /**
+     * Must be called after writing `ref` at the given index of the given vector object
+     */
+    void write_barrier(msh::obj &vec, size_t index, const msh::obj &ref) {
+        heap.write_barrier(vec, index, ref);
+    }
 };
 
 /**
@@ -40,7 +66,9 @@ public:
 
 /**
  * Will run given bytecode's main method.
+ * @param profiler the profiler that records the execution, or null to run it without profiling
+ * @param jit the compiler of the hot functions, or null to only interpret them
  * @throws InvalidBytecodeError if an interpreted instruction set contains invalid instructions
  * @return true if the run did not abort
  */
-bool run_unit(CallStack &call_stack, const msh::loader &loader, msh::pager &pager, const msh::memory_page &current_page, runtime_memory mem, const natives_functions_t &natives, pid_t pgid = 0);
+bool run_unit(CallStack &call_stack, const msh::loader &loader, msh::pager &pager, const msh::memory_page &current_page, runtime_memory mem, const natives_functions_t &natives, pid_t pgid = 0, msh::profiler *profiler = nullptr, msh::jit *jit = nullptr);
@@ -0,0 +1,476 @@
+#include "jit.h"
+
+#include "conversions.h"
+#include "memory/constant_pool.h"
+#include "opcode.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace msh {
+    native_code::native_code(void *memory, size_t size, std::vector<int32_t> offsets)
+        : memory{memory}, size{size}, offsets{std::move(offsets)} {}
+
+    native_code::~native_code() {
+        munmap(memory, size);
+    }
+
+    /**
+     * Reads the compilation threshold from the `MOSHELL_JIT_THRESHOLD` environment variable.
+     */
+    static uint32_t read_threshold() {
+        const char *env_val = getenv("MOSHELL_JIT_THRESHOLD");
+        if (env_val == nullptr) {
+            return jit::DEFAULT_THRESHOLD;
+        }
+        char *end;
+        long value = strtol(env_val, &end, 10);
+        if (*env_val == '\0' || *end != '\0' || value < 1 || value >= UINT32_MAX) {
+            std::cerr << "ignoring invalid MOSHELL_JIT_THRESHOLD value " << env_val << std::endl;
+            return jit::DEFAULT_THRESHOLD;
+        }
+        return static_cast<uint32_t>(value);
+    }
+
+    jit::jit() : threshold{read_threshold()} {}
+
+    /**
+     * Tests whether the instruction never handles an object reference, once its function is known to be reference free.
+     */
+    static bool is_reference_free(Opcode opcode) {
+        switch (opcode) {
+        case OP_PUSH_INT:
+        case OP_PUSH_BYTE:
+        case OP_PUSH_FLOAT:
+        case OP_LOCAL_GET_BYTE:
+        case OP_LOCAL_SET_BYTE:
+        case OP_LOCAL_GET_Q_WORD:
+        case OP_LOCAL_SET_Q_WORD:
+        case OP_DUP:
+        case OP_DUP_BYTE:
+        case OP_SWAP:
+        case OP_SWAP_2:
+        case OP_POP_BYTE:
+        case OP_POP_Q_WORD:
+        case OP_IF_JUMP:
+        case OP_IF_NOT_JUMP:
+        case OP_JUMP:
+        case OP_RETURN:
+        case OP_BYTE_TO_INT:
+        case OP_INT_TO_BYTE:
+        case OP_BYTE_XOR:
+        case OP_INT_ADD:
+        case OP_INT_SUB:
+        case OP_INT_MUL:
+        case OP_INT_DIV:
+        case OP_INT_MOD:
+        case OP_INT_NEG:
+        case OP_FLOAT_ADD:
+        case OP_FLOAT_SUB:
+        case OP_FLOAT_MUL:
+        case OP_FLOAT_DIV:
+        case OP_FLOAT_NEG:
+        case OP_INT_EQ:
+        case OP_INT_LT:
+        case OP_INT_LE:
+        case OP_INT_GT:
+        case OP_INT_GE:
+        case OP_FLOAT_EQ:
+        case OP_FLOAT_LT:
+        case OP_FLOAT_LE:
+        case OP_FLOAT_GT:
+        case OP_FLOAT_GE:
+        case OP_INT_ADD_CONST:
+        case OP_INT_COMPARE_IF_JUMP:
+        case OP_INT_COMPARE_IF_NOT_JUMP:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * Tests whether a frame of the function may hold an object reference, in its locals or in its operands.
+     *
+     * The invoked functions are tested too, as their returned values are pushed onto the operands.
+     * A function that is already being tested is assumed to be reference free.
+     */
+    static bool may_hold_references(const function_definition &function, pager &pager, std::unordered_set<const function_definition *> &visited) {
+        if (!function.verified || !function.obj_ref_offsets.empty()) {
+            return true;
+        }
+        if (!visited.insert(&function).second) {
+            return false;
+        }
+        const call_target *call_targets = pager.get_call_targets(function.constant_pool_index);
+        size_t ip = 0;
+        while (ip < function.instruction_count) {
+            Opcode opcode = static_cast<Opcode>(function.instructions[ip]);
+            if (opcode == OP_INVOKE || opcode == OP_TAIL_INVOKE) {
+                // the natives may return references
+                const call_target &target = call_targets[read_native_endian<constant_index>(function.instructions + ip + 1)];
+                if (target.function == nullptr || may_hold_references(*target.function, pager, visited)) {
+                    return true;
+                }
+            } else if (!is_reference_free(opcode)) {
+                return true;
+            }
+            ip += 1 + opcode_operands_size(opcode);
+        }
+        return false;
+    }
+
+    /**
+     * Writes the x86-64 machine code of a function.
+     *
+     * The code keeps the address of the operand stack top in rdi and the address of the locals in rsi,
+     * the operands and locals stay in the frame so that the interpreter can resume at any instruction.
+     */
+    class assembler {
+        std::vector<uint8_t> code;
+
+    public:
+        /**
+         * The size of the code written by `exit`.
+         */
+        static constexpr uint8_t EXIT_SIZE = 9;
+
+        size_t position() const {
+            return code.size();
+        }
+
+        const std::vector<uint8_t> &get_code() const {
+            return code;
+        }
+
+        void bytes(std::initializer_list<uint8_t> bytes) {
+            code.insert(code.end(), bytes);
+        }
+
+        void imm32(int32_t value) {
+            uint8_t bytes[sizeof(value)];
+            std::memcpy(bytes, &value, sizeof(value));
+            code.insert(code.end(), bytes, bytes + sizeof(value));
+        }
+
+        void imm64(int64_t value) {
+            uint8_t bytes[sizeof(value)];
+            std::memcpy(bytes, &value, sizeof(value));
+            code.insert(code.end(), bytes, bytes + sizeof(value));
+        }
+
+        void patch32(size_t at, int32_t value) {
+            std::memcpy(code.data() + at, &value, sizeof(value));
+        }
+
+        // add rdi, n
+        void grow(uint8_t n) {
+            bytes({0x48, 0x83, 0xC7, n});
+        }
+
+        // sub rdi, n
+        void shrink(uint8_t n) {
+            bytes({0x48, 0x83, 0xEF, n});
+        }
+
+        // mov rax, value; mov [rdi], rax; add rdi, 8
+        void push_q_word(int64_t value) {
+            bytes({0x48, 0xB8});
+            imm64(value);
+            bytes({0x48, 0x89, 0x07});
+            grow(8);
+        }
+
+        // mov rax, rdi; mov edx, ip; ret
+        void exit(size_t ip) {
+            bytes({0x48, 0x89, 0xF8, 0xBA});
+            imm32(static_cast<int32_t>(ip));
+            bytes({0xC3});
+        }
+    };
+
+    /**
+     * @return the condition code of the x86-64 conditional instructions for the given int comparison,
+     *         or 0 if the opcode is not an int comparison
+     */
+    static uint8_t int_condition(Opcode comparison, bool negated) {
+        switch (comparison) {
+        case OP_INT_EQ:
+            return negated ? 0x5 : 0x4;
+        case OP_INT_LT:
+            return negated ? 0xD : 0xC;
+        case OP_INT_LE:
+            return negated ? 0xF : 0xE;
+        case OP_INT_GT:
+            return negated ? 0xE : 0xF;
+        case OP_INT_GE:
+            return negated ? 0xC : 0xD;
+        default:
+            return 0;
+        }
+    }
+
+    const native_code *jit::compile(const function_definition &function, pager &pager) {
+        std::unordered_set<const function_definition *> visited;
+        if (may_hold_references(function, pager, visited)) {
+            return nullptr;
+        }
+
+        const std::byte *instructions = function.instructions;
+        size_t instruction_count = function.instruction_count;
+        std::vector<int32_t> offsets(instruction_count + 1, -1);
+        // the position of each jump offset in the code, with the destination instruction
+        std::vector<std::pair<size_t, uint32_t>> jumps;
+
+        assembler a;
+        // jmp rdx, to the entry instruction
+        a.bytes({0xFF, 0xE2});
+        auto jump = [&](std::initializer_list<uint8_t> opcode, uint32_t destination) {
+            a.bytes(opcode);
+            jumps.emplace_back(a.position(), destination);
+            a.imm32(0);
+        };
+
+        size_t ip = 0;
+        while (ip < instruction_count) {
+            offsets[ip] = static_cast<int32_t>(a.position());
+            Opcode opcode = static_cast<Opcode>(instructions[ip]);
+            const std::byte *operand = instructions + ip + 1;
+            switch (opcode) {
+            case OP_PUSH_INT:
+            case OP_PUSH_FLOAT:
+                a.push_q_word(read_native_endian<int64_t>(operand));
+                break;
+            case OP_PUSH_BYTE:
+                // mov byte [rdi], value
+                a.bytes({0xC6, 0x07, static_cast<uint8_t>(*operand)});
+                a.grow(1);
+                break;
+            case OP_LOCAL_GET_BYTE:
+                // mov al, [rsi + index]; mov [rdi], al
+                a.bytes({0x8A, 0x86});
+                a.imm32(read_native_endian<int32_t>(operand));
+                a.bytes({0x88, 0x07});
+                a.grow(1);
+                break;
+            case OP_LOCAL_SET_BYTE:
+                // mov al, [rdi - 1]; mov [rsi + index], al
+                a.bytes({0x8A, 0x47, 0xFF, 0x88, 0x86});
+                a.imm32(read_native_endian<int32_t>(operand));
+                a.shrink(1);
+                break;
+            case OP_LOCAL_GET_Q_WORD:
+                // mov rax, [rsi + index]; mov [rdi], rax
+                a.bytes({0x48, 0x8B, 0x86});
+                a.imm32(read_native_endian<int32_t>(operand));
+                a.bytes({0x48, 0x89, 0x07});
+                a.grow(8);
+                break;
+            case OP_LOCAL_SET_Q_WORD:
+                // mov rax, [rdi - 8]; mov [rsi + index], rax
+                a.bytes({0x48, 0x8B, 0x47, 0xF8, 0x48, 0x89, 0x86});
+                a.imm32(read_native_endian<int32_t>(operand));
+                a.shrink(8);
+                break;
+            case OP_DUP:
+                // mov rax, [rdi - 8]; mov [rdi], rax
+                a.bytes({0x48, 0x8B, 0x47, 0xF8, 0x48, 0x89, 0x07});
+                a.grow(8);
+                break;
+            case OP_DUP_BYTE:
+                // mov al, [rdi - 1]; mov [rdi], al
+                a.bytes({0x8A, 0x47, 0xFF, 0x88, 0x07});
+                a.grow(1);
+                break;
+            case OP_SWAP:
+                // mov rax, [rdi - 8]; mov rcx, [rdi - 16]; mov [rdi - 16], rax; mov [rdi - 8], rcx
+                a.bytes({0x48, 0x8B, 0x47, 0xF8, 0x48, 0x8B, 0x4F, 0xF0, 0x48, 0x89, 0x47, 0xF0, 0x48, 0x89, 0x4F, 0xF8});
+                break;
+            case OP_SWAP_2:
+                // the third quad-word goes on top, above the former top and second
+                // mov rax, [rdi - 8]; mov rcx, [rdi - 16]; mov rdx, [rdi - 24]
+                a.bytes({0x48, 0x8B, 0x47, 0xF8, 0x48, 0x8B, 0x4F, 0xF0, 0x48, 0x8B, 0x57, 0xE8});
+                // mov [rdi - 24], rcx; mov [rdi - 16], rax; mov [rdi - 8], rdx
+                a.bytes({0x48, 0x89, 0x4F, 0xE8, 0x48, 0x89, 0x47, 0xF0, 0x48, 0x89, 0x57, 0xF8});
+                break;
+            case OP_POP_BYTE:
+                a.shrink(1);
+                break;
+            case OP_POP_Q_WORD:
+                a.shrink(8);
+                break;
+            case OP_IF_JUMP:
+            case OP_IF_NOT_JUMP:
+                // cmp byte [rdi], 1 (or 0); je destination
+                a.shrink(1);
+                a.bytes({0x80, 0x3F, static_cast<uint8_t>(opcode == OP_IF_JUMP)});
+                jump({0x0F, 0x84}, read_native_endian<uint32_t>(operand));
+                break;
+            case OP_JUMP:
+                jump({0xE9}, read_native_endian<uint32_t>(operand));
+                break;
+            case OP_INT_COMPARE_IF_JUMP:
+            case OP_INT_COMPARE_IF_NOT_JUMP: {
+                uint8_t condition = int_condition(static_cast<Opcode>(*operand), opcode == OP_INT_COMPARE_IF_NOT_JUMP);
+                if (condition == 0) {
+                    return nullptr;
+                }
+                // mov rax, [rdi - 8]; sub rdi, 16; cmp [rdi], rax; jcc destination
+                a.bytes({0x48, 0x8B, 0x47, 0xF8});
+                a.shrink(16);
+                a.bytes({0x48, 0x39, 0x07});
+                jump({0x0F, static_cast<uint8_t>(0x80 | condition)}, read_native_endian<uint32_t>(operand + 1));
+                break;
+            }
+            case OP_BYTE_TO_INT:
+                // movsx rax, byte [rdi - 1]; mov [rdi - 1], rax
+                a.bytes({0x48, 0x0F, 0xBE, 0x47, 0xFF, 0x48, 0x89, 0x47, 0xFF});
+                a.grow(7);
+                break;
+            case OP_INT_TO_BYTE:
+                // the low byte of the int stays in place
+                a.shrink(7);
+                break;
+            case OP_BYTE_XOR:
+                // mov al, [rdi - 1]; xor [rdi - 2], al
+                a.bytes({0x8A, 0x47, 0xFF, 0x30, 0x47, 0xFE});
+                a.shrink(1);
+                break;
+            case OP_INT_ADD:
+                // mov rax, [rdi - 8]; add [rdi - 16], rax
+                a.bytes({0x48, 0x8B, 0x47, 0xF8, 0x48, 0x01, 0x47, 0xF0});
+                a.shrink(8);
+                break;
+            case OP_INT_SUB:
+                // mov rax, [rdi - 8]; sub [rdi - 16], rax
+                a.bytes({0x48, 0x8B, 0x47, 0xF8, 0x48, 0x29, 0x47, 0xF0});
+                a.shrink(8);
+                break;
+            case OP_INT_MUL:
+                // mov rax, [rdi - 16]; imul rax, [rdi - 8]; mov [rdi - 16], rax
+                a.bytes({0x48, 0x8B, 0x47, 0xF0, 0x48, 0x0F, 0xAF, 0x47, 0xF8, 0x48, 0x89, 0x47, 0xF0});
+                a.shrink(8);
+                break;
+            case OP_INT_DIV:
+            case OP_INT_MOD:
+                // mov rcx, [rdi - 8]; lea rax, [rcx + 1]; cmp rax, 1; ja over the exit
+                a.bytes({0x48, 0x8B, 0x4F, 0xF8, 0x48, 0x8D, 0x41, 0x01, 0x48, 0x83, 0xF8, 0x01, 0x77, assembler::EXIT_SIZE});
+                // the interpreter divides by 0, that throws, and by -1, that may overflow
+                a.exit(ip);
+                // mov rax, [rdi - 16]; cqo; idiv rcx; mov [rdi - 16], rax (or rdx)
+                a.bytes({0x48, 0x8B, 0x47, 0xF0, 0x48, 0x99, 0x48, 0xF7, 0xF9});
+                a.bytes({0x48, 0x89, static_cast<uint8_t>(opcode == OP_INT_DIV ? 0x47 : 0x57), 0xF0});
+                a.shrink(8);
+                break;
+            case OP_INT_ADD_CONST: {
+                int64_t value = read_native_endian<int64_t>(operand);
+                if (value >= INT32_MIN && value <= INT32_MAX) {
+                    // add qword [rdi - 8], value
+                    a.bytes({0x48, 0x81, 0x47, 0xF8});
+                    a.imm32(static_cast<int32_t>(value));
+                } else {
+                    // mov rax, value; add [rdi - 8], rax
+                    a.bytes({0x48, 0xB8});
+                    a.imm64(value);
+                    a.bytes({0x48, 0x01, 0x47, 0xF8});
+                }
+                break;
+            }
+            case OP_INT_NEG:
+                // neg qword [rdi - 8]
+                a.bytes({0x48, 0xF7, 0x5F, 0xF8});
+                break;
+            case OP_FLOAT_ADD:
+            case OP_FLOAT_SUB:
+            case OP_FLOAT_MUL: {
+                uint8_t operation = opcode == OP_FLOAT_ADD ? 0x58 : opcode == OP_FLOAT_SUB ? 0x5C : 0x59;
+                // movsd xmm0, [rdi - 16]; addsd (or subsd, mulsd) xmm0, [rdi - 8]; movsd [rdi - 16], xmm0
+                a.bytes({0xF2, 0x0F, 0x10, 0x47, 0xF0, 0xF2, 0x0F, operation, 0x47, 0xF8, 0xF2, 0x0F, 0x11, 0x47, 0xF0});
+                a.shrink(8);
+                break;
+            }
+            case OP_FLOAT_DIV:
+                // xorpd xmm0, xmm0; ucomisd xmm0, [rdi - 8]; jp and jne over the exit
+                a.bytes({0x66, 0x0F, 0x57, 0xC0, 0x66, 0x0F, 0x2E, 0x47, 0xF8, 0x7A, assembler::EXIT_SIZE + 2, 0x75, assembler::EXIT_SIZE});
+                // the interpreter divides by 0, that throws
+                a.exit(ip);
+                // movsd xmm0, [rdi - 16]; divsd xmm0, [rdi - 8]; movsd [rdi - 16], xmm0
+                a.bytes({0xF2, 0x0F, 0x10, 0x47, 0xF0, 0xF2, 0x0F, 0x5E, 0x47, 0xF8, 0xF2, 0x0F, 0x11, 0x47, 0xF0});
+                a.shrink(8);
+                break;
+            case OP_FLOAT_NEG:
+                // mov rax, sign bit; xor [rdi - 8], rax
+                a.bytes({0x48, 0xB8});
+                a.imm64(INT64_MIN);
+                a.bytes({0x48, 0x31, 0x47, 0xF8});
+                break;
+            case OP_INT_EQ:
+            case OP_INT_LT:
+            case OP_INT_LE:
+            case OP_INT_GT:
+            case OP_INT_GE:
+                // mov rax, [rdi - 8]; cmp [rdi - 16], rax; setcc byte [rdi - 16]
+                a.bytes({0x48, 0x8B, 0x47, 0xF8, 0x48, 0x39, 0x47, 0xF0});
+                a.bytes({0x0F, static_cast<uint8_t>(0x90 | int_condition(opcode, false)), 0x47, 0xF0});
+                a.shrink(15);
+                break;
+            case OP_FLOAT_EQ:
+                // movsd xmm0, [rdi - 16]; ucomisd xmm0, [rdi - 8]; sete al; setnp cl; and al, cl; mov [rdi - 16], al
+                a.bytes({0xF2, 0x0F, 0x10, 0x47, 0xF0, 0x66, 0x0F, 0x2E, 0x47, 0xF8});
+                a.bytes({0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8, 0x88, 0x47, 0xF0});
+                a.shrink(15);
+                break;
+            case OP_FLOAT_LT:
+            case OP_FLOAT_LE:
+            case OP_FLOAT_GT:
+            case OP_FLOAT_GE: {
+                // the unordered comparisons are false, as they set the carry flag
+                bool swapped = opcode == OP_FLOAT_LT || opcode == OP_FLOAT_LE;
+                bool strict = opcode == OP_FLOAT_LT || opcode == OP_FLOAT_GT;
+                uint8_t left = swapped ? 0xF8 : 0xF0;
+                uint8_t right = swapped ? 0xF0 : 0xF8;
+                // movsd xmm0, left; ucomisd xmm0, right; seta (or setae) byte [rdi - 16]
+                a.bytes({0xF2, 0x0F, 0x10, 0x47, left, 0x66, 0x0F, 0x2E, 0x47, right});
+                a.bytes({0x0F, static_cast<uint8_t>(strict ? 0x97 : 0x93), 0x47, 0xF0});
+                a.shrink(15);
+                break;
+            }
+            default:
+                // the invocations and the returns are run by the interpreter
+                a.exit(ip);
+                break;
+            }
+            ip += 1 + opcode_operands_size(opcode);
+        }
+        // the return appended by the loader
+        offsets[instruction_count] = static_cast<int32_t>(a.position());
+        a.exit(instruction_count);
+
+        for (auto [at, destination] : jumps) {
+            if (destination > instruction_count || offsets[destination] == -1) {
+                return nullptr;
+            }
+            a.patch32(at, offsets[destination] - static_cast<int32_t>(at + sizeof(int32_t)));
+        }
+
+        const std::vector<uint8_t> &code = a.get_code();
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t size = (code.size() + page_size - 1) / page_size * page_size;
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        std::memcpy(memory, code.data(), code.size());
+        // the code is never writable and executable at the same time
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) == -1) {
+            munmap(memory, size);
+            return nullptr;
+        }
+        return codes.emplace_back(std::make_unique<native_code>(memory, size, std::move(offsets))).get();
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "definitions/function_definition.h"
+#include "definitions/pager.h"
+
+namespace msh {
+    /**
+     * Where the native code of a function has given the execution back to the interpreter.
+     */
+    struct jit_exit {
+        /**
+         * the address of the byte following the top of the operand stack
+         */
+        std::byte *top;
+
+        /**
+         * the instruction that the interpreter runs next
+         */
+        size_t ip;
+    };
+
+    /**
+     * The native code of a function, that runs its instructions directly on its frame's operands and locals.
+     *
+     * The code runs until it reaches an instruction that it leaves to the interpreter,
+     * such as an invocation, a return or a division by zero.
+     */
+    class native_code {
+        using entry_t = jit_exit (*)(std::byte *top, std::byte *locals, const void *entry);
+
+        void *memory;
+        size_t size;
+
+        /**
+         * the offset in the code of each instruction, or -1 if there is no instruction at this position
+         */
+        std::vector<int32_t> offsets;
+
+    public:
+        native_code(void *memory, size_t size, std::vector<int32_t> offsets);
+
+        native_code(const native_code &) = delete;
+        native_code &operator=(const native_code &) = delete;
+
+        ~native_code();
+
+        /**
+         * Runs the code from the given instruction.
+         *
+         * @param top The address of the byte following the top of the frame's operand stack.
+         * @param locals The address of the frame's locals.
+         * @param ip The instruction to start from, that is either the first instruction or a jump destination.
+         * @return Where the interpreter resumes.
+         */
+        jit_exit run(std::byte *top, std::byte *locals, size_t ip) const {
+            const std::byte *code = static_cast<const std::byte *>(memory);
+            return reinterpret_cast<entry_t>(memory)(top, locals, code + offsets[ip]);
+        }
+    };
+
+    /**
+     * Compiles the hot functions to native code.
+     *
+     * The interpreter counts the entries and the backward jumps of each verified function,
+     * and asks for its native code once the count reaches the threshold.
+     * Only the functions that never hold an object reference in their frame are compiled,
+     * so that their native code does not have to track the references of the operand stack for the garbage collector.
+     */
+    class jit {
+        std::vector<std::unique_ptr<native_code>> codes;
+
+        uint32_t threshold;
+
+    public:
+        /**
+         * The default number of entries and backward jumps after which a function is compiled.
+         */
+        static constexpr uint32_t DEFAULT_THRESHOLD = 1000;
+
+        /**
+         * Creates a compiler whose threshold is read from the `MOSHELL_JIT_THRESHOLD` environment variable.
+         */
+        jit();
+
+        uint32_t get_threshold() const {
+            return threshold;
+        }
+
+        /**
+         * Compiles the given function.
+         *
+         * @param function The verified function to compile.
+         * @param pager The pager where the invocations of the function are bound.
+         * @return The native code of the function, that lives as long as this compiler,
+         *         or null if the function cannot be compiled.
+         */
+        const native_code *compile(const function_definition &function, pager &pager);
+    };
+}
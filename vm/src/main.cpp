@@ -1,6 +1,5 @@
 #include "vm.h"
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <vector>
 
@@ -9,13 +8,6 @@ int main(int argc, const char *argv[]) {
         std::cerr << "Usage: " << argv[0] << " <filename>\n";
         return 1;
     }
-    std::ifstream input(argv[1], std::ios::binary);
-    if (!input) {
-        std::cerr << "Could not open file " << argv[1] << " (" << strerror(errno) << ")\n";
-        return 1;
-    }
-    std::vector<char> bytes_vec(std::istreambuf_iterator<char>(input), {});
-    const char *bytes = bytes_vec.data();
 
     std::vector<size_t> lens;
     lens.resize(argc);
@@ -24,7 +16,10 @@ int main(int argc, const char *argv[]) {
     }
     moshell_vm vm = moshell_vm_init(argv, argc, lens.data());
 
-    moshell_vm_register(vm, bytes, bytes_vec.size());
+    if (moshell_vm_register_file(vm, argv[1]) == -1) {
+        moshell_vm_free(vm);
+        return 1;
+    }
     int exit = moshell_vm_run(vm);
     moshell_vm_free(vm);
 
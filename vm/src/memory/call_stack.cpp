@@ -3,21 +3,38 @@
 #include <cstring>
 
 CallStack::CallStack(size_t capacity)
-    : tape(capacity), operands_refs_offsets(capacity, false) {}
+    : tape(capacity), operands_refs_offsets(capacity) {}
 
 void CallStack::push_frame(const function_definition &callee) {
-    size_t values_start = callee.locals_size;
     size_t locals_start = 0;
     if (!blocks.empty()) {
         stack_frame &caller = blocks.back();
         caller.operands.pop_bytes(callee.parameters_byte_count);
         locals_start = caller.operands.size();
-        values_start = locals_start + callee.locals_size;
     }
-    if (values_start > tape.size() || blocks.size() > tape.size()) {
+    place_frame(callee, locals_start);
+}
+
+void CallStack::replace_frame(const function_definition &callee) {
+    // the replaced frame's locals started right after its caller's operands
+    size_t locals_start = blocks.size() > 1 ? blocks[blocks.size() - 2].operands.size() : 0;
+    const std::byte *parameters = blocks.back().operands.pop_bytes(callee.parameters_byte_count);
+
+    // the locals are not tracked in the operands references, they are known from the callee definition
+    std::memmove(tape.data() + locals_start, parameters, callee.parameters_byte_count);
+    blocks.pop_back();
+    place_frame(callee, locals_start);
+}
+
+void CallStack::place_frame(const function_definition &callee, size_t locals_start) {
+    size_t values_start = locals_start + callee.locals_size;
+    // the operands of a verified function are not checked when pushed, their maximum size must fit in the stack
+    size_t values_end = values_start + (callee.verified ? callee.max_stack_size : 0);
+    // the frames themselves are bounded by the capacity, for the functions that do not use the tape
+    if (values_end > tape.size() || blocks.size() >= tape.size() / sizeof(stack_frame)) {
         throw StackOverflowError("exceeded stack capacity via operand stack");
     }
-    std::fill(operands_refs_offsets.begin() + locals_start, operands_refs_offsets.begin() + values_start, false);
+    operands_refs_offsets.clear(locals_start, values_start);
 
     // zeroing non-parameter locals
     memset(tape.data() + locals_start + callee.parameters_byte_count, 0, callee.locals_size - callee.parameters_byte_count);
@@ -42,8 +59,11 @@ bool CallStack::is_empty() const {
 }
 
 void CallStack::clear() {
+    // the bits above the top of the stack are cleared when reached again
+    if (!blocks.empty()) {
+        operands_refs_offsets.clear(0, blocks.back().operands.size());
+    }
     blocks.clear();
-    std::fill(operands_refs_offsets.begin(), operands_refs_offsets.end(), false);
 }
 
 std::vector<stack_frame>::iterator CallStack::begin() {
@@ -6,6 +6,7 @@
 #include "definitions/function_definition.h"
 #include "memory/locals.h"
 #include "memory/operand_stack.h"
+#include "memory/reserved_memory.h"
 
 /**
  * The information about a stack frame.
@@ -19,26 +20,50 @@ struct stack_frame {
 };
 
 /**
- * A thread callstack, with fixed capacity
+ * A thread callstack, with fixed capacity.
+ *
+ * The tape of the locals and operands is reserved for the whole capacity, but its memory is only committed
+ * once reached by the frames, so that a deep stack does not cost anything to the shallow programs.
+ * The tape never moves, the operand stacks and locals of the frames point into it.
  */
 class CallStack {
     std::vector<stack_frame> blocks;
-    std::vector<std::byte> tape;
-    std::vector<bool> operands_refs_offsets;
+    ReservedMemory tape;
+    ReferenceBitmap operands_refs_offsets;
     friend msh::gc;
 
+    /**
+     * Pushes a new frame whose locals start at the given tape position, where its parameters already are.
+     */
+    void place_frame(const function_definition &callee, size_t locals_start);
+
 public:
+    /**
+     * The default capacity in bytes of a call stack, that is the reserved size of its tape
+     */
+    static constexpr size_t DEFAULT_CAPACITY = 8 * 1024 * 1024;
+
     /**
      * creates an empty call stack
      */
-    explicit CallStack(size_t capacity);
+    explicit CallStack(size_t capacity = DEFAULT_CAPACITY);
 
     /**
      * Pushes a new frame inside this call stack.
+     * The frame of a verified function is only pushed if its operands can grow up to their maximum size.
      * @param callee the function definition of the new frame to create and push
+     * @throws StackOverflowError if the frame does not fit in the call stack
      */
     void push_frame(const function_definition &callee);
 
+    /**
+     * Replaces the last frame by a new frame of the given function, whose parameters are the last operands of the replaced frame.
+     * The new frame returns to the caller of the replaced frame, in place of it.
+     * @param callee the function definition of the new frame
+     * @throws StackOverflowError if the frame does not fit in the call stack
+     */
+    void replace_frame(const function_definition &callee);
+
     /**
      * pops last frame from the call_stack.
      * this action does not writes in the popped frame
@@ -8,7 +8,7 @@ static const msh::obj &read_string(ByteReader &reader, msh::heap &heap) {
     // Allocate the string
     std::string str(reader.read_n<char>(length), length);
 
-    return heap.insert(std::move(str));
+    return heap.intern(std::move(str));
 }
 
 ConstantPool load_constant_pool(ByteReader &reader, msh::heap &heap) {
@@ -27,13 +27,10 @@ ConstantPool::ConstantPool(uint32_t size)
     : constants{std::vector<const msh::obj *>(size)},
       size{size} {}
 
-const msh::obj &ConstantPool::get_ref(constant_index at) const {
-    if (at >= size) {
-        throw std::out_of_range("get string at index " + std::to_string(at) + " exceeds constant pool size (" + std::to_string(size) + ")");
-    }
-    return *constants[at];
-}
-
 const std::string &ConstantPool::get_string(constant_index at) const {
     return get_ref(at).get<const std::string>();
 }
+
+uint32_t ConstantPool::get_size() const {
+    return size;
+}
@@ -5,6 +5,8 @@
 #include "memory/heap.h"
 
 #include <memory>
+#include <stdexcept>
+#include <string>
 
 class ByteReader;
 
@@ -15,7 +17,7 @@ typedef uint32_t constant_index;
 
 /**
  * Contains the string constants defined in a bytecode unit.
- * As the pool isn't the owner of its strings, it contains pointers to the bound `heap` object.
+ * As the pool isn't the owner of its strings, it contains pointers to the static strings of the bound `heap`.
  */
 class ConstantPool {
     std::vector<const msh::obj *> constants;
@@ -28,8 +30,6 @@ class ConstantPool {
 
     friend ConstantPool load_constant_pool(ByteReader &reader, msh::heap &heap);
 
-    friend msh::gc;
-
 public:
     /**
      * get given string reference
@@ -39,7 +39,26 @@ public:
      */
     const std::string &get_string(constant_index at) const;
 
-    const msh::obj &get_ref(constant_index at) const;
+    /**
+     * get given constant reference
+     * @tparam checked false if the index is known to be in range
+     * @param at the constant's index to get
+     * @throws std::out_of_range if the given index is out of range
+     */
+    template <bool checked = true>
+    const msh::obj &get_ref(constant_index at) const {
+        if constexpr (checked) {
+            if (at >= size) {
+                throw std::out_of_range("get string at index " + std::to_string(at) + " exceeds constant pool size (" + std::to_string(size) + ")");
+            }
+        }
+        return *constants[at];
+    }
+
+    /**
+     * @returns the number of constants in the pool
+     */
+    uint32_t get_size() const;
 };
 
 /**
@@ -1,15 +1,109 @@
 #include "memory/gc.h"
 
-#ifndef NDEBUG
+#include <atomic>
+#include <bit>
 #include <chrono>
-#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#ifndef NDEBUG
+#include <fstream>
 #endif
 
 using namespace msh;
 
+/**
+ * Reads the growth percent from the `MOSHELL_GC_PERCENT` environment variable, in the manner of Go's GOGC.
+ * `off` disables the automatic collections.
+ */
+static int read_growth_percent() {
+    const char *env_val = getenv("MOSHELL_GC_PERCENT");
+    if (env_val == nullptr) {
+        return gc::DEFAULT_GROWTH_PERCENT;
+    }
+    if (strcmp(env_val, "off") == 0) {
+        return -1;
+    }
+    char *end;
+    long percent = strtol(env_val, &end, 10);
+    if (*env_val == '\0' || *end != '\0' || percent < 0 || percent > std::numeric_limits<int>::max()) {
+        std::cerr << "ignoring invalid MOSHELL_GC_PERCENT value " << env_val << std::endl;
+        return gc::DEFAULT_GROWTH_PERCENT;
+    }
+    return static_cast<int>(percent);
+}
+
+/**
+ * Reads a positive integer from the given environment variable.
+ * @return the fallback value if the variable is not set or is invalid
+ */
+static size_t read_size(const char *name, size_t fallback) {
+    const char *env_val = getenv(name);
+    if (env_val == nullptr) {
+        return fallback;
+    }
+    char *end;
+    long value = strtol(env_val, &end, 10);
+    if (*env_val == '\0' || *end != '\0' || value < 0) {
+        std::cerr << "ignoring invalid " << name << " value " << env_val << std::endl;
+        return fallback;
+    }
+    return static_cast<size_t>(value);
+}
+
+/**
+ * Reads the number of marking threads from the `MOSHELL_GC_THREADS` environment variable,
+ * that defaults to the number of hardware threads, up to `gc::MAX_DEFAULT_MARK_THREADS`.
+ */
+static size_t read_mark_threads() {
+    return read_size("MOSHELL_GC_THREADS", std::min<size_t>(std::thread::hardware_concurrency(), gc::MAX_DEFAULT_MARK_THREADS));
+}
+
 gc::gc(heap &heap_space, CallStack &thread_stack, const pager &pages, const loader &ldr)
-    : heap_space{heap_space}, thread_call_stack{thread_stack}, pages{pages}, ldr{ldr}, last_roots_size{0}, cycle{0} {
+    : heap_space{heap_space}, thread_call_stack{thread_stack}, pages{pages}, ldr{ldr}, last_roots_size{0},
+      growth_percent{read_growth_percent()}, mark_threads{read_mark_threads()},
+      sweep_budget{read_size("MOSHELL_GC_SWEEP_BUDGET", 0)}, swept_object_count{0}, stats{}, trace{getenv("MOSHELL_GC_TRACE") != nullptr} {
+    update_next_collection_size();
+}
+
+void gc::update_next_collection_size() {
+    if (growth_percent < 0) {
+        next_collection_size = std::numeric_limits<size_t>::max();
+        nursery_capacity = std::numeric_limits<size_t>::max();
+        return;
+    }
+    size_t live = stats.live_objects;
+    next_collection_size = std::max(MIN_COLLECTION_SIZE, live + live * growth_percent / 100);
+    nursery_capacity = NURSERY_SIZE;
+}
+
+void gc::set_growth_percent(int percent) {
+    growth_percent = percent;
+    update_next_collection_size();
+}
+
+void gc::set_mark_threads(size_t threads) {
+    mark_threads = threads;
+}
+
+void gc::set_sweep_budget(size_t objects) {
+    sweep_budget = objects;
+}
+
+void gc::record_pause(uint64_t pause_ns) {
+    stats.total_pause_ns += pause_ns;
+    stats.max_pause_ns = std::max(stats.max_pause_ns, pause_ns);
+    size_t bucket = std::bit_width(pause_ns / 1000);
+    stats.pause_histogram[std::min(bucket, gc_stats::PAUSE_BUCKETS - 1)]++;
+}
+
+const gc_stats &gc::get_stats() const {
+    return stats;
 }
 #ifndef NDEBUG
 
@@ -52,6 +146,12 @@ void debug_obj_freed(msh::obj &obj) {
             debug_file << "vector len:" << data.size();
         } else if constexpr (std::is_same_v<T, obj_struct>) {
             debug_file << "structure " << data.definition->identifier;
+        } else if constexpr (std::is_same_v<T, obj_rope>) {
+            debug_file << "rope len:" << data.length;
+        } else if constexpr (std::is_same_v<T, obj_slice>) {
+            debug_file << "slice len:" << data.length;
+        } else if constexpr (std::is_same_v<T, obj_int_vector> || std::is_same_v<T, obj_float_vector> || std::is_same_v<T, obj_byte_vector>) {
+            debug_file << "unboxed vector len:" << data.size();
         } else {
             // unreachable
             static_assert(sizeof(T) != sizeof(T), "non-exhaustive object visitor ");
@@ -74,28 +174,56 @@ void msh::disable_gc_debug() {
 
 #endif
 
-void gc::scan() {
-    cycle++;
+static void on_object_freed([[maybe_unused]] msh::obj &obj) {
+#ifndef NDEBUG
+    debug_obj_freed(obj);
+#endif
+}
 
+void gc::scan() {
     std::vector<const msh::obj *> roots;
     roots.reserve(last_roots_size);
 
-    scan_constants(roots);
+    // constants are static objects and do not reference any object
     scan_exported_vars(roots);
     scan_thread(roots);
 
     last_roots_size = roots.size();
 
-    walk_objects(std::move(roots));
+    walk_objects(std::move(roots), false);
+}
+
+void gc::scan_young() {
+    std::vector<const msh::obj *> roots;
+    roots.reserve(last_roots_size);
+
+    scan_exported_vars(roots);
+    scan_thread(roots);
+    for (const remembered_ref &ref : heap_space.get_remembered_set()) {
+        if (ref.index == remembered_ref::WHOLE_OBJECT) {
+            push_children(*ref.container, roots);
+            continue;
+        }
+        // the vector may have shrunk since, or its elements got unboxed
+        const obj_vector *vec = std::get_if<obj_vector>(&ref.container->data);
+        if (vec != nullptr && ref.index < vec->size()) {
+            roots.push_back((*vec)[ref.index]);
+        }
+    }
+
+    walk_objects(std::move(roots), true);
 }
 
 void gc::run() {
     size_t last_roots_size = this->last_roots_size;
+    auto t0 = std::chrono::steady_clock::now();
+
+    // the marks of the previous collection must all be cleared
+    finish_sweep();
 
 #ifndef NDEBUG
     gc_debug("-----------");
-    gc_debug("Running cycle " + std::to_string(cycle + 1));
-    int t0 = time(nullptr);
+    gc_debug("Running cycle " + std::to_string(stats.collections + 1));
 #endif
 
     scan();
@@ -104,61 +232,253 @@ void gc::run() {
     gc_debug(std::to_string(this->last_roots_size) + " roots found (last cycle: " + std::to_string(last_roots_size) + ")");
 #endif
 
-    size_t removed_object_count = heap_space.objects.remove_if([&](msh::obj &obj) {
-        bool detached = obj.gc_cycle != cycle;
+    if (sweep_budget != 0) {
+        // the old objects are swept by the next slices
+        swept_object_count = heap_space.begin_sweep(on_object_freed);
+
+        uint64_t pause_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        stats.collections++;
+        record_pause(pause_ns);
+
+        if (trace) {
+            std::cerr << "gc " << stats.collections << ": " << swept_object_count << " young objects freed, "
+                      << "sweeping incrementally, " << pause_ns / 1000 << "us pause" << std::endl;
+        }
+        if (!heap_space.is_sweeping()) {
+            end_sweep();
+        }
+        return;
+    }
+
+    size_t removed_object_count = heap_space.sweep(on_object_freed);
+
+    uint64_t pause_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    stats.collections++;
+    record_pause(pause_ns);
+    stats.live_objects = heap_space.size();
+    update_next_collection_size();
+
+    if (trace) {
+        std::cerr << "gc " << stats.collections << ": " << removed_object_count << " objects freed, "
+                  << stats.live_objects << " live, " << pause_ns / 1000 << "us pause" << std::endl;
+    }
+
 #ifndef NDEBUG
-        if (detached)
-            debug_obj_freed(obj);
+    gc_debug("Removed " + std::to_string(removed_object_count) + " objects.");
+    gc_debug("Cycle ended in " + std::to_string(pause_ns / 1000) + "us");
 #endif
-        return detached;
-    });
+}
 
-    this->heap_space.len -= removed_object_count;
+void gc::run_minor() {
+    auto t0 = std::chrono::steady_clock::now();
+
+    // the promoted objects would be swept as unmarked old objects
+    finish_sweep();
+
+#ifndef NDEBUG
+    gc_debug("-----------");
+    gc_debug("Running minor cycle " + std::to_string(stats.minor_collections + 1) + " over " + std::to_string(heap_space.young_size()) + " young objects");
+#endif
+
+    scan_young();
+
+    size_t removed_object_count = heap_space.sweep_nursery(on_object_freed);
+
+    uint64_t pause_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    stats.minor_collections++;
+    record_pause(pause_ns);
+
+    if (trace) {
+        std::cerr << "minor gc " << stats.minor_collections << ": " << removed_object_count << " objects freed, "
+                  << heap_space.size() << " promoted or old, " << pause_ns / 1000 << "us pause" << std::endl;
+    }
 
 #ifndef NDEBUG
-    int t1 = time(nullptr);
     gc_debug("Removed " + std::to_string(removed_object_count) + " objects.");
-    gc_debug("Cycle ended in " + std::to_string(t1 - t0) + "ms");
+    gc_debug("Cycle ended in " + std::to_string(pause_ns / 1000) + "us");
+#endif
+
+    // the promoted objects may have grown the old generation enough for a full collection
+    if (heap_space.size() >= next_collection_size) {
+        run();
+    }
+}
+
+void gc::sweep_slice() {
+    auto t0 = std::chrono::steady_clock::now();
+    swept_object_count += heap_space.sweep_step(sweep_budget, on_object_freed);
+    uint64_t pause_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    record_pause(pause_ns);
+
+    if (!heap_space.is_sweeping()) {
+        end_sweep();
+    }
+}
+
+void gc::finish_sweep() {
+    if (heap_space.is_sweeping()) {
+        swept_object_count += heap_space.sweep_step(SIZE_MAX, on_object_freed);
+        end_sweep();
+    }
+}
+
+void gc::end_sweep() {
+    stats.live_objects = heap_space.size();
+    update_next_collection_size();
+
+    if (trace) {
+        std::cerr << "gc " << stats.collections << ": swept, " << swept_object_count << " objects freed, "
+                  << stats.live_objects << " live" << std::endl;
+    }
+
+#ifndef NDEBUG
+    gc_debug("Removed " + std::to_string(swept_object_count) + " objects.");
 #endif
 }
 
 std::vector<const msh::obj *> gc::collect() {
+    finish_sweep();
     scan();
     std::vector<const msh::obj *> object_refs;
-    for (const msh::obj &obj : heap_space.objects) {
-        bool detached = obj.gc_cycle != cycle;
-        if (detached) {
+    heap_space.for_each([&](const msh::obj &obj) {
+        if (!obj.marked) {
             object_refs.push_back(&obj);
         }
-    }
+        obj.marked = false;
+    });
     return object_refs;
 }
 
-void gc::walk_objects(std::vector<const msh::obj *> to_visit) {
+void gc::push_children(const msh::obj &obj, std::vector<const msh::obj *> &to_visit) {
+    std::visit([&](auto &&obj) {
+        using T = std::decay_t<decltype(obj)>;
+        if constexpr (std::is_same_v<T, msh::obj_vector>) {
+            for (msh::obj *item : obj) {
+                to_visit.push_back(item);
+            }
+        } else if constexpr (std::is_same_v<T, msh::obj_struct>) {
+            const msh::struct_definition *def = obj.definition;
+            for (size_t obj_offset : def->obj_ref_offsets) {
+                const msh::obj *attribute_obj = *(const msh::obj **)(obj.data() + obj_offset);
+                to_visit.push_back(attribute_obj);
+            }
+        } else if constexpr (std::is_same_v<T, msh::obj_rope>) {
+            to_visit.push_back(obj.left);
+            to_visit.push_back(obj.right);
+        } else if constexpr (std::is_same_v<T, msh::obj_slice>) {
+            to_visit.push_back(obj.parent);
+        }
+    },
+               obj.data);
+}
+
+void gc::walk_objects(std::vector<const msh::obj *> to_visit, bool young_only) {
+    if (!young_only && mark_threads > 1 && heap_space.size() >= PARALLEL_MARK_MIN_SIZE) {
+        walk_objects_in_parallel(std::move(to_visit));
+        return;
+    }
+
     while (!to_visit.empty()) {
         const msh::obj *obj = to_visit.back();
         to_visit.pop_back();
 
-        // object is already marked as present in this cycle
-        if (!obj || obj->gc_cycle == cycle)
+        // object is already marked as present in this cycle,
+        // or is an old object during a minor cycle (its young children are in the remembered set)
+        if (!obj || obj->marked || (young_only && !obj->young))
             continue;
 
-        obj->gc_cycle = cycle;
-        std::visit([&](auto &&obj) {
-            using T = std::decay_t<decltype(obj)>;
-            if constexpr (std::is_same_v<T, msh::obj_vector>) {
-                for (msh::obj *item : obj) {
-                    to_visit.push_back(item);
+        obj->marked = true;
+        push_children(*obj, to_visit);
+    }
+}
+
+/**
+ * The number of objects to visit above which a marking thread shares half of them with the idle threads
+ */
+static constexpr size_t MARK_SHARE_THRESHOLD = 256;
+
+void gc::walk_objects_in_parallel(std::vector<const msh::obj *> roots) {
+    // the objects that a thread has put aside for the other threads to steal
+    struct mark_queue {
+        std::mutex lock;
+        std::deque<const msh::obj *> objects;
+    };
+
+    size_t workers = mark_threads;
+    std::vector<mark_queue> queues(workers);
+    for (size_t i = 0; i < roots.size(); i++) {
+        queues[i % workers].objects.push_back(roots[i]);
+    }
+    std::atomic<size_t> queued_count{roots.size()};
+    std::atomic<size_t> idle_count{0};
+
+    // moves the first objects of a queue to the visited objects of a thread
+    auto take = [&](mark_queue &queue, std::vector<const msh::obj *> &to_visit, bool half) {
+        std::lock_guard guard(queue.lock);
+        size_t count = half ? (queue.objects.size() + 1) / 2 : queue.objects.size();
+        if (count == 0) {
+            return false;
+        }
+        to_visit.insert(to_visit.end(), queue.objects.begin(), queue.objects.begin() + count);
+        queue.objects.erase(queue.objects.begin(), queue.objects.begin() + count);
+        queued_count -= count;
+        return true;
+    };
+
+    auto mark = [&](size_t id) {
+        std::vector<const msh::obj *> to_visit;
+        mark_queue &own = queues[id];
+        while (true) {
+            while (!to_visit.empty()) {
+                const msh::obj *obj = to_visit.back();
+                to_visit.pop_back();
+
+                // several threads may reach the same object, the first one to mark it visits its children
+                if (!obj || std::atomic_ref<bool>(obj->marked).exchange(true, std::memory_order_relaxed))
+                    continue;
+
+                push_children(*obj, to_visit);
+                if (to_visit.size() > MARK_SHARE_THRESHOLD && idle_count.load(std::memory_order_relaxed) != 0 && queued_count.load(std::memory_order_relaxed) == 0) {
+                    std::lock_guard guard(own.lock);
+                    size_t count = to_visit.size() / 2;
+                    own.objects.insert(own.objects.end(), to_visit.begin(), to_visit.begin() + count);
+                    to_visit.erase(to_visit.begin(), to_visit.begin() + count);
+                    queued_count += count;
                 }
-            } else if constexpr (std::is_same_v<T, msh::obj_struct>) {
-                const msh::struct_definition *def = obj.definition;
-                for (size_t obj_offset : def->obj_ref_offsets) {
-                    const msh::obj *attribute_obj = *(const msh::obj **)(obj.bytes.data() + obj_offset);
-                    to_visit.push_back(attribute_obj);
+            }
+
+            if (take(own, to_visit, false)) {
+                continue;
+            }
+            bool stolen = false;
+            for (size_t i = 1; i < workers && !stolen; i++) {
+                stolen = take(queues[(id + i) % workers], to_visit, true);
+            }
+            if (stolen) {
+                continue;
+            }
+
+            // the marking is over once every thread is idle with no queued object,
+            // a thread that is done stays counted as idle
+            idle_count++;
+            while (queued_count.load() == 0) {
+                if (idle_count.load() == workers) {
+                    return;
                 }
+                std::this_thread::yield();
             }
-        },
-                   obj->data);
+            idle_count--;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (size_t id = 1; id < workers; id++) {
+        threads.emplace_back(mark, id);
+    }
+    mark(0);
+    for (std::thread &thread : threads) {
+        thread.join();
     }
 }
 
@@ -179,15 +499,14 @@ void gc::scan_thread(std::vector<const msh::obj *> &roots) {
         stack_frame &frame = thread_call_stack.peek_frame();
         size = frame.operands.size();
     }
-    for (size_t i = 0; i < size; ++i) {
-        if (thread_call_stack.operands_refs_offsets[i]) {
-            msh::obj *obj = *(msh::obj **)(thread_call_stack.tape.data() + i);
-            if (obj != nullptr) { // might be not yet initialized
-                roots.push_back(obj);
-            }
-            i += 7;
+    const std::byte *tape = thread_call_stack.tape.data();
+    thread_call_stack.operands_refs_offsets.for_each_set(size, [&](size_t i) {
+        msh::obj *obj;
+        memcpy(&obj, tape + i, sizeof(obj));
+        if (obj != nullptr) { // might be not yet initialized
+            roots.push_back(obj);
         }
-    }
+    });
 }
 
 void gc::scan_exported_vars(std::vector<const msh::obj *> &roots) {
@@ -201,10 +520,3 @@ void gc::scan_exported_vars(std::vector<const msh::obj *> &roots) {
             roots.push_back(obj);
     }
 }
-
-void gc::scan_constants(std::vector<const msh::obj *> &roots) {
-    for (const ConstantPool &pool : pages.pools) {
-        const std::vector<const msh::obj *> &constants = pool.constants;
-        roots.insert(roots.end(), constants.cbegin(), constants.cend());
-    }
-}
\ No newline at end of file
@@ -16,6 +16,44 @@ namespace msh {
     void disable_gc_debug();
 #endif
 
+    /**
+     * Collection statistics of a garbage collector
+     * */
+    struct gc_stats {
+        /**
+         * number of buckets of the pause times histogram
+         * */
+        static constexpr size_t PAUSE_BUCKETS = 20;
+
+        /**
+         * number of full collections performed
+         * */
+        uint64_t collections;
+
+        /**
+         * number of minor collections performed
+         * */
+        uint64_t minor_collections;
+
+        /**
+         * cumulated and longest pause times of the collections and of the incremental sweep slices, in nanoseconds
+         * */
+        uint64_t total_pause_ns;
+        uint64_t max_pause_ns;
+
+        /**
+         * number of collections by pause time, where the bucket `i` counts the pauses
+         * shorter than 2^i microseconds that do not fit in the previous bucket,
+         * and the last bucket the pauses that do not fit in any other
+         * */
+        uint64_t pause_histogram[PAUSE_BUCKETS];
+
+        /**
+         * number of objects kept alive by the last collection
+         * */
+        uint64_t live_objects;
+    };
+
     /**
      * Garbage Collector
      * */
@@ -27,26 +65,168 @@ namespace msh {
         size_t last_roots_size;
 
         /**
-         * The GC cycle, incremented each time it performs a garbage collection
+         * The heap growth, in percent of the objects kept alive by the last collection,
+         * that triggers the next collection. A negative value disables automatic collections.
+         * */
+        int growth_percent;
+
+        /**
+         * The heap size, in objects, above which a full collection is run
          * */
-        uint8_t cycle;
+        size_t next_collection_size;
+
+        /**
+         * The number of young objects above which `should_run` requests a minor collection
+         * */
+        size_t nursery_capacity;
+
+        /**
+         * The number of threads that mark the objects of the large heaps during full collections
+         * */
+        size_t mark_threads;
+
+        /**
+         * The number of objects swept by each slice of an incremental sweep,
+         * or 0 to sweep the heap during the collections
+         * */
+        size_t sweep_budget;
+
+        /**
+         * The number of objects freed by the pending incremental sweep
+         * */
+        size_t swept_object_count;
+
+        gc_stats stats;
+
+        /**
+         * Write a line to stderr for each collection
+         * */
+        bool trace;
 
         void scan_exported_vars(std::vector<const msh::obj *> &roots);
-        void scan_constants(std::vector<const msh::obj *> &roots);
         void scan_thread(std::vector<const msh::obj *> &roots);
-        void walk_objects(std::vector<const msh::obj *> to_visit);
+        static void push_children(const msh::obj &obj, std::vector<const msh::obj *> &to_visit);
+
+        /**
+         * Marks the objects reachable from `to_visit`.
+         * @param young_only if true, the traversal does not go through old objects
+         * */
+        void walk_objects(std::vector<const msh::obj *> to_visit, bool young_only);
 
+        /**
+         * Marks the objects reachable from `roots` with `mark_threads` threads,
+         * that each traverse the graph from their own share of objects, and steal the shares of the others once done.
+         * */
+        void walk_objects_in_parallel(std::vector<const msh::obj *> roots);
+
+        /**
+         * Marks all the reachable objects
+         * */
         void scan();
 
+        /**
+         * Marks the young objects reachable from the roots and the remembered set
+         * */
+        void scan_young();
+
+        void update_next_collection_size();
+
+        /**
+         * Sweeps the remaining chunks of the pending incremental sweep, if any
+         * */
+        void finish_sweep();
+
+        /**
+         * Updates the statistics and the next collection size once an incremental sweep has swept the whole heap
+         * */
+        void end_sweep();
+
+        void record_pause(uint64_t pause_ns);
+
     public:
+        /**
+         * The default heap growth percent, `MOSHELL_GC_PERCENT` overrides it.
+         * */
+        static constexpr int DEFAULT_GROWTH_PERCENT = 100;
+
+        /**
+         * The minimum heap size (in objects) before a full collection is automatically triggered
+         * */
+        static constexpr size_t MIN_COLLECTION_SIZE = 4096;
+
+        /**
+         * The number of young objects that triggers a minor collection
+         * */
+        static constexpr size_t NURSERY_SIZE = 4096;
+
+        /**
+         * The maximum default number of marking threads, `MOSHELL_GC_THREADS` overrides it.
+         * */
+        static constexpr size_t MAX_DEFAULT_MARK_THREADS = 8;
+
+        /**
+         * The minimum heap size (in objects) for which a full collection marks the objects in parallel,
+         * below it the threads cost more than they save
+         * */
+        static constexpr size_t PARALLEL_MARK_MIN_SIZE = 65536;
+
         gc(heap &heap_space, CallStack &thread_stack, const pager &pages, const loader &ldr);
 
+        /**
+         * @return true if the nursery or the remembered set is full, and `run_minor` should be called
+         * */
+        bool should_run() const {
+            return heap_space.young_size() >= nursery_capacity || heap_space.get_remembered_set().size() >= nursery_capacity;
+        }
+
+        /**
+         * Sets the heap growth percent that triggers the next automatic collections.
+         * @param percent the growth percent, or a negative value to disable the automatic collections
+         * */
+        void set_growth_percent(int percent);
+
+        /**
+         * Sets the number of threads that mark the objects of the large heaps during full collections.
+         * @param threads the number of threads, where 0 and 1 mark the objects on the collecting thread only
+         * */
+        void set_mark_threads(size_t threads);
+
+        /**
+         * Sets the number of objects swept by each slice of the incremental sweeps.
+         *
+         * Once incremental, full collections only mark the live objects,
+         * and the garbage is then swept by slices before the next allocations, which bounds the pauses.
+         * @param objects the number of objects per slice, or 0 to sweep the heap during the collections
+         * */
+        void set_sweep_budget(size_t objects);
+
+        /**
+         * @return true if an incremental sweep is pending, and `sweep_slice` should be called before allocating
+         * */
+        bool is_sweeping() const {
+            return heap_space.is_sweeping();
+        }
+
+        /**
+         * Sweeps the next slice of the pending incremental sweep.
+         * */
+        void sweep_slice();
+
+        const gc_stats &get_stats() const;
+
         /**
          * Run a new Garbage Collection cycle
          * to remove detached objects from heap.
          * */
         void run();
 
+        /**
+         * Run a minor Garbage Collection cycle, that only removes the detached young objects
+         * and promotes the surviving ones.
+         * A full collection follows if the old objects exceeded the heap growth target.
+         * */
+        void run_minor();
+
         /**
          * Run a new Garbage Collection cycle
          * but instead of removing detached heap objects,
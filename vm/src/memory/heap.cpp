@@ -1,6 +1,39 @@
 #include "heap.h"
 
+#include <cstring>
+#include <utility>
+
 namespace msh {
+    obj_struct::obj_struct(const struct_definition *definition) : definition{definition} {
+        if (is_inline()) {
+            std::memset(inline_bytes, 0, INLINE_CAPACITY);
+        } else {
+            heap_bytes = new char[definition->heap_size]();
+        }
+    }
+
+    obj_struct::obj_struct(const obj_struct &other) : definition{other.definition} {
+        if (is_inline()) {
+            std::memcpy(inline_bytes, other.inline_bytes, INLINE_CAPACITY);
+        } else {
+            heap_bytes = new char[definition->heap_size];
+            std::memcpy(heap_bytes, other.heap_bytes, definition->heap_size);
+        }
+    }
+
+    obj_struct::obj_struct(obj_struct &&other) noexcept : definition{other.definition} {
+        if (is_inline()) {
+            std::memcpy(inline_bytes, other.inline_bytes, INLINE_CAPACITY);
+        } else {
+            heap_bytes = std::exchange(other.heap_bytes, nullptr);
+        }
+    }
+
+    obj_struct::~obj_struct() {
+        if (!is_inline()) {
+            delete[] heap_bytes;
+        }
+    }
 
     obj_data &obj::get_data() {
         return data;
@@ -10,10 +43,139 @@ namespace msh {
         return data;
     }
 
-    obj &heap::insert(msh::obj &&obj) {
-        objects.push_front(std::forward<msh::obj>(obj));
+    const std::string &obj::get_string() {
+        if (const obj_rope *rope = std::get_if<obj_rope>(&data)) {
+            std::string flat;
+            flat.reserve(rope->length);
+            // the pieces are appended from left to right, without recursion as ropes are usually deeply nested
+            std::vector<const obj *> pending{rope->right, rope->left};
+            while (!pending.empty()) {
+                const obj *piece = pending.back();
+                pending.pop_back();
+                if (const obj_rope *inner = std::get_if<obj_rope>(&piece->data)) {
+                    pending.push_back(inner->right);
+                    pending.push_back(inner->left);
+                } else {
+                    flat += piece->get_flat_view();
+                }
+            }
+            data.emplace<const std::string>(std::move(flat));
+        } else if (std::holds_alternative<obj_slice>(data)) {
+            data.emplace<const std::string>(get_flat_view());
+        }
+        return std::get<const std::string>(data);
+    }
+
+    std::string_view obj::get_string_view() {
+        if (std::holds_alternative<obj_rope>(data)) {
+            return get_string();
+        }
+        return get_flat_view();
+    }
+
+    std::string_view obj::get_flat_view() const {
+        if (const obj_slice *slice = std::get_if<obj_slice>(&data)) {
+            return std::string_view(std::get<const std::string>(slice->parent->data)).substr(slice->offset, slice->length);
+        }
+        return std::get<const std::string>(data);
+    }
+
+    size_t obj::get_string_length() const {
+        if (const obj_rope *rope = std::get_if<obj_rope>(&data)) {
+            return rope->length;
+        }
+        if (const obj_slice *slice = std::get_if<obj_slice>(&data)) {
+            return slice->length;
+        }
+        return std::get<const std::string>(data).length();
+    }
+
+    bool heap_chunk::is_empty() const {
+        for (uint64_t word : live) {
+            if (word != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    heap::~heap() {
+        for (std::unique_ptr<heap_chunk> &chunk : chunks) {
+            chunk->for_each_live([&](size_t i) {
+                std::destroy_at(&chunk->slots[i].object);
+            });
+        }
+    }
+
+    void heap::grow() {
+        heap_chunk &chunk = *chunks.emplace_back(std::make_unique<heap_chunk>());
+        for (size_t i = heap_chunk::CAPACITY; i-- > 0;) {
+            chunk.slots[i].free = {free_list, &chunk};
+            free_list = &chunk.slots[i];
+        }
+    }
+
+    void heap::release_empty_chunks() {
+        free_list = nullptr;
+        bool kept_empty_chunk = false;
+        for (auto it = chunks.begin(); it != chunks.end();) {
+            heap_chunk &chunk = **it;
+            if (chunk.is_empty()) {
+                if (kept_empty_chunk) {
+                    it = chunks.erase(it);
+                    continue;
+                }
+                kept_empty_chunk = true;
+            }
+            ++it;
+        }
+
+        for (auto it = chunks.rbegin(); it != chunks.rend(); ++it) {
+            heap_chunk &chunk = **it;
+            for (size_t i = heap_chunk::CAPACITY; i-- > 0;) {
+                if (!(chunk.live[i / heap_chunk::WORD_BITS] & (uint64_t{1} << (i % heap_chunk::WORD_BITS)))) {
+                    chunk.slots[i].free = {free_list, &chunk};
+                    free_list = &chunk.slots[i];
+                }
+            }
+        }
+    }
+
+    heap_chunk::slot *heap::pop_free_slot() {
+        if (free_list == nullptr) {
+            grow();
+        }
+        heap_chunk::slot *slot = free_list;
+        free_list = slot->free.next;
+        return slot;
+    }
+
+    void heap::track_young(heap_chunk &chunk, heap_chunk::slot *slot) {
+        uint32_t i = slot - chunk.slots.data();
+        chunk.live[i / heap_chunk::WORD_BITS] |= uint64_t{1} << (i % heap_chunk::WORD_BITS);
+        nursery.emplace_back(&chunk, i);
         len++;
-        return objects.front();
+    }
+
+    const obj &heap::intern(std::string &&str) {
+        auto it = interned_strings.find(str);
+        if (it != interned_strings.end()) {
+            return *it->second;
+        }
+        msh::obj &obj = static_objects.emplace_back(std::move(str));
+        obj.marked = true;
+        obj.young = false;
+        interned_strings.emplace(obj.get<const std::string>(), &obj);
+        return obj;
+    }
+
+    bool heap::is_interned(const obj &object) const {
+        const std::string *str = std::get_if<const std::string>(&object.data);
+        if (str == nullptr) {
+            return false;
+        }
+        auto it = interned_strings.find(*str);
+        return it != interned_strings.end() && it->second == &object;
     }
 
     size_t heap::size() const {
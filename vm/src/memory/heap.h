@@ -1,15 +1,19 @@
 #pragma once
 
+#include <array>
+#include <bit>
 #include <cstdint>
-#include <forward_list>
+#include <deque>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
-namespace msh {
+#include "definitions/struct_definition.h"
 
-    struct struct_definition;
+namespace msh {
 
     // Create a recursive variant type by forward declaring the vector type.
     // Since C++17, `std::vector` doesn't require the type to be complete with
@@ -17,19 +21,240 @@ namespace msh {
 
     class obj;
 
+    /**
+     * A contiguous sequence of values, that can also remove its first value in amortized constant time.
+     *
+     * The values removed from the front are only skipped, and the storage is compacted
+     * once they outnumber the remaining values.
+     */
+    template <typename T>
+    class front_erasable_vector {
+        std::vector<T> values;
+
+        /**
+         * the number of values removed from the front and not compacted yet
+         */
+        size_t head = 0;
+
+    public:
+        using value_type = T;
+        using iterator = typename std::vector<T>::iterator;
+        using const_iterator = typename std::vector<T>::const_iterator;
+
+        front_erasable_vector() = default;
+
+        front_erasable_vector(size_t count, const T &value) : values(count, value) {}
+
+        template <typename It>
+        front_erasable_vector(It first, It last) : values(first, last) {}
+
+        iterator begin() {
+            return values.begin() + head;
+        }
+
+        iterator end() {
+            return values.end();
+        }
+
+        const_iterator begin() const {
+            return values.begin() + head;
+        }
+
+        const_iterator end() const {
+            return values.end();
+        }
+
+        T *data() {
+            return values.data() + head;
+        }
+
+        const T *data() const {
+            return values.data() + head;
+        }
+
+        size_t size() const {
+            return values.size() - head;
+        }
+
+        bool empty() const {
+            return values.size() == head;
+        }
+
+        T &operator[](size_t index) {
+            return values[head + index];
+        }
+
+        const T &operator[](size_t index) const {
+            return values[head + index];
+        }
+
+        T &front() {
+            return values[head];
+        }
+
+        T &back() {
+            return values.back();
+        }
+
+        void reserve(size_t capacity) {
+            values.reserve(head + capacity);
+        }
+
+        void push_back(const T &value) {
+            values.push_back(value);
+        }
+
+        void pop_back() {
+            values.pop_back();
+            if (values.size() == head) {
+                clear();
+            }
+        }
+
+        void pop_front() {
+            head++;
+            if (values.size() == head) {
+                clear();
+            } else if (head > values.size() / 2) {
+                values.erase(values.begin(), values.begin() + head);
+                head = 0;
+            }
+        }
+
+        template <typename It>
+        void append(It first, It last) {
+            values.insert(values.end(), first, last);
+        }
+
+        void clear() {
+            values.clear();
+            head = 0;
+        }
+    };
+
     /**
      * A vector of heap allocated objects.
      */
-    struct obj_vector : public std::vector<obj *> {
-        using std::vector<obj *>::vector;
+    struct obj_vector : public front_erasable_vector<obj *> {
+        using front_erasable_vector<obj *>::front_erasable_vector;
+    };
+
+    /**
+     * A vector of primitive values, stored contiguously without boxing them.
+     *
+     * An empty vector of objects becomes an unboxed vector when a primitive value is pushed in it,
+     * and an unboxed vector is boxed back if it ever receives a value of another type.
+     */
+    template <typename T>
+    struct obj_unboxed_vector : public front_erasable_vector<T> {
+        using front_erasable_vector<T>::front_erasable_vector;
+    };
+
+    template <typename V>
+    constexpr bool is_unboxed_vector_v = false;
+
+    template <typename T>
+    constexpr bool is_unboxed_vector_v<obj_unboxed_vector<T>> = true;
+
+    using obj_int_vector = obj_unboxed_vector<int64_t>;
+    using obj_float_vector = obj_unboxed_vector<double>;
+    using obj_byte_vector = obj_unboxed_vector<int8_t>;
+
+    /**
+     * The concatenation of two strings, that is only flattened once its content is read.
+     *
+     * Appending piece by piece to a string then copies each byte once, instead of
+     * copying the whole prefix on each concatenation.
+     */
+    struct obj_rope {
+        /**
+         * the concatenations whose total length is below this one are directly flattened
+         */
+        static constexpr size_t MIN_LENGTH = 64;
+
+        // either strings or ropes
+        const obj *left;
+        const obj *right;
+
+        /**
+         * the length in bytes of the whole string
+         */
+        size_t length;
+    };
+
+    /**
+     * A part of another string, that references its content instead of copying it.
+     *
+     * The slice keeps the parent string alive, and is only copied into its own string once it is read as a whole.
+     */
+    struct obj_slice {
+        /**
+         * the slices shorter than this are directly copied, as they fit in the inline buffer of a string
+         */
+        static constexpr size_t MIN_LENGTH = 16;
+
+        // always a flat string
+        const obj *parent;
+
+        /**
+         * the position in bytes of the slice in the parent string
+         */
+        size_t offset;
+
+        /**
+         * the length in bytes of the slice
+         */
+        size_t length;
     };
 
+    /**
+     * An instance of a structure.
+     *
+     * The fields of small structures are stored inline, so that the instance is
+     * placed in its object slot without any separate allocation.
+     */
     struct obj_struct {
+        /**
+         * the largest structure whose fields are stored inline, that fits in the footprint of a vector
+         */
+        static constexpr size_t INLINE_CAPACITY = 3 * sizeof(uint64_t);
+
         const struct_definition *definition;
-        std::vector<char> bytes;
+
+    private:
+        union {
+            alignas(uint64_t) char inline_bytes[INLINE_CAPACITY];
+            char *heap_bytes;
+        };
+
+        bool is_inline() const {
+            return definition->heap_size <= INLINE_CAPACITY;
+        }
+
+    public:
+        /**
+         * Creates an instance of the given structure, with all its fields zeroed.
+         */
+        explicit obj_struct(const struct_definition *definition);
+        obj_struct(const obj_struct &other);
+        obj_struct(obj_struct &&other) noexcept;
+        obj_struct &operator=(const obj_struct &) = delete;
+        ~obj_struct();
+
+        char *data() {
+            return is_inline() ? inline_bytes : heap_bytes;
+        }
+
+        const char *data() const {
+            return is_inline() ? inline_bytes : heap_bytes;
+        }
+
+        size_t size() const {
+            return definition->heap_size;
+        }
     };
 
-    using obj_data = std::variant<int64_t, int8_t, double, const std::string, obj_vector, obj_struct>;
+    using obj_data = std::variant<int64_t, int8_t, double, const std::string, obj_vector, obj_struct, obj_rope, obj_slice, obj_int_vector, obj_float_vector, obj_byte_vector>;
 
     class gc;
 
@@ -37,18 +262,62 @@ namespace msh {
      * A vm object that can be stored in the heap.
      */
     class obj {
-        mutable uint8_t gc_cycle;
+        /**
+         * set on the objects reached by the marking phase of a collection, cleared by its sweep
+         */
+        mutable bool marked;
+
+        /**
+         * true while the object is in the nursery, i.e. it did not survive a collection yet
+         */
+        bool young;
+
+        /**
+         * true if the object is in the remembered set of the heap as a whole object
+         */
+        bool remembered;
+
         obj_data data;
 
+        /**
+         * Gets the content of a string object that is not a rope.
+         */
+        std::string_view get_flat_view() const;
+
         friend gc;
+        friend class heap;
 
     public:
         template <typename T>
-        obj(T val) : gc_cycle{0}, data{std::move(val)} {}
+            requires(!std::is_same_v<std::remove_cvref_t<T>, obj>)
+        obj(T &&val) : marked{false}, young{true}, remembered{false}, data{std::forward<T>(val)} {}
+
+        // objects are constructed in place in the heap, and never copied nor moved
+        obj(const obj &) = delete;
+        obj &operator=(const obj &) = delete;
 
         obj_data &get_data();
         const obj_data &get_data() const;
 
+        /**
+         * Gets the content of a string object, flattening it first if it is a rope or copying it if it is a slice.
+         *
+         * The flattened rope no longer references its pieces, nor the copied slice its parent.
+         */
+        const std::string &get_string();
+
+        /**
+         * Gets the content of a string object, only flattening it if it is a rope.
+         *
+         * The view is valid as long as the object is alive.
+         */
+        std::string_view get_string_view();
+
+        /**
+         * Gets the length in bytes of a string object, without flattening it.
+         */
+        size_t get_string_length() const;
+
         template <typename T>
         T &get()
             requires(!std::is_const_v<T>)
@@ -63,6 +332,71 @@ namespace msh {
         }
     };
 
+    /**
+     * An entry of the remembered set: an old object that may reference young objects.
+     */
+    struct remembered_ref {
+        /**
+         * the `index` of a whole object entry
+         */
+        static constexpr size_t WHOLE_OBJECT = SIZE_MAX;
+
+        obj *container;
+
+        /**
+         * the written vector element, or `WHOLE_OBJECT` if any reference of the container may have been written
+         */
+        size_t index;
+    };
+
+    /**
+     * A fixed-size block of object slots.
+     *
+     * Chunks are individually allocated and never moved, so that inserting or
+     * removing objects does not invalidate references to the other objects.
+     */
+    struct heap_chunk {
+        static constexpr size_t CAPACITY = 256;
+        static constexpr size_t WORD_BITS = 64;
+
+        /**
+         * A slot either holds a live object, or links to the next free slot of the heap.
+         */
+        union slot {
+            obj object;
+            struct {
+                slot *next;
+                heap_chunk *chunk;
+            } free;
+
+            slot() : free{nullptr, nullptr} {}
+            ~slot() {}
+        };
+
+        std::array<slot, CAPACITY> slots;
+
+        /**
+         * one bit per slot, set if the slot holds a live object
+         */
+        std::array<uint64_t, CAPACITY / WORD_BITS> live{};
+
+        /**
+         * calls `f` with the index of each live slot, in increasing order
+         */
+        template <typename F>
+        void for_each_live(F f) const {
+            for (size_t w = 0; w < live.size(); ++w) {
+                uint64_t word = live[w];
+                while (word != 0) {
+                    f(w * WORD_BITS + std::countr_zero(word));
+                    word &= word - 1;
+                }
+            }
+        }
+
+        bool is_empty() const;
+    };
+
     /**
      * A collection of objects that can be referenced by other objects.
      *
@@ -70,29 +404,317 @@ namespace msh {
      */
     class heap {
         /**
-         * The allocated objects.
+         * The chunks holding the allocated objects.
+         *
+         * Objects are placed into the slots of fixed-size chunks, so that the allocations
+         * are amortized over a whole chunk and the sweep walks contiguous memory.
+         */
+        std::vector<std::unique_ptr<heap_chunk>> chunks;
+
+        /**
+         * The free slots of all chunks.
+         */
+        heap_chunk::slot *free_list = nullptr;
+
+        /**
+         * The location of the young objects, allocated since the last collection.
+         */
+        std::vector<std::pair<heap_chunk *, uint32_t>> nursery;
+
+        /**
+         * The old objects (or vector elements) that were assigned a reference since the last collection,
+         * and thus may hold the only reference to a young object.
+         */
+        std::vector<remembered_ref> remembered_set;
+
+        /**
+         * The static objects, filled by the loader with the constant strings.
          *
-         * A linked list is used to avoid invalidating references to objects when
-         * inserting or removing new objects.
+         * They are never collected, and are permanently marked so that
+         * the garbage collector neither traverses nor sweeps them.
          */
-        std::forward_list<obj> objects;
+        std::deque<obj> static_objects;
 
         /**
-         * heap size
+         * The static strings by their content, shared between all the constant pools.
+         */
+        std::unordered_map<std::string_view, const obj *> interned_strings;
+
+        /**
+         * heap size, excluding the static objects
          * */
-        size_t len;
+        size_t len = 0;
 
-        friend gc;
+        /**
+         * true while the chunks swept by `sweep_step` have not all been swept
+         */
+        bool sweeping = false;
+
+        /**
+         * The index of the next chunk to sweep, the chunks allocated during the sweep are appended after it.
+         */
+        size_t sweep_cursor = 0;
+
+        /**
+         * The number of chunks found empty by the pending sweep
+         */
+        size_t swept_empty_chunks = 0;
+
+        /**
+         * Allocates a new chunk and prepends its slots to the free list.
+         */
+        void grow();
+
+        /**
+         * Releases the empty chunks (except one, to avoid reallocating a chunk right after a collection)
+         * and rebuilds the free list from the remaining chunks' free slots.
+         */
+        void release_empty_chunks();
 
     public:
+        heap() = default;
+        heap(const heap &) = delete;
+        heap &operator=(const heap &) = delete;
+        ~heap();
+
         /**
-         * Inserts a new object in the heap.
+         * Inserts a new object in the heap's nursery.
+         *
+         * The object is directly constructed in its slot, as the `const std::string` alternative
+         * of its data cannot be moved.
          *
-         * @param obj The object to insert.
+         * @param value The value of the object to insert.
          * @return A reference to this object, valid as long as the object is not deleted.
          */
-        msh::obj &insert(msh::obj &&obj);
+        template <typename T>
+        msh::obj &insert(T &&value) {
+            heap_chunk::slot *slot = pop_free_slot();
+            auto free = slot->free;
+            msh::obj *obj;
+            try {
+                obj = std::construct_at(&slot->object, std::forward<T>(value));
+            } catch (...) {
+                slot->free = {free_list, free.chunk};
+                free_list = slot;
+                throw;
+            }
+            track_young(*free.chunk, slot);
+            return *obj;
+        }
+
+        /**
+         * Gets the static string object holding the given content, creating it if needed.
+         *
+         * @param str The string content.
+         * @return A reference to the static object, valid as long as the heap.
+         */
+        const msh::obj &intern(std::string &&str);
+
+        /**
+         * @return true if the given object is one of the static strings of this heap
+         */
+        bool is_interned(const msh::obj &object) const;
 
         size_t size() const;
+
+        /**
+         * @return the number of objects in the nursery
+         */
+        size_t young_size() const {
+            return nursery.size();
+        }
+
+        /**
+         * Records that `container` has been written to.
+         *
+         * Must be called each time a reference may have been written into an object,
+         * so that minor collections can find the young objects only referenced by old objects.
+         */
+        void write_barrier(msh::obj &container) {
+            if (!container.young && !container.remembered) {
+                container.remembered = true;
+                remembered_set.push_back({&container, remembered_ref::WHOLE_OBJECT});
+            }
+        }
+
+        /**
+         * Records that `ref` has been stored at the given index of the `container` vector.
+         *
+         * Unlike the whole object barrier, a minor collection then only visits the written element,
+         * which avoids rescanning large old vectors that keep receiving new objects.
+         */
+        void write_barrier(msh::obj &container, size_t index, const msh::obj &ref) {
+            if (!container.young && !container.remembered && ref.young) {
+                remembered_set.push_back({&container, index});
+            }
+        }
+
+        const std::vector<remembered_ref> &get_remembered_set() const {
+            return remembered_set;
+        }
+
+        /**
+         * Calls `f` for each object of the heap.
+         */
+        template <typename F>
+        void for_each(F f) const {
+            for (const std::unique_ptr<heap_chunk> &chunk : chunks) {
+                chunk->for_each_live([&](size_t i) {
+                    f(static_cast<const msh::obj &>(chunk->slots[i].object));
+                });
+            }
+        }
+
+        /**
+         * Deletes every object that is not marked, then unmarks the remaining objects
+         * which all become old.
+         *
+         * @param on_free called with each object before its deletion
+         * @return the number of deleted objects
+         */
+        template <typename F>
+        size_t sweep(F on_free) {
+            size_t removed = begin_sweep(on_free);
+            return removed + sweep_step(SIZE_MAX, on_free);
+        }
+
+        /**
+         * Starts to sweep the objects that are not marked, that `sweep_step` then deletes chunk by chunk
+         * while new objects get allocated.
+         *
+         * The young objects are swept right away, so that the young objects of the heap
+         * are all allocated after the mark and are left untouched by the sweep steps.
+         *
+         * @param on_free called with each object before its deletion
+         * @return the number of deleted young objects
+         */
+        template <typename F>
+        size_t begin_sweep(F on_free) {
+            for (remembered_ref &ref : remembered_set) {
+                ref.container->remembered = false;
+            }
+            remembered_set.clear();
+
+            size_t removed = 0;
+            for (auto [chunk, i] : nursery) {
+                msh::obj &obj = chunk->slots[i].object;
+                if (obj.marked) {
+                    // unmarked by the sweep of its chunk
+                    obj.young = false;
+                } else {
+                    on_free(obj);
+                    release(*chunk, i);
+                    removed++;
+                }
+            }
+            len -= removed;
+            nursery.clear();
+
+            sweeping = !chunks.empty();
+            sweep_cursor = 0;
+            swept_empty_chunks = 0;
+            return removed;
+        }
+
+        /**
+         * @return true if a sweep has begun and not all of its chunks have been swept
+         */
+        bool is_sweeping() const {
+            return sweeping;
+        }
+
+        /**
+         * Sweeps the next chunks of the pending sweep, deleting their old objects that are not marked
+         * and unmarking the others.
+         *
+         * @param budget the number of objects after which no other chunk is swept,
+         *               the last chunk is always swept entirely
+         * @param on_free called with each object before its deletion
+         * @return the number of deleted objects
+         */
+        template <typename F>
+        size_t sweep_step(size_t budget, F on_free) {
+            size_t removed = 0;
+            size_t visited = 0;
+            while (sweeping && visited < budget) {
+                heap_chunk &chunk = *chunks[sweep_cursor++];
+                chunk.for_each_live([&](size_t i) {
+                    msh::obj &obj = chunk.slots[i].object;
+                    if (obj.young) {
+                        // allocated since the mark
+                        return;
+                    }
+                    visited++;
+                    if (obj.marked) {
+                        obj.marked = false;
+                    } else {
+                        on_free(obj);
+                        release(chunk, i);
+                        removed++;
+                    }
+                });
+                swept_empty_chunks += chunk.is_empty();
+
+                if (sweep_cursor == chunks.size()) {
+                    sweeping = false;
+                    if (swept_empty_chunks > 1) {
+                        release_empty_chunks();
+                    }
+                }
+            }
+            len -= removed;
+            return removed;
+        }
+
+        /**
+         * Deletes the young objects that are not marked, the marked young objects are unmarked and promoted as old objects.
+         *
+         * @param on_free called with each object before its deletion
+         * @return the number of deleted objects
+         */
+        template <typename F>
+        size_t sweep_nursery(F on_free) {
+            size_t removed = 0;
+            for (auto [chunk, i] : nursery) {
+                msh::obj &obj = chunk->slots[i].object;
+                if (obj.marked) {
+                    obj.marked = false;
+                    obj.young = false;
+                } else {
+                    on_free(obj);
+                    release(*chunk, i);
+                    removed++;
+                }
+            }
+            len -= removed;
+            nursery.clear();
+            for (remembered_ref &ref : remembered_set) {
+                ref.container->remembered = false;
+            }
+            remembered_set.clear();
+            return removed;
+        }
+
+    private:
+        /**
+         * Destroys the object of the given chunk slot, and pushes the slot in the free list.
+         */
+        void release(heap_chunk &chunk, size_t i) {
+            heap_chunk::slot &slot = chunk.slots[i];
+            std::destroy_at(&slot.object);
+            chunk.live[i / heap_chunk::WORD_BITS] &= ~(uint64_t{1} << (i % heap_chunk::WORD_BITS));
+            slot.free = {free_list, &chunk};
+            free_list = &slot;
+        }
+
+        /**
+         * Pops a slot from the free list, allocating a new chunk if needed.
+         */
+        heap_chunk::slot *pop_free_slot();
+
+        /**
+         * Marks the given slot of the chunk as live, and registers its new object in the nursery.
+         */
+        void track_young(heap_chunk &chunk, heap_chunk::slot *slot);
     };
 }
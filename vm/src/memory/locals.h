@@ -18,6 +18,9 @@ public:
 
 /**
  * Encapsulates the allocated locals area of a stack frame
+ *
+ * Each access is checked against the bounds of the area, unless its `checked` parameter is false,
+ * for the verified functions whose local accesses are known to be in range.
  */
 class Locals {
     /**
@@ -33,39 +36,68 @@ class Locals {
 public:
     Locals(std::byte *bytes, size_t capacity);
 
+    /**
+     * @returns the address of the area
+     */
+    std::byte *data() const {
+        return bytes;
+    }
+
     /**
      * @returns a reference to given byte
      * @throws LocalsOutOfBoundError if `at` is out of bound
      */
-    uint8_t &reference(size_t at);
+    template <bool checked = true>
+    uint8_t &reference(size_t at) {
+        if constexpr (checked) {
+            check_capacity(at, 0, "accessing");
+        }
+        return reinterpret_cast<uint8_t &>(*(bytes + at));
+    }
 
     /**
      * @throws LocalsOutOfBoundError if `at` is out of bound
      */
-    int64_t get_q_word(size_t at) const;
+    template <bool checked = true>
+    int64_t get_q_word(size_t at) const {
+        return *get<int64_t, checked>(at);
+    }
     /**
      * @throws LocalsOutOfBoundError if `at` is out of bound
      */
-    uint8_t get_byte(size_t at) const;
+    template <bool checked = true>
+    uint8_t get_byte(size_t at) const {
+        return *get<char, checked>(at);
+    }
 
     /**
      * @throws LocalsOutOfBoundError if `at` + the size of `int64_i` is out of bound
      */
-    void set_q_word(int64_t i, size_t at);
+    template <bool checked = true>
+    void set_q_word(int64_t i, size_t at) {
+        set<int64_t, checked>(i, at);
+    }
     /**
      * @throws LocalsOutOfBoundError if `at` + the size of `char` is out of bound
      */
-    void set_byte(uint8_t b, size_t at);
+    template <bool checked = true>
+    void set_byte(uint8_t b, size_t at) {
+        set<char, checked>(b, at);
+    }
 
-    template <typename T>
+    template <typename T, bool checked = true>
     T *get(size_t at) const {
-        check_capacity(at, sizeof(T), "accessing");
+        if constexpr (checked) {
+            check_capacity(at, sizeof(T), "accessing");
+        }
         return (T *)(bytes + at);
     }
 
-    template <typename T>
+    template <typename T, bool checked = true>
     void set(T t, size_t at) {
-        check_capacity(at, sizeof(T), "updating");
+        if constexpr (checked) {
+            check_capacity(at, sizeof(T), "updating");
+        }
         *(T *)(bytes + at) = t;
     }
 
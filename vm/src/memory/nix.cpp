@@ -1,5 +1,12 @@
 #include "nix.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 int fd_table::push_redirection(int from_fd, int to_fd) {
@@ -26,4 +33,181 @@ fd_table::~fd_table() {
     while (!active_redirections.empty()) {
         pop_redirection();
     }
-}
\ No newline at end of file
+}
+/**
+ * @return the amount of bytes that are likely to be read from the given file descriptor, or 0 if unknown
+ */
+static size_t read_size_hint(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        if (offset != -1 && st.st_size > offset) {
+            return st.st_size - offset;
+        }
+        return 0;
+    }
+    int available;
+    if (ioctl(fd, FIONREAD, &available) == 0 && available > 0) {
+        return available;
+    }
+    return 0;
+}
+
+/**
+ * Waits for a non-blocking descriptor to be ready for the given events, instead of spinning on it.
+ *
+ * @return 0 once it is ready or if the wait got interrupted, -1 on error (with errno set)
+ */
+static int wait_ready(int fd, short events) {
+    pollfd ready{fd, events, 0};
+    if (poll(&ready, 1, -1) == -1 && errno != EINTR) {
+        return -1;
+    }
+    return 0;
+}
+
+int read_all(int fd, std::string &out) {
+    size_t len = out.size();
+    // one more byte so that the end of input is detected without growing the buffer
+    out.resize(len + std::max<size_t>(read_size_hint(fd) + 1, 4096));
+    while (true) {
+        if (len == out.size()) {
+            out.resize(out.size() * 2);
+        }
+        ssize_t r = read(fd, out.data() + len, out.size() - len);
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_ready(fd, POLLIN) == 0) {
+                continue;
+            }
+            out.resize(len);
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+        len += r;
+    }
+    out.resize(len);
+    // the exponential growth may leave up to half of the buffer unused
+    if (out.capacity() - len > len / 4) {
+        out.shrink_to_fit();
+    }
+    return 0;
+}
+
+int write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t w = write(fd, data, size);
+        if (w == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_ready(fd, POLLOUT) == 0) {
+                continue;
+            }
+            return -1;
+        }
+        data += w;
+        size -= w;
+    }
+    return 0;
+}
+
+line_reader::line_reader(int fd) : fd{fd}, pos{0} {}
+
+int line_reader::next_line(std::string &line) {
+    size_t scanned = pos;
+    while (true) {
+        const char *start = pending.data() + scanned;
+        const char *newline = static_cast<const char *>(memchr(start, '\n', pending.size() - scanned));
+        if (newline != nullptr) {
+            size_t end = newline - pending.data();
+            line.assign(pending, pos, end - pos);
+            pos = end + 1;
+            return 1;
+        }
+        scanned = pending.size();
+
+        // drop the consumed bytes before reading more
+        if (pos > 0) {
+            pending.erase(0, pos);
+            scanned -= pos;
+            pos = 0;
+        }
+        size_t len = pending.size();
+        pending.resize(len + 4096);
+        ssize_t r = read(fd, pending.data() + len, 4096);
+        if (r == -1) {
+            pending.resize(len);
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_ready(fd, POLLIN) == 0) {
+                continue;
+            }
+            return -1;
+        }
+        pending.resize(len + r);
+        if (r == 0) {
+            if (pending.empty()) {
+                return 0;
+            }
+            line = std::move(pending);
+            pending.clear();
+            return 1;
+        }
+    }
+}
+
+child_reaper children;
+
+int child_reaper::wait(pid_t pid, int &status) {
+    auto it = statuses.find(pid);
+    if (it != statuses.end()) {
+        status = it->second;
+        statuses.erase(it);
+        return 0;
+    }
+
+    // fail early if the pid is not one of our children, instead of waiting for the others
+    pid_t reaped = waitpid(pid, &status, WNOHANG);
+    if (reaped == pid) {
+        return 0;
+    }
+    if (reaped == -1 && errno != EINTR) {
+        return -1;
+    }
+    while (true) {
+        int reaped_status;
+        reaped = waitpid(-1, &reaped_status, 0);
+        if (reaped == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (reaped == pid) {
+            status = reaped_status;
+            return 0;
+        }
+        statuses[reaped] = reaped_status;
+    }
+}
+
+void child_reaper::wait_all() {
+    int status;
+    while (waitpid(-1, &status, 0) > 0 || errno == EINTR) {
+    }
+    statuses.clear();
+}
+
+void child_reaper::forget(pid_t pid) {
+    statuses.erase(pid);
+}
+
+void child_reaper::clear() {
+    statuses.clear();
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
 #include <vector>
 
 struct redir {
@@ -17,3 +20,81 @@ public:
 
     ~fd_table();
 };
+
+/**
+ * Reads the given file descriptor until its end, appending the read bytes to `out`.
+ *
+ * The buffer is sized from `fstat` for regular files or `FIONREAD` for pipes,
+ * then grows exponentially, and the bytes are read in place.
+ * A non-blocking descriptor is polled until more bytes can be read.
+ * @return 0 on success, -1 on error (with errno set)
+ */
+int read_all(int fd, std::string &out);
+
+/**
+ * Writes all the given bytes to the file descriptor, retrying the partial and interrupted writes,
+ * and polling a non-blocking descriptor until it can be written again.
+ *
+ * @return 0 on success, -1 on error (with errno set)
+ */
+int write_all(int fd, const char *data, size_t size);
+
+/**
+ * Reads a file descriptor line by line, only buffering the read bytes
+ * that are not yet returned.
+ */
+class line_reader {
+    int fd;
+    std::string pending;
+    size_t pos;
+
+public:
+    explicit line_reader(int fd);
+
+    /**
+     * Reads the next line, without its trailing newline.
+     * The last line of the input may not end with a newline.
+     * A non-blocking descriptor is polled until more bytes can be read.
+     *
+     * @return 1 if a line has been read, 0 at the end of the input, -1 on error (with errno set)
+     */
+    int next_line(std::string &line);
+};
+
+/**
+ * Reaps the children of the process.
+ *
+ * While waiting for a child, the other children that exit are reaped in the same pass,
+ * and their statuses are kept until they are waited, without any other system call.
+ */
+class child_reaper {
+    std::unordered_map<pid_t, int> statuses;
+
+public:
+    /**
+     * Waits for the given child to exit.
+     *
+     * @return 0 on success, -1 on error (with errno set)
+     */
+    int wait(pid_t pid, int &status);
+
+    /**
+     * Waits for all the children, discarding their statuses.
+     */
+    void wait_all();
+
+    /**
+     * Discards the status kept for a reaped child, as its pid has been reused by a new child.
+     */
+    void forget(pid_t pid);
+
+    /**
+     * Discards all the kept statuses, as the children belong to the parent of a forked process.
+     */
+    void clear();
+};
+
+/**
+ * The reaper of this process's children
+ */
+extern child_reaper children;
@@ -2,11 +2,14 @@
 
 #include "constant_pool.h"
 #include "errors.h"
+#include "reference_bitmap.h"
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <exception>
 #include <memory>
 #include <stdexcept>
+#include <utility>
 
 namespace msh {
     template <typename T>
@@ -35,15 +38,22 @@ public:
     }
 };
 
+/**
+ * The operands area of a stack frame.
+ *
+ * Each access is checked against the bounds of the stack, unless its `checked` parameter is false.
+ * Unchecked accesses are only made by the interpreter for the verified functions,
+ * whose frames are known to never underflow nor to exceed their maximum stack size.
+ */
 class OperandStack {
 private:
     std::byte *bytes;
     size_t current_pos;
     size_t stack_capacity;
-    std::vector<bool> &operands_refs;
+    ReferenceBitmap &operands_refs;
 
 public:
-    OperandStack(std::byte *bytes, size_t current_pos, size_t stack_capacity, std::vector<bool> &operands_refs);
+    OperandStack(std::byte *bytes, size_t current_pos, size_t stack_capacity, ReferenceBitmap &operands_refs);
 
     /**
      * @return the size in bytes of the operand stack
@@ -58,54 +68,90 @@ public:
     /**
      * @throws StackOverflowError if the operand stack would overflow by pushing the quad-word
      */
-    void push_int(int64_t i);
+    template <bool checked = true>
+    void push_int(int64_t i) {
+        push<int64_t, checked>(i);
+    }
 
     /**
      * @throws StackOverflowError if the operand stack would overflow by pushing the byte
      */
-    void push_byte(int8_t b);
+    template <bool checked = true>
+    void push_byte(int8_t b) {
+        push<int8_t, checked>(b);
+    }
 
     /**
      * @throws StackOverflowError if the operand stack would overflow by pushing the quad-word
      */
-    void push_double(double d);
+    template <bool checked = true>
+    void push_double(double d) {
+        push<double, checked>(d);
+    }
 
     /**
      * @throws StackOverflowError if the operand stack would overflow by pushing the reference
      */
-    void push_reference(msh::obj &r);
+    template <bool checked = true>
+    void push_reference(msh::obj &r) {
+        push<msh::obj *, checked>(&r);
+    }
 
-    void push_unchecked_reference(void *r);
+    template <bool checked = true>
+    void push_unchecked_reference(void *r) {
+        push<uint64_t, checked>((uint64_t)r);
+    }
 
     /**
      * @return popped quad-word as an integer
      * @throws OperandStackUnderflowError if the operand stack does not have enough bytes to pop a quad-word
      */
-    int64_t pop_int();
+    template <bool checked = true>
+    int64_t pop_int() {
+        return pop<int64_t, checked>();
+    }
 
     /**
      * @return popped byte
      * @throws OperandStackUnderflowError if the operand stack does not have enough bytes to pop a byte
      */
-    int8_t pop_byte();
+    template <bool checked = true>
+    int8_t pop_byte() {
+        return pop<int8_t, checked>();
+    }
 
     /**
      * @return popped quad-word as a double
      * @throws OperandStackUnderflowError if the operand stack does not have enough bytes to pop a quad-word
      */
-    double pop_double();
+    template <bool checked = true>
+    double pop_double() {
+        return pop<double, checked>();
+    }
 
     /**
      * @return popped reference
      * @throws OperandStackUnderflowError if the operand stack does not have enough bytes to pop a reference
      */
-    msh::obj &pop_reference();
+    template <bool checked = true>
+    msh::obj &pop_reference() {
+        return *pop<msh::obj *, checked>();
+    }
 
     /**
      * pops `n` bytes
      * @throws OperandStackUnderflowError if the operand stack does not have enough bytes to pop
      */
-    const std::byte *pop_bytes(size_t n);
+    template <bool checked = true>
+    const std::byte *pop_bytes(size_t n) {
+        if constexpr (checked) {
+            if (current_pos < n) {
+                throw OperandStackUnderflowError("operand stack is empty");
+            }
+        }
+        current_pos -= n;
+        return bytes + current_pos;
+    }
 
     /**
      * transfer to this operand stack the n first bytes of the given caller stack.
@@ -125,52 +171,113 @@ public:
      */
     void memmove(size_t dest, size_t src, size_t size);
 
+    /**
+     * @return the address of the byte following the top of the stack
+     */
+    std::byte *top() const {
+        return bytes + current_pos;
+    }
+
+    /**
+     * Moves the top of the stack to the given address, once its values have been written elsewhere.
+     *
+     * The written values must not be references, as the pushed bytes are marked as such.
+     *
+     * @param top the address of the byte following the new top of the stack
+     */
+    void set_top(std::byte *top) {
+        size_t pos = top - bytes;
+        if (pos > current_pos) {
+            operands_refs.clear(current_pos, pos);
+        }
+        current_pos = pos;
+    }
+
     /**
      * Duplicates the quad-word on the top of the stack.
      */
-    void dup_qword();
+    template <bool checked = true>
+    void dup_qword() {
+        if constexpr (checked) {
+            if (current_pos + sizeof(int64_t) > stack_capacity) {
+                throw StackOverflowError("exceeded stack capacity via operand stack");
+            }
+        }
+        std::memcpy(this->bytes + current_pos, this->bytes + current_pos - sizeof(int64_t), sizeof(int64_t));
+        operands_refs.copy(current_pos, current_pos - sizeof(int64_t), sizeof(int64_t));
+        current_pos += sizeof(int64_t);
+    }
 
     /**
      * Swaps the two quad-words on the top of the stack.
      */
-    void swap_upper_qwords();
+    template <bool checked = true>
+    void swap_upper_qwords() {
+        if constexpr (checked) {
+            if (current_pos < sizeof(int64_t) * 2) {
+                throw OperandStackUnderflowError("operand stack is empty");
+            }
+        }
+        std::swap(*(int64_t *)(bytes + current_pos - sizeof(int64_t)), *(int64_t *)(bytes + current_pos - sizeof(int64_t) * 2));
+        operands_refs.swap(current_pos - sizeof(int64_t), current_pos - sizeof(int64_t) * 2);
+    }
 
     /**
      * Swaps the three quad-words on the top of the stack.
      */
-    void swap_upper_three_qwords();
+    template <bool checked = true>
+    void swap_upper_three_qwords() {
+        if constexpr (checked) {
+            if (current_pos < sizeof(int64_t) * 3) {
+                throw OperandStackUnderflowError("operand stack is empty");
+            }
+        }
+        std::swap(*(int64_t *)(bytes + current_pos - sizeof(int64_t)), *(int64_t *)(bytes + current_pos - sizeof(int64_t) * 3));
+        std::swap(*(int64_t *)(bytes + current_pos - sizeof(int64_t) * 2), *(int64_t *)(bytes + current_pos - sizeof(int64_t) * 3));
+        operands_refs.swap(current_pos - sizeof(int64_t), current_pos - sizeof(int64_t) * 3);
+        operands_refs.swap(current_pos - sizeof(int64_t) * 2, current_pos - sizeof(int64_t) * 3);
+    }
 
-    template <typename T>
+    template <typename T, bool checked = true>
     void push(T t) {
-        if (current_pos + msh::value_sizeof<T>() > stack_capacity) {
-            throw StackOverflowError("exceeded stack capacity via operand stack");
+        if constexpr (checked) {
+            if (current_pos + msh::value_sizeof<T>() > stack_capacity) {
+                throw StackOverflowError("exceeded stack capacity via operand stack");
+            }
         }
 
         // Because pointers might be misaligned due to a previous smaller type push,
-        // each individual byte of each type must be re-marked. TODO: align types
-        std::fill(operands_refs.begin() + current_pos, operands_refs.begin() + current_pos + msh::value_sizeof<T>(), false);
+        // each individual byte of each type must be re-marked.
+        operands_refs.clear(current_pos, current_pos + msh::value_sizeof<T>());
         if constexpr (std::is_same_v<msh::obj, std::remove_cvref_t<std::remove_pointer_t<T>>>) {
-            operands_refs[current_pos] = true;
+            operands_refs.set(current_pos);
         }
 
-        *(T *)(bytes + current_pos) = t;
+        // values are byte-packed, memcpy lets the compiler emit a single unaligned store
+        std::memcpy(bytes + current_pos, &t, sizeof(T));
         current_pos += msh::value_sizeof<T>();
     }
 
-    template <typename T>
+    template <typename T, bool checked = true>
     T pop() {
-        if (current_pos < msh::value_sizeof<T>()) {
-            throw OperandStackUnderflowError("operand stack is empty");
+        if constexpr (checked) {
+            if (current_pos < msh::value_sizeof<T>()) {
+                throw OperandStackUnderflowError("operand stack is empty");
+            }
         }
         current_pos -= msh::value_sizeof<T>();
-        return *(T *)(bytes + current_pos);
+        T t;
+        std::memcpy(&t, bytes + current_pos, sizeof(T));
+        return t;
     }
 
     template <typename T>
     T peek(size_t offset = 0)
         requires msh::value_t<T>
     {
-        return *(T *)(bytes + current_pos - offset);
+        T t;
+        std::memcpy(&t, bytes + current_pos - offset, sizeof(T));
+        return t;
     }
 };
 
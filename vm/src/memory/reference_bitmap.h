@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#include "memory/reserved_memory.h"
+
+/**
+ * Tells for each byte of a call stack's tape if an object reference starts at it.
+ *
+ * The bits are stored by 64-bit words so that the small ranges touched by a push
+ * are cleared with one or two masks, and so that the garbage collector can walk
+ * the set bits directly instead of testing each byte of the stack.
+ * Like the tape, the words are only committed once touched, so that a large stack costs nothing up front.
+ */
+class ReferenceBitmap {
+    static constexpr size_t WORD_BITS = 64;
+
+    ReservedMemory storage;
+    uint64_t *words;
+
+    /**
+     * @return a mask of `n` consecutive bits starting at `bit` (`bit + n` must not exceed `WORD_BITS`)
+     */
+    static constexpr uint64_t mask(size_t bit, size_t n) {
+        return (n == WORD_BITS ? ~uint64_t{0} : ((uint64_t{1} << n) - 1)) << bit;
+    }
+
+public:
+    /**
+     * creates a bitmap of `capacity` unset bits
+     */
+    explicit ReferenceBitmap(size_t capacity)
+        : storage((capacity + WORD_BITS - 1) / WORD_BITS * sizeof(uint64_t)), words{reinterpret_cast<uint64_t *>(storage.data())} {}
+
+    bool test(size_t pos) const {
+        return (words[pos / WORD_BITS] >> (pos % WORD_BITS)) & 1;
+    }
+
+    void set(size_t pos) {
+        words[pos / WORD_BITS] |= uint64_t{1} << (pos % WORD_BITS);
+    }
+
+    void assign(size_t pos, bool value) {
+        uint64_t bit = uint64_t{1} << (pos % WORD_BITS);
+        uint64_t &word = words[pos / WORD_BITS];
+        word = value ? word | bit : word & ~bit;
+    }
+
+    /**
+     * unsets the bits in [from, to)
+     */
+    void clear(size_t from, size_t to) {
+        while (from < to) {
+            size_t bit = from % WORD_BITS;
+            size_t n = std::min(WORD_BITS - bit, to - from);
+            words[from / WORD_BITS] &= ~mask(bit, n);
+            from += n;
+        }
+    }
+
+    /**
+     * copies the `n` bits starting at `src` to `dest`.
+     * The ranges may overlap only if `dest` is before `src`.
+     */
+    void copy(size_t dest, size_t src, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            assign(dest + i, test(src + i));
+        }
+    }
+
+    void swap(size_t a, size_t b) {
+        bool tmp = test(a);
+        assign(a, test(b));
+        assign(b, tmp);
+    }
+
+    /**
+     * calls `f` with the position of each set bit in [0, to), in increasing order
+     */
+    template <typename F>
+    void for_each_set(size_t to, F f) const {
+        size_t end_word = (to + WORD_BITS - 1) / WORD_BITS;
+        for (size_t w = 0; w < end_word; ++w) {
+            uint64_t word = words[w];
+            if (w == end_word - 1 && to % WORD_BITS != 0) {
+                word &= mask(0, to % WORD_BITS);
+            }
+            while (word != 0) {
+                f(w * WORD_BITS + std::countr_zero(word));
+                word &= word - 1;
+            }
+        }
+    }
+};
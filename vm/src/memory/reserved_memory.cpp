@@ -0,0 +1,30 @@
+#include "reserved_memory.h"
+
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t page_size() {
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+ReservedMemory::ReservedMemory(size_t capacity) {
+    size_t page = page_size();
+    this->capacity = (capacity + page - 1) / page * page;
+
+    // private anonymous pages are zero-filled on their first access, without reserving swap up front
+    void *region = mmap(nullptr, this->capacity + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    bytes = static_cast<std::byte *>(region);
+    if (mprotect(bytes + this->capacity, page, PROT_NONE) == -1) {
+        munmap(region, this->capacity + page);
+        throw std::bad_alloc();
+    }
+}
+
+ReservedMemory::~ReservedMemory() {
+    munmap(bytes, capacity + page_size());
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * A zeroed region of virtual memory, reserved up front but only committed by the system
+ * page by page, as the pages are first touched.
+ *
+ * The region never moves, and is followed by an inaccessible guard page
+ * so that an overflow faults instead of silently corrupting the following memory.
+ */
+class ReservedMemory {
+    std::byte *bytes;
+    size_t capacity;
+
+public:
+    /**
+     * reserves a region of at least `capacity` bytes
+     * @throws std::bad_alloc if the address space cannot be reserved
+     */
+    explicit ReservedMemory(size_t capacity);
+
+    ReservedMemory(const ReservedMemory &) = delete;
+    ReservedMemory &operator=(const ReservedMemory &) = delete;
+
+    ~ReservedMemory();
+
+    std::byte *data() const {
+        return bytes;
+    }
+
+    /**
+     * @return the size in bytes of the region, excluding its guard page
+     */
+    size_t size() const {
+        return capacity;
+    }
+};
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum Opcode {
+    OP_PUSH_INT,        // with 8 byte int value, pushes an int onto the operand stack
+    OP_PUSH_BYTE,       // with 1 byte value, pushes a byte onto the operand stack
+    OP_PUSH_FLOAT,      // with 8 byte float value, pushes a float onto the operand stack
+    OP_PUSH_STRING_REF, // with 8 byte string index in constant pool, pushes a reference to the string constant onto the operand stack
+    OP_PUSH_LOCAL_REF,  // with 4 bytes locals index, pushes a reference to the locals address onto the stack
+
+    OP_BOX_Q_WORD, // pops an int, and push it as a new reference
+    OP_BOX_BYTE,   // pops an int, and push it as a new reference
+    OP_UNBOX,      // pops a reference, and convert it to a value
+
+    OP_LOCAL_GET_BYTE,   // pops last reference and pushes its byte value onto the operands
+    OP_LOCAL_SET_BYTE,   // pops last reference, pops a byte value then sets the reference's value with byte value
+    OP_LOCAL_GET_Q_WORD, // pops last reference and pushes its qword value onto the operands
+    OP_LOCAL_SET_Q_WORD, // pops last reference, pops a qword value then sets the reference's value with qword value
+
+    OP_REF_GET_BYTE,   // pops last reference and pushes its byte value onto the operands
+    OP_REF_SET_BYTE,   // pops last reference, pops a byte value then sets the reference's value with byte value
+    OP_REF_GET_Q_WORD, // pops last reference and pushes its qword value onto the operands
+    OP_REF_SET_Q_WORD, // pops last reference, pops a qword value then sets the reference's value with qword value
+
+    OP_STRUCT_GET_BYTE,   // pops last reference and pushes byte value at given index onto the operands
+    OP_STRUCT_SET_BYTE,   // pops last reference, pops new byte value and set byte value at given index in the struct
+    OP_STRUCT_GET_Q_WORD, // pops last reference and pushes qword value at given index onto the operands
+    OP_STRUCT_SET_Q_WORD, // pops last reference, pops new qword value and set sword value at given index in the struct
+
+    OP_FETCH_BYTE,   // with 4 byte external index in constant pool, pushes given external value onto the operand stack
+    OP_FETCH_Q_WORD, // with 4 byte external index in constant pool, pushes given external value onto the operand stack
+    OP_STORE_BYTE,   // with 4 byte external index in constant pool, set given external value from value popped from the operand stack
+    OP_STORE_Q_WORD, // with 4 byte external index in constant pool, set given external value from value popped from the operand stack
+
+    OP_STRUCT_NEW,    // with 4 byte external index in constant pool, instantiates on the heap the given structure
+    OP_STRUCT_COPY_N, // with 4 byte uint32 pops structure ref, and pop given amount of bytes from the operands to copy them on the given structure, starting at index 0
+
+    OP_INVOKE,         // with 4 byte function ref string in constant pool, pops parameters from operands then pushes invoked function return in operand stack (if non-void)
+    OP_FORK,           // forks a new process, pushes the pid onto the operand stack of the parent and jumps to the given address in the parent
+    OP_EXEC,           // pops the arguments array and replaces the current program
+    OP_WAIT,           // pops a pid from the operand stack and waits for it to finish
+    OP_OPEN,           // opens a file with the name popped from the stack, pushes the file descriptor onto the operand stack
+    OP_CLOSE,          // pops a file descriptor from the operand stack and closes the file
+    OP_SETUP_REDIRECT, // peek the fd from the operand stack, pop the source fd from the operand stack, and performs a cancelable redirection
+    OP_REDIRECT,       // duplicates the file descriptor popped from the operand stack and leave the source fd on the stack
+    OP_POP_REDIRECT,   // pops a file descriptor from the operand stack and closes it
+    OP_PIPE,           // creates a pipe, pushes the read and write file descriptors onto the operand stack
+    OP_READ,           // pops a file descriptor to read all the data from, pushes the data onto the stack
+    OP_WRITE,          // pops a file descriptor to write the data to, pops the data to write from the stack
+    OP_EXIT,           // exits the current process with the popped exit code
+
+    OP_DUP,        // duplicates the last value on the operand stack
+    OP_DUP_BYTE,   // duplicates the last byte on the operand stack
+    OP_SWAP,       // swaps the last two values on the operand stack
+    OP_SWAP_2,     // swaps the last two values on the operand stack with the one before that
+    OP_POP_BYTE,   // pops one byte from operand stack
+    OP_POP_Q_WORD, // pops 8 bytes from operand stack
+
+    OP_IF_JUMP,     // with 1 byte opcode for 'then' branch, jumps only if value popped from operand stack is 0
+    OP_IF_NOT_JUMP, // with 1 byte opcode for where to jump, jumps only if value popped from operand stack is not 0
+    OP_JUMP,        // with 1 byte opcode for where to jump
+
+    OP_RETURN, // stops frame interpretation
+
+    OP_BYTE_TO_INT, // replaces last value of operand stack from byte to int
+    OP_INT_TO_BYTE, // replaces last value of operand stack from int to byte
+
+    OP_BYTE_XOR,  // pops last two bytes, apply xor operation then push the resulting byte
+    OP_INT_ADD,   // pops two ints, adds them, and pushes the resulting integer
+    OP_INT_SUB,   // pops two ints, subtracts them, and pushes the resulting integer
+    OP_INT_MUL,   // pops two ints, multiplies them, and pushes the resulting integer
+    OP_INT_DIV,   // pops two ints, divides them, and pushes the resulting integer
+    OP_INT_MOD,   // pops two ints, mods them, and pushes the resulting integer
+    OP_INT_NEG,   // pops an int, negates it, and pushes the resulting integer
+    OP_FLOAT_ADD, // pops two floats, adds them, and pushes the resulting float
+    OP_FLOAT_SUB, // pops two floats, subtracts them, and pushes the resulting float
+    OP_FLOAT_MUL, // pops two floats, multiplies them, and pushes the resulting float
+    OP_FLOAT_DIV, // pops two floats, divides them, and pushes the resulting float
+    OP_FLOAT_NEG, // pops a float, negates it, and pushes the resulting float
+
+    OP_INT_EQ, // pops two ints, checks if they are equal, and pushes the resulting byte
+    OP_INT_LT, // pops two ints, checks if the first is less than the second, and pushes the resulting byte
+    OP_INT_LE, // pops two ints, checks if the first is less than or equal to the second, and pushes the resulting byte
+    OP_INT_GT, // pops two ints, checks if the first is greater than the second, and pushes the resulting byte
+    OP_INT_GE, // pops two ints, checks if the first is greater than or equal to the second, and pushes the resulting byte
+
+    OP_FLOAT_EQ, // pops two floats, checks if they are equal, and pushes the resulting byte
+    OP_FLOAT_LT, // pops two floats, checks if the first is less than the second, and pushes the resulting byte
+    OP_FLOAT_LE, // pops two floats, checks if the first is less than or equal to the second, and pushes the resulting byte
+    OP_FLOAT_GT, // pops two floats, checks if the first is greater than the second, and pushes the resulting byte
+    OP_FLOAT_GE, // pops two floats, checks if the first is greater than or equal to the second, and pushes the resulting byte
+
+    // superinstructions, that perform a common sequence of instructions with a single dispatch
+    OP_INT_ADD_CONST,           // with 8 byte int value, pops an int, adds the value to it, and pushes the resulting integer
+    OP_LOCAL_REF_GET_Q_WORD,    // with 4 bytes locals index, pushes the qword value referenced by the given local
+    OP_INT_COMPARE_IF_JUMP,     // with 1 byte int comparison opcode and 4 byte address, pops two ints and jumps only if the comparison is true
+    OP_INT_COMPARE_IF_NOT_JUMP, // with 1 byte int comparison opcode and 4 byte address, pops two ints and jumps only if the comparison is false
+    OP_TAIL_INVOKE,             // with 4 byte function ref string in constant pool, an invocation followed by a return, whose callee frame may replace the current frame
+};
+
+/**
+ * Gets the size in bytes of the immediate operands that follow the given opcode in an instruction stream.
+ *
+ * @param code The opcode to get the operands size of.
+ * @return The number of bytes to skip after the opcode byte to reach the next instruction.
+ */
+constexpr size_t opcode_operands_size(Opcode code) {
+    switch (code) {
+    case OP_PUSH_INT:
+    case OP_PUSH_FLOAT:
+    case OP_INT_ADD_CONST:
+        return sizeof(int64_t);
+    case OP_PUSH_BYTE:
+        return sizeof(int8_t);
+    case OP_PUSH_STRING_REF:
+    case OP_PUSH_LOCAL_REF:
+    case OP_LOCAL_GET_BYTE:
+    case OP_LOCAL_SET_BYTE:
+    case OP_LOCAL_GET_Q_WORD:
+    case OP_LOCAL_SET_Q_WORD:
+    case OP_STRUCT_GET_BYTE:
+    case OP_STRUCT_SET_BYTE:
+    case OP_STRUCT_GET_Q_WORD:
+    case OP_STRUCT_SET_Q_WORD:
+    case OP_FETCH_BYTE:
+    case OP_FETCH_Q_WORD:
+    case OP_STORE_BYTE:
+    case OP_STORE_Q_WORD:
+    case OP_STRUCT_NEW:
+    case OP_STRUCT_COPY_N:
+    case OP_INVOKE:
+    case OP_TAIL_INVOKE:
+    case OP_FORK:
+    case OP_OPEN:
+    case OP_IF_JUMP:
+    case OP_IF_NOT_JUMP:
+    case OP_JUMP:
+    case OP_LOCAL_REF_GET_Q_WORD:
+        return sizeof(uint32_t);
+    case OP_INT_COMPARE_IF_JUMP:
+    case OP_INT_COMPARE_IF_NOT_JUMP:
+        return sizeof(uint8_t) + sizeof(uint32_t);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Gets the position of the jump address operand of the given opcode, relative to the opcode byte.
+ *
+ * @param code The opcode to get the jump address position of.
+ * @return The position of the jump address, or 0 if the instruction does not jump.
+ */
+constexpr size_t opcode_jump_operand(Opcode code) {
+    switch (code) {
+    case OP_JUMP:
+    case OP_IF_JUMP:
+    case OP_IF_NOT_JUMP:
+    case OP_FORK:
+        return 1;
+    case OP_INT_COMPARE_IF_JUMP:
+    case OP_INT_COMPARE_IF_NOT_JUMP:
+        return 1 + sizeof(uint8_t);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Gets the name of the given opcode, without its `OP_` prefix.
+ *
+ * @param code The opcode to get the name of.
+ * @return The name of the opcode, or null if the opcode is unknown.
+ */
+constexpr const char *opcode_name(Opcode code) {
+    switch (code) {
+    case OP_PUSH_INT:
+        return "PUSH_INT";
+    case OP_PUSH_BYTE:
+        return "PUSH_BYTE";
+    case OP_PUSH_FLOAT:
+        return "PUSH_FLOAT";
+    case OP_PUSH_STRING_REF:
+        return "PUSH_STRING_REF";
+    case OP_PUSH_LOCAL_REF:
+        return "PUSH_LOCAL_REF";
+    case OP_BOX_Q_WORD:
+        return "BOX_Q_WORD";
+    case OP_BOX_BYTE:
+        return "BOX_BYTE";
+    case OP_UNBOX:
+        return "UNBOX";
+    case OP_LOCAL_GET_BYTE:
+        return "LOCAL_GET_BYTE";
+    case OP_LOCAL_SET_BYTE:
+        return "LOCAL_SET_BYTE";
+    case OP_LOCAL_GET_Q_WORD:
+        return "LOCAL_GET_Q_WORD";
+    case OP_LOCAL_SET_Q_WORD:
+        return "LOCAL_SET_Q_WORD";
+    case OP_REF_GET_BYTE:
+        return "REF_GET_BYTE";
+    case OP_REF_SET_BYTE:
+        return "REF_SET_BYTE";
+    case OP_REF_GET_Q_WORD:
+        return "REF_GET_Q_WORD";
+    case OP_REF_SET_Q_WORD:
+        return "REF_SET_Q_WORD";
+    case OP_STRUCT_GET_BYTE:
+        return "STRUCT_GET_BYTE";
+    case OP_STRUCT_SET_BYTE:
+        return "STRUCT_SET_BYTE";
+    case OP_STRUCT_GET_Q_WORD:
+        return "STRUCT_GET_Q_WORD";
+    case OP_STRUCT_SET_Q_WORD:
+        return "STRUCT_SET_Q_WORD";
+    case OP_FETCH_BYTE:
+        return "FETCH_BYTE";
+    case OP_FETCH_Q_WORD:
+        return "FETCH_Q_WORD";
+    case OP_STORE_BYTE:
+        return "STORE_BYTE";
+    case OP_STORE_Q_WORD:
+        return "STORE_Q_WORD";
+    case OP_STRUCT_NEW:
+        return "STRUCT_NEW";
+    case OP_STRUCT_COPY_N:
+        return "STRUCT_COPY_N";
+    case OP_INVOKE:
+        return "INVOKE";
+    case OP_FORK:
+        return "FORK";
+    case OP_EXEC:
+        return "EXEC";
+    case OP_WAIT:
+        return "WAIT";
+    case OP_OPEN:
+        return "OPEN";
+    case OP_CLOSE:
+        return "CLOSE";
+    case OP_SETUP_REDIRECT:
+        return "SETUP_REDIRECT";
+    case OP_REDIRECT:
+        return "REDIRECT";
+    case OP_POP_REDIRECT:
+        return "POP_REDIRECT";
+    case OP_PIPE:
+        return "PIPE";
+    case OP_READ:
+        return "READ";
+    case OP_WRITE:
+        return "WRITE";
+    case OP_EXIT:
+        return "EXIT";
+    case OP_DUP:
+        return "DUP";
+    case OP_DUP_BYTE:
+        return "DUP_BYTE";
+    case OP_SWAP:
+        return "SWAP";
+    case OP_SWAP_2:
+        return "SWAP_2";
+    case OP_POP_BYTE:
+        return "POP_BYTE";
+    case OP_POP_Q_WORD:
+        return "POP_Q_WORD";
+    case OP_IF_JUMP:
+        return "IF_JUMP";
+    case OP_IF_NOT_JUMP:
+        return "IF_NOT_JUMP";
+    case OP_JUMP:
+        return "JUMP";
+    case OP_RETURN:
+        return "RETURN";
+    case OP_BYTE_TO_INT:
+        return "BYTE_TO_INT";
+    case OP_INT_TO_BYTE:
+        return "INT_TO_BYTE";
+    case OP_BYTE_XOR:
+        return "BYTE_XOR";
+    case OP_INT_ADD:
+        return "INT_ADD";
+    case OP_INT_SUB:
+        return "INT_SUB";
+    case OP_INT_MUL:
+        return "INT_MUL";
+    case OP_INT_DIV:
+        return "INT_DIV";
+    case OP_INT_MOD:
+        return "INT_MOD";
+    case OP_INT_NEG:
+        return "INT_NEG";
+    case OP_FLOAT_ADD:
+        return "FLOAT_ADD";
+    case OP_FLOAT_SUB:
+        return "FLOAT_SUB";
+    case OP_FLOAT_MUL:
+        return "FLOAT_MUL";
+    case OP_FLOAT_DIV:
+        return "FLOAT_DIV";
+    case OP_FLOAT_NEG:
+        return "FLOAT_NEG";
+    case OP_INT_EQ:
+        return "INT_EQ";
+    case OP_INT_LT:
+        return "INT_LT";
+    case OP_INT_LE:
+        return "INT_LE";
+    case OP_INT_GT:
+        return "INT_GT";
+    case OP_INT_GE:
+        return "INT_GE";
+    case OP_FLOAT_EQ:
+        return "FLOAT_EQ";
+    case OP_FLOAT_LT:
+        return "FLOAT_LT";
+    case OP_FLOAT_LE:
+        return "FLOAT_LE";
+    case OP_FLOAT_GT:
+        return "FLOAT_GT";
+    case OP_FLOAT_GE:
+        return "FLOAT_GE";
+    case OP_INT_ADD_CONST:
+        return "INT_ADD_CONST";
+    case OP_LOCAL_REF_GET_Q_WORD:
+        return "LOCAL_REF_GET_Q_WORD";
+    case OP_INT_COMPARE_IF_JUMP:
+        return "INT_COMPARE_IF_JUMP";
+    case OP_INT_COMPARE_IF_NOT_JUMP:
+        return "INT_COMPARE_IF_NOT_JUMP";
+    case OP_TAIL_INVOKE:
+        return "TAIL_INVOKE";
+    default:
+        return nullptr;
+    }
+}
@@ -0,0 +1,166 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace msh {
+    profiler::profiler() : nodes(1, call_node{nullptr, nullptr, 0, 1, 0, {}}), current{0}, last_charge{std::chrono::steady_clock::now()} {}
+
+    void profiler::charge() {
+        auto now = std::chrono::steady_clock::now();
+        nodes[current].self_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_charge).count();
+        last_charge = now;
+    }
+
+    void profiler::enter(const void *callee, const function_definition *function, const native_function *native) {
+        charge();
+        auto [it, inserted] = nodes[current].children.try_emplace(callee, nodes.size());
+        size_t child = it->second;
+        if (inserted) {
+            // the reference to the current node is invalidated by the insertion
+            nodes.push_back(call_node{function, native, current, 0, 0, {}});
+        }
+        nodes[child].calls++;
+        current = child;
+    }
+
+    void profiler::enter_function(const function_definition &function) {
+        enter(&function, &function, nullptr);
+    }
+
+    void profiler::enter_native(const native_function &native) {
+        enter(&native, nullptr, &native);
+    }
+
+    void profiler::leave() {
+        charge();
+        current = nodes[current].parent;
+    }
+
+    void profiler::leave_all() {
+        charge();
+        current = 0;
+    }
+
+    std::string profiler::node_name(const call_node &node, const std::unordered_map<const native_function *, std::string_view> &native_names) const {
+        if (node.native != nullptr) {
+            auto it = native_names.find(node.native);
+            return it == native_names.end() ? "<native>" : std::string(it->second);
+        }
+        if (node.function == nullptr) {
+            return "<root>";
+        }
+        std::string name(node.function->identifier);
+        if (!node.function->mappings.empty()) {
+            // the source line of the function's first instruction
+            name += ':' + std::to_string(node.function->mappings.front().second);
+        }
+        return name;
+    }
+
+    static std::unordered_map<const native_function *, std::string_view> name_natives(const natives_functions_t &natives) {
+        std::unordered_map<const native_function *, std::string_view> names;
+        for (const auto &[name, native] : natives) {
+            names.emplace(&native, name);
+        }
+        return names;
+    }
+
+    void profiler::write_report(std::ostream &out, const natives_functions_t &natives, const gc_stats &gc) const {
+        auto native_names = name_natives(natives);
+
+        out << "instructions:\n";
+        std::vector<std::pair<uint64_t, Opcode>> instructions;
+        for (size_t opcode = 0; opcode < instruction_counts.size(); opcode++) {
+            if (instruction_counts[opcode] != 0) {
+                instructions.emplace_back(instruction_counts[opcode], static_cast<Opcode>(opcode));
+            }
+        }
+        std::sort(instructions.rbegin(), instructions.rend());
+        for (auto [count, opcode] : instructions) {
+            const char *name = opcode_name(opcode);
+            out << std::setw(16) << count << "  " << (name == nullptr ? "<unknown>" : name) << '\n';
+        }
+
+        // the time of each node including its callees, as the nodes are placed after their parent
+        std::vector<uint64_t> total_ns(nodes.size());
+        for (size_t i = nodes.size(); i-- > 0;) {
+            total_ns[i] += nodes[i].self_ns;
+            if (i != 0) {
+                total_ns[nodes[i].parent] += total_ns[i];
+            }
+        }
+
+        struct callee_stats {
+            std::string name;
+            uint64_t calls;
+            uint64_t inclusive_ns;
+            uint64_t exclusive_ns;
+        };
+        std::unordered_map<const void *, callee_stats> functions;
+        std::unordered_map<const void *, callee_stats> natives_stats;
+        for (size_t i = 1; i < nodes.size(); i++) {
+            const call_node &node = nodes[i];
+            const void *callee = node.native != nullptr ? static_cast<const void *>(node.native) : node.function;
+            auto &stats = node.native != nullptr ? natives_stats : functions;
+            auto [it, inserted] = stats.try_emplace(callee, callee_stats{node_name(node, native_names), 0, 0, 0});
+            it->second.calls += node.calls;
+            it->second.exclusive_ns += node.self_ns;
+
+            // the time of recursive calls is already included by their outermost call
+            bool recursive = false;
+            for (size_t caller = node.parent; caller != 0 && !recursive; caller = nodes[caller].parent) {
+                recursive = nodes[caller].function == node.function && nodes[caller].native == node.native;
+            }
+            if (!recursive) {
+                it->second.inclusive_ns += total_ns[i];
+            }
+        }
+
+        auto write_callees = [&](const std::unordered_map<const void *, callee_stats> &callees) {
+            std::vector<const callee_stats *> sorted;
+            for (const auto &[callee, stats] : callees) {
+                sorted.push_back(&stats);
+            }
+            std::sort(sorted.begin(), sorted.end(), [](const callee_stats *a, const callee_stats *b) {
+                return a->inclusive_ns > b->inclusive_ns;
+            });
+            out << std::setw(16) << "calls" << std::setw(16) << "inclusive us" << std::setw(16) << "exclusive us" << "  name\n";
+            for (const callee_stats *stats : sorted) {
+                out << std::setw(16) << stats->calls << std::setw(16) << stats->inclusive_ns / 1000
+                    << std::setw(16) << stats->exclusive_ns / 1000 << "  " << stats->name << '\n';
+            }
+        };
+        out << "\nfunctions:\n";
+        write_callees(functions);
+        out << "\nnatives:\n";
+        write_callees(natives_stats);
+
+        out << "\ngc pauses:\n";
+        for (size_t bucket = 0; bucket < gc_stats::PAUSE_BUCKETS; bucket++) {
+            if (gc.pause_histogram[bucket] == 0) {
+                continue;
+            }
+            if (bucket == gc_stats::PAUSE_BUCKETS - 1) {
+                out << "  >= " << std::setw(8) << (uint64_t{1} << (bucket - 1)) << " us";
+            } else {
+                out << "   < " << std::setw(8) << (uint64_t{1} << bucket) << " us";
+            }
+            out << std::setw(16) << gc.pause_histogram[bucket] << '\n';
+        }
+        out << "  total " << gc.total_pause_ns / 1000 << " us, longest " << gc.max_pause_ns / 1000 << " us\n";
+    }
+
+    void profiler::write_folded_stacks(std::ostream &out, const natives_functions_t &natives) const {
+        auto native_names = name_natives(natives);
+
+        std::vector<std::string> stacks(nodes.size());
+        for (size_t i = 1; i < nodes.size(); i++) {
+            const call_node &node = nodes[i];
+            stacks[i] = node.parent == 0 ? node_name(node, native_names) : stacks[node.parent] + ';' + node_name(node, native_names);
+            if (node.self_ns != 0) {
+                out << stacks[i] << ' ' << node.self_ns << '\n';
+            }
+        }
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "definitions/function_definition.h"
+#include "memory/gc.h"
+#include "opcode.h"
+#include "stdlib_natives.h"
+
+namespace msh {
+    /**
+     * An opt-in profiler of the interpreter.
+     *
+     * It counts the executed instructions by opcode, and times the invocations of the functions and natives
+     * along the call tree, so that the time of each function is known with and without its callees.
+     */
+    class profiler {
+        /**
+         * A path of the call tree, that is a function or a native called from a given path.
+         */
+        struct call_node {
+            /**
+             * the called function or native, both null for the root of the tree
+             */
+            const function_definition *function;
+            const native_function *native;
+
+            /**
+             * the index of the calling node
+             */
+            size_t parent;
+
+            uint64_t calls;
+
+            /**
+             * the time spent in the node itself, excluding its callees, in nanoseconds
+             */
+            uint64_t self_ns;
+
+            /**
+             * the indexes of the called nodes, by called function or native
+             */
+            std::unordered_map<const void *, size_t> children;
+        };
+
+        std::array<uint64_t, 256> instruction_counts{};
+
+        /**
+         * the call tree, where the root is the first node and each node is after its parent
+         */
+        std::vector<call_node> nodes;
+
+        /**
+         * the index of the node that currently runs
+         */
+        size_t current;
+
+        /**
+         * the time at which the current node was last charged
+         */
+        std::chrono::steady_clock::time_point last_charge;
+
+        /**
+         * Charges the time spent since the last charge to the current node.
+         */
+        void charge();
+
+        void enter(const void *callee, const function_definition *function, const native_function *native);
+
+        /**
+         * Gets the name of a node in the reports.
+         */
+        std::string node_name(const call_node &node, const std::unordered_map<const native_function *, std::string_view> &native_names) const;
+
+    public:
+        profiler();
+
+        void count_instruction(Opcode opcode) {
+            instruction_counts[opcode]++;
+        }
+
+        /**
+         * Records that the given function is called by the current node.
+         */
+        void enter_function(const function_definition &function);
+
+        /**
+         * Records that the given native is called by the current node.
+         */
+        void enter_native(const native_function &native);
+
+        /**
+         * Records that the current node returns to its caller.
+         */
+        void leave();
+
+        /**
+         * Records that all the calls are aborted, once the execution of a page is left.
+         */
+        void leave_all();
+
+        /**
+         * Writes a human-readable report of the instruction counts, of the time spent by function,
+         * of the native calls and of the collection pauses.
+         *
+         * @param out The stream to write to.
+         * @param natives The natives that may have been called, to name them.
+         * @param gc The collection statistics of the profiled VM.
+         */
+        void write_report(std::ostream &out, const natives_functions_t &natives, const gc_stats &gc) const;
+
+        /**
+         * Writes the time spent in each path of the call tree as folded stacks, that is a line per path
+         * with its frames separated by semicolons and followed by its exclusive time in nanoseconds.
+         * This is the input format of the flame graph tools.
+         *
+         * @param out The stream to write to.
+         * @param natives The natives that may have been called, to name them.
+         */
+        void write_folded_stacks(std::ostream &out, const natives_functions_t &natives) const;
+    };
+}
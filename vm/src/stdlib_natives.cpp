@@ -1,15 +1,19 @@
 #include "stdlib_natives.h"
+#include "glob_walker.h"
 #include "interpreter.h"
 #include "memory/heap.h"
+#include "memory/nix.h"
+#include <algorithm>
+#include <array>
 #include <charconv>
 #include <cmath>
 #include <cstring>
 #include <filesystem>
-#include <glob.h>
-#include <iostream>
 #include <pwd.h>
 #include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
+#include <unordered_map>
 
 static void int_to_string(OperandStack &caller_stack, runtime_memory &mem) {
     int64_t value = caller_stack.pop_int();
@@ -24,24 +28,30 @@ static void float_to_string(OperandStack &caller_stack, runtime_memory &mem) {
 }
 
 static void str_concat(OperandStack &caller_stack, runtime_memory &mem) {
-    const std::string &right = caller_stack.pop_reference().get<const std::string>();
-    const std::string &left = caller_stack.pop_reference().get<const std::string>();
-
-    std::string result = left + right;
-
-    msh::obj &str = mem.emplace(std::move(result));
-    caller_stack.push_reference(str);
+    // the pieces are kept reachable while the result is allocated, as they may be referenced by it
+    msh::native_procedure<msh::obj *> procedure(caller_stack);
+    msh::obj &right = procedure.pop_reference();
+    msh::obj &left = procedure.pop_reference();
+
+    size_t length = left.get_string_length() + right.get_string_length();
+    if (length < msh::obj_rope::MIN_LENGTH) {
+        std::string concatenation(left.get_string_view());
+        concatenation += right.get_string_view();
+        caller_stack.push_reference(mem.emplace(std::move(concatenation)));
+    } else {
+        caller_stack.push_reference(mem.emplace(msh::obj_rope{&left, &right, length}));
+    }
 }
 
 static void str_eq(OperandStack &caller_stack, runtime_memory &) {
-    const std::string &right = caller_stack.pop_reference().get<const std::string>();
-    const std::string &left = caller_stack.pop_reference().get<const std::string>();
+    std::string_view right = caller_stack.pop_reference().get_string_view();
+    std::string_view left = caller_stack.pop_reference().get_string_view();
     int8_t test = static_cast<int8_t>(right == left);
     caller_stack.push_byte(test);
 }
 
 static void get_env(OperandStack &caller_stack, runtime_memory &mem) {
-    const std::string &var_name = caller_stack.pop_reference().get<const std::string>();
+    const std::string &var_name = caller_stack.pop_reference().get_string();
     const char *value = getenv(var_name.c_str());
     if (value == nullptr) {
         caller_stack.push(nullptr);
@@ -51,13 +61,13 @@ static void get_env(OperandStack &caller_stack, runtime_memory &mem) {
 }
 
 static void set_env(OperandStack &caller_stack, runtime_memory &) {
-    const std::string &value = caller_stack.pop_reference().get<const std::string>();
-    const std::string &var_name = caller_stack.pop_reference().get<const std::string>();
+    const std::string &value = caller_stack.pop_reference().get_string();
+    const std::string &var_name = caller_stack.pop_reference().get_string();
     setenv(var_name.c_str(), value.c_str(), true);
 }
 
 static void panic(OperandStack &caller_stack, runtime_memory &) {
-    const std::string &message = caller_stack.pop_reference().get<const std::string>();
+    const std::string &message = caller_stack.pop_reference().get_string();
     throw RuntimeException(message);
 }
 
@@ -66,14 +76,48 @@ static void exit(OperandStack &caller_stack, runtime_memory &) {
     exit(code);
 }
 
+/**
+ * The line readers of the file descriptors read by `read_line` and `read_line_fd`,
+ * which keep the bytes read past the returned lines.
+ */
+static std::unordered_map<int, line_reader> line_readers;
+
+/**
+ * Reads the next line of the given file descriptor.
+ * @return false at the end of the input
+ */
+static bool read_fd_line(int fd, std::string &line) {
+    auto it = line_readers.try_emplace(fd, fd).first;
+    int status = it->second.next_line(line);
+    if (status == -1) {
+        throw RuntimeException("Failed to read from file descriptor " + std::to_string(fd) + ": " + strerror(errno) + ".");
+    }
+    if (status == 0) {
+        // the descriptor may be closed and its number reused
+        line_readers.erase(it);
+        return false;
+    }
+    return true;
+}
+
 static void read_line(OperandStack &caller_stack, runtime_memory &mem) {
     std::string line;
-    std::getline(std::cin, line);
+    read_fd_line(STDIN_FILENO, line);
 
-    msh::obj &obj = mem.emplace(line);
+    msh::obj &obj = mem.emplace(std::move(line));
     caller_stack.push_reference(obj);
 }
 
+static void read_line_fd(OperandStack &caller_stack, runtime_memory &mem) {
+    int fd = static_cast<int>(caller_stack.pop_int());
+    std::string line;
+    if (!read_fd_line(fd, line)) {
+        caller_stack.push(nullptr);
+        return;
+    }
+    caller_stack.push_reference(mem.emplace(std::move(line)));
+}
+
 static void new_vec(OperandStack &caller_stack, runtime_memory &mem) {
     msh::obj &obj = mem.emplace(msh::obj_vector());
     caller_stack.push_reference(obj);
@@ -88,7 +132,7 @@ static void none(OperandStack &caller_stack, runtime_memory &) {
 }
 
 static void cd(OperandStack &caller_stack, runtime_memory &) {
-    const std::string &path = caller_stack.pop_reference().get<const std::string>();
+    const std::string &path = caller_stack.pop_reference().get_string();
     if (chdir(path.c_str()) == -1) {
         throw RuntimeException("Failed to change directory to " + path + ": " + strerror(errno) + ".");
     }
@@ -101,7 +145,7 @@ static void working_dir(OperandStack &caller_stack, runtime_memory &mem) {
 }
 
 static void home_dir(OperandStack &caller_stack, runtime_memory &mem) {
-    const std::string &username = caller_stack.pop_reference().get<const std::string>();
+    const std::string &username = caller_stack.pop_reference().get_string();
     struct passwd *pass = getpwnam(username.c_str());
     if (pass == nullptr) {
         caller_stack.push(nullptr);
@@ -144,7 +188,7 @@ static void round(OperandStack &caller_stack, runtime_memory &) {
 
 static void parse_int_radix(OperandStack &caller_stack, runtime_memory &mem) {
     int base = static_cast<int>(caller_stack.pop_int());
-    const std::string &str = caller_stack.pop_reference().get<const std::string>();
+    const std::string &str = caller_stack.pop_reference().get_string();
 
     if (base < 2 || base > 36) {
         throw RuntimeException("Invalid base: " + std::to_string(base) + ".");
@@ -167,10 +211,41 @@ static void parse_int_radix(OperandStack &caller_stack, runtime_memory &mem) {
     }
 }
 
+/**
+ * Allocates a part of a string, as a slice if it is long enough to be worth sharing the string's content.
+ *
+ * The string must be reachable, and must not be a rope.
+ */
+static msh::obj &emplace_substring(runtime_memory &mem, msh::obj &str, size_t offset, size_t length) {
+    if (length < msh::obj_slice::MIN_LENGTH) {
+        return mem.emplace(std::string(str.get_string_view().substr(offset, length)));
+    }
+    if (const msh::obj_slice *slice = std::get_if<msh::obj_slice>(&str.get_data())) {
+        // a slice of a slice directly references the flat string
+        return mem.emplace(msh::obj_slice{slice->parent, slice->offset + offset, length});
+    }
+    return mem.emplace(msh::obj_slice{&str, offset, length});
+}
+
+/**
+ * Finds the next occurrence of a non-empty delimiter in a string, with the vectorized search functions of the C library.
+ *
+ * @return a pointer to the occurrence in the string, or null if there is none.
+ */
+static const char *find_delimiter(std::string_view str, size_t start, std::string_view delim) {
+    const char *from = str.data() + start;
+    size_t remaining = str.length() - start;
+    if (delim.length() == 1) {
+        return static_cast<const char *>(memchr(from, delim[0], remaining));
+    }
+    return static_cast<const char *>(memmem(from, remaining, delim.data(), delim.length()));
+}
+
 static void str_split(OperandStack &caller_stack, runtime_memory &mem) {
     msh::native_procedure<msh::obj *> procedure(caller_stack);
-    const std::string &delim = procedure.pop_reference().get<const std::string>();
-    const std::string &str = procedure.pop_reference().get<const std::string>();
+    std::string_view delim = procedure.pop_reference().get_string_view();
+    msh::obj &str_obj = procedure.pop_reference();
+    std::string_view str = str_obj.get_string_view();
 
     msh::obj &res_obj = mem.emplace(msh::obj_vector());
     caller_stack.push_reference(res_obj);
@@ -180,45 +255,41 @@ static void str_split(OperandStack &caller_stack, runtime_memory &mem) {
         throw RuntimeException("The delimiter is empty.");
     }
 
-    std::string word;
-    size_t start = 0, end, delim_len = delim.length();
-    while ((end = str.find(delim, start)) != std::string::npos) {
-        word = str.substr(start, end - start);
-        start = end + delim_len;
-        res.push_back(&mem.emplace(word));
+    // the words are slices of the split string,
+    // whose allocations may promote the result vector that then needs to remember its young words
+    size_t start = 0;
+    while (const char *found = find_delimiter(str, start, delim)) {
+        size_t end = found - str.data();
+        res.push_back(&emplace_substring(mem, str_obj, start, end - start));
+        mem.write_barrier(res_obj, res.size() - 1, *res.back());
+        start = end + delim.length();
     }
-    res.push_back(&mem.emplace(str.substr(start)));
+    res.push_back(&emplace_substring(mem, str_obj, start, str.length() - start));
+    mem.write_barrier(res_obj, res.size() - 1, *res.back());
 }
 
 static void str_bytes(OperandStack &caller_stack, runtime_memory &mem) {
     msh::native_procedure<msh::obj *> procedure(caller_stack);
-    const std::string &str = procedure.pop_reference().get<const std::string>();
-    msh::obj_vector res;
-    res.reserve(str.length());
+    const std::string &str = procedure.pop_reference().get_string();
+    msh::obj_int_vector res(str.begin(), str.end());
 
-    msh::obj &heap_obj = mem.emplace(std::move(res));
-    caller_stack.push_reference(heap_obj);
-    msh::obj_vector &heap_res = heap_obj.get<msh::obj_vector>();
-
-    for (char c : str) {
-        heap_res.push_back(&mem.emplace(static_cast<int64_t>(c)));
-    }
+    caller_stack.push_reference(mem.emplace(std::move(res)));
 }
 
 static void str_len(OperandStack &caller_stack, runtime_memory &) {
-    const std::string &str = caller_stack.pop_reference().get<const std::string>();
-    caller_stack.push_int(static_cast<int64_t>(str.length()));
+    size_t length = caller_stack.pop_reference().get_string_length();
+    caller_stack.push_int(static_cast<int64_t>(length));
 }
 
 static void str_index(OperandStack &caller_stack, runtime_memory &mem) {
     // Tests if the index is at a UTF-8 char boundary
-    auto is_char_boundary = [](const std::string &s, size_t index) {
+    auto is_char_boundary = [](std::string_view s, size_t index) {
         return index == 0 || index == s.length() || static_cast<signed char>(s[index]) >= -0x40;
     };
 
     int64_t n = caller_stack.pop_int();
     size_t index = static_cast<size_t>(n);
-    const std::string &str = caller_stack.pop_reference().get<const std::string>();
+    std::string_view str = caller_stack.pop_reference().get_string_view();
     if (n < 0 || index >= str.length()) {
         throw RuntimeException("Index " + std::to_string(n) + " is out of range, the length is " + std::to_string(str.length()) + ".");
     }
@@ -237,96 +308,302 @@ static void str_index(OperandStack &caller_stack, runtime_memory &mem) {
     if ((index + codepoint_len) > str.length()) {
         codepoint_len = 1;
     }
-    std::string codepoint = str.substr(index, codepoint_len);
+    std::string codepoint(str.substr(index, codepoint_len));
     msh::obj &obj = mem.emplace(codepoint);
     caller_stack.push_reference(obj);
 }
 
-static void vec_len(OperandStack &caller_stack, runtime_memory &) {
-    const msh::obj_vector &vec = caller_stack.pop_reference().get<msh::obj_vector>();
-    caller_stack.push_int(static_cast<int64_t>(vec.size()));
+/**
+ * Calls `f` with the elements of a vector object, whether they are boxed or not.
+ */
+template <typename F>
+static decltype(auto) visit_vector(msh::obj &vec_obj, F f) {
+    return std::visit([&](auto &vec) -> decltype(f(std::declval<msh::obj_vector &>())) {
+        using V = std::remove_const_t<std::remove_reference_t<decltype(vec)>>;
+        if constexpr (std::is_same_v<V, msh::obj_vector> || msh::is_unboxed_vector_v<V>) {
+            return f(vec);
+        } else {
+            throw std::bad_variant_access();
+        }
+    },
+                      vec_obj.get_data());
 }
 
-static void vec_pop(OperandStack &caller_stack, runtime_memory &) {
-    msh::obj_vector &vec = caller_stack.pop_reference().get<msh::obj_vector>();
-    if (vec.empty()) {
-        caller_stack.push(nullptr);
-        return;
+static void check_index(int64_t n, size_t size) {
+    if (static_cast<size_t>(n) >= size) {
+        throw RuntimeException("Index " + std::to_string(n) + " is out of range, the length is " + std::to_string(size) + ".");
     }
-    msh::obj &last_element = *vec.back();
-    vec.pop_back();
-    caller_stack.push_reference(last_element);
 }
 
-static void vec_pop_head(OperandStack &caller_stack, runtime_memory &) {
-    msh::obj_vector &vec = caller_stack.pop_reference().get<msh::obj_vector>();
-    if (vec.empty()) {
-        caller_stack.push(nullptr);
-        return;
+/**
+ * Sets the element at the given index of a vector, or appends it if the index is the vector size.
+ */
+template <typename V, typename T>
+static void place(V &vec, size_t index, T value) {
+    if (index == vec.size()) {
+        vec.push_back(value);
+    } else {
+        vec[index] = value;
     }
-    msh::obj *first_element = *vec.begin();
-    vec.erase(vec.begin());
-    caller_stack.push_reference(*first_element);
 }
 
-static void vec_push(OperandStack &caller_stack, runtime_memory &) {
-    msh::obj &ref = caller_stack.pop_reference();
-    msh::obj_vector &vec = caller_stack.pop_reference().get<msh::obj_vector>();
-    vec.push_back(&ref);
+/**
+ * Boxes the elements of an unboxed vector in place, so that it can hold any object.
+ *
+ * The vector object must be reachable, as the boxes are allocated while it is converted.
+ */
+static msh::obj_vector &box_elements(msh::obj &vec_obj, runtime_memory &mem) {
+    msh::obj_data &data = vec_obj.get_data();
+    std::visit([&](auto &values) {
+        using V = std::remove_reference_t<decltype(values)>;
+        if constexpr (msh::is_unboxed_vector_v<V>) {
+            V unboxed = std::move(values);
+            msh::obj_vector &boxed = data.template emplace<msh::obj_vector>(unboxed.size(), nullptr);
+            for (size_t i = 0; i < unboxed.size(); ++i) {
+                msh::obj &box = mem.emplace(unboxed[i]);
+                boxed[i] = &box;
+                mem.write_barrier(vec_obj, i, box);
+            }
+        }
+    },
+               data);
+    return std::get<msh::obj_vector>(data);
+}
+
+/**
+ * Stores a boxed value in a vector, unboxing it if the vector is unboxed and of the value's type.
+ *
+ * The value may be a null reference, such as a `None` option, that is always stored boxed.
+ * The vector and the value must be reachable, as the vector may be boxed.
+ */
+static void store_boxed(msh::obj &vec_obj, size_t index, msh::obj *ref, runtime_memory &mem) {
+    bool stored = ref != nullptr && visit_vector(vec_obj, [&]<typename V>(V &vec) {
+        if constexpr (msh::is_unboxed_vector_v<V>) {
+            if (auto *value = std::get_if<typename V::value_type>(&ref->get_data())) {
+                place(vec, index, *value);
+                return true;
+            }
+        }
+        return false;
+    });
+    if (!stored) {
+        place(box_elements(vec_obj, mem), index, ref);
+        if (ref != nullptr) {
+            mem.write_barrier(vec_obj, index, *ref);
+        }
+    }
 }
 
-static void vec_extend(OperandStack &caller_stack, runtime_memory &) {
-    msh::obj_vector &right = caller_stack.pop_reference().get<msh::obj_vector>();
-    msh::obj_vector &left = caller_stack.pop_reference().get<msh::obj_vector>();
-    left.insert(left.end(), right.begin(), right.end());
+/**
+ * Stores a primitive value in a vector, without boxing it if the vector is unboxed or empty.
+ *
+ * The vector must be reachable, as the value may be boxed.
+ */
+template <typename T>
+static void store_unboxed(msh::obj &vec_obj, size_t index, T value, runtime_memory &mem) {
+    msh::obj_data &data = vec_obj.get_data();
+    if (auto *unboxed = std::get_if<msh::obj_unboxed_vector<T>>(&data)) {
+        place(*unboxed, index, value);
+        return;
+    }
+    if (auto *boxed = std::get_if<msh::obj_vector>(&data); boxed != nullptr && boxed->empty()) {
+        data.template emplace<msh::obj_unboxed_vector<T>>(1, value);
+        return;
+    }
+    msh::obj_vector &vec = box_elements(vec_obj, mem);
+    msh::obj &box = mem.emplace(value);
+    place(vec, index, &box);
+    mem.write_barrier(vec_obj, index, box);
 }
 
-static void vec_index(OperandStack &caller_stack, runtime_memory &) {
-    int64_t n = caller_stack.pop_int();
-    size_t index = static_cast<size_t>(n);
-    msh::obj_vector &vec = caller_stack.pop_reference().get<msh::obj_vector>();
-    if (index >= vec.size()) {
-        throw RuntimeException("Index " + std::to_string(n) + " is out of range, the length is " + std::to_string(vec.size()) + ".");
+static void vec_len(OperandStack &caller_stack, runtime_memory &) {
+    size_t size = visit_vector(caller_stack.pop_reference(), [](auto &vec) {
+        return vec.size();
+    });
+    caller_stack.push_int(static_cast<int64_t>(size));
+}
+
+static void vec_pop(OperandStack &caller_stack, runtime_memory &mem) {
+    msh::obj *last_element = visit_vector(caller_stack.pop_reference(), [&]<typename V>(V &vec) -> msh::obj * {
+        if (vec.empty()) {
+            return nullptr;
+        }
+        auto value = vec.back();
+        vec.pop_back();
+        if constexpr (msh::is_unboxed_vector_v<V>) {
+            return &mem.emplace(value);
+        } else {
+            return value;
+        }
+    });
+    if (last_element == nullptr) {
+        caller_stack.push(nullptr);
+    } else {
+        caller_stack.push_reference(*last_element);
     }
-    caller_stack.push_reference(*vec[index]);
 }
 
-static void vec_index_set(OperandStack &caller_stack, runtime_memory &) {
-    msh::obj &ref = caller_stack.pop_reference();
-    int64_t n = caller_stack.pop_int();
-    size_t index = static_cast<size_t>(n);
-    msh::obj_vector &vec = caller_stack.pop_reference().get<msh::obj_vector>();
-    if (index >= vec.size()) {
-        throw RuntimeException("Index " + std::to_string(n) + " is out of range, the length is " + std::to_string(vec.size()) + ".");
+static void vec_pop_head(OperandStack &caller_stack, runtime_memory &mem) {
+    msh::obj &vec_obj = caller_stack.pop_reference();
+    msh::obj *first_element = visit_vector(vec_obj, [&]<typename V>(V &vec) -> msh::obj * {
+        if (vec.empty()) {
+            return nullptr;
+        }
+        auto value = vec.front();
+        vec.pop_front();
+        if constexpr (msh::is_unboxed_vector_v<V>) {
+            return &mem.emplace(value);
+        } else {
+            // elements are shifted, which would make the remembered indexes of the vector stale
+            mem.write_barrier(vec_obj);
+            return value;
+        }
+    });
+    if (first_element == nullptr) {
+        caller_stack.push(nullptr);
+    } else {
+        caller_stack.push_reference(*first_element);
     }
-    vec[index] = &ref;
 }
 
-static void expand_glob(OperandStack &caller_stack, runtime_memory &mem) {
-    glob_t glob_result;
-    memset(&glob_result, 0, sizeof(glob_result));
-    const std::string &pattern = caller_stack.pop_reference().get<const std::string>();
-    int ret = glob(pattern.c_str(), GLOB_TILDE, nullptr, &glob_result);
-    if (ret != 0 && ret != GLOB_NOMATCH) {
-        globfree(&glob_result);
-        switch (ret) {
-        case GLOB_NOSPACE:
-            throw RuntimeException("Failed to glob files: out of memory.");
-        case GLOB_ABORTED:
-            throw RuntimeException("Failed to glob files: read error.");
-        default:
-            throw RuntimeException("Failed to glob files: unknown error.");
+static void vec_push(OperandStack &caller_stack, runtime_memory &mem) {
+    // the operands are only popped once stored, to stay reachable if the vector gets boxed
+    msh::obj *ref = caller_stack.peek<msh::obj *>(sizeof(msh::obj *));
+    msh::obj &vec_obj = *caller_stack.peek<msh::obj *>(2 * sizeof(msh::obj *));
+    size_t size = visit_vector(vec_obj, [](auto &vec) {
+        return vec.size();
+    });
+    store_boxed(vec_obj, size, ref, mem);
+    caller_stack.pop_bytes(2 * sizeof(msh::obj *));
+}
+
+static void vec_extend(OperandStack &caller_stack, runtime_memory &mem) {
+    // the operands are only popped once extended, to stay reachable if the vectors get boxed
+    msh::obj &right_obj = *caller_stack.peek<msh::obj *>(sizeof(msh::obj *));
+    msh::obj &left_obj = *caller_stack.peek<msh::obj *>(2 * sizeof(msh::obj *));
+    msh::obj_data &left_data = left_obj.get_data();
+    bool extended = visit_vector(right_obj, [&]<typename V>(V &right) {
+        if (auto *left = std::get_if<V>(&left_data)) {
+            left->append(right.begin(), right.end());
+            return true;
+        }
+        if constexpr (std::is_same_v<V, msh::obj_vector>) {
+            // an empty vector may be of any type, and leaves the other one as it is
+            if (right.empty()) {
+                return true;
+            }
         }
+        if constexpr (msh::is_unboxed_vector_v<V>) {
+            if (auto *left = std::get_if<msh::obj_vector>(&left_data); left != nullptr && left->empty()) {
+                left_data.template emplace<V>(right);
+                return true;
+            }
+        }
+        return false;
+    });
+    if (!extended) {
+        // the vectors hold different types, the elements of both are boxed
+        msh::obj_vector &right = box_elements(right_obj, mem);
+        msh::obj_vector &left = box_elements(left_obj, mem);
+        left.append(right.begin(), right.end());
+    }
+    if (std::holds_alternative<msh::obj_vector>(left_data)) {
+        mem.write_barrier(left_obj);
     }
+    caller_stack.pop_bytes(2 * sizeof(msh::obj *));
+}
+
+static void vec_index(OperandStack &caller_stack, runtime_memory &mem) {
+    int64_t n = caller_stack.pop_int();
+    msh::obj &element = visit_vector(caller_stack.pop_reference(), [&]<typename V>(V &vec) -> msh::obj & {
+        check_index(n, vec.size());
+        if constexpr (msh::is_unboxed_vector_v<V>) {
+            return mem.emplace(vec[n]);
+        } else {
+            return *vec[n];
+        }
+    });
+    caller_stack.push_reference(element);
+}
+
+static void vec_index_set(OperandStack &caller_stack, runtime_memory &mem) {
+    // the operands are only popped once stored, to stay reachable if the vector gets boxed
+    msh::obj *ref = caller_stack.peek<msh::obj *>(sizeof(msh::obj *));
+    int64_t n = caller_stack.peek<int64_t>(sizeof(msh::obj *) + sizeof(int64_t));
+    msh::obj &vec_obj = *caller_stack.peek<msh::obj *>(sizeof(msh::obj *) + sizeof(int64_t) + sizeof(msh::obj *));
+    check_index(n, visit_vector(vec_obj, [](auto &vec) {
+                    return vec.size();
+                }));
+    store_boxed(vec_obj, n, ref, mem);
+    caller_stack.pop_bytes(2 * sizeof(msh::obj *) + sizeof(int64_t));
+}
+
+/**
+ * vector[Int] -> T, for the primitive types whose elements can be read without being boxed.
+ */
+template <typename T>
+static void vec_index_unboxed(OperandStack &caller_stack, runtime_memory &) {
+    int64_t n = caller_stack.pop_int();
+    T element = visit_vector(caller_stack.pop_reference(), [&]<typename V>(V &vec) -> T {
+        check_index(n, vec.size());
+        if constexpr (std::is_same_v<V, msh::obj_vector>) {
+            return vec[n]->template get<T>();
+        } else if constexpr (std::is_same_v<typename V::value_type, T>) {
+            return vec[n];
+        } else {
+            throw std::bad_variant_access();
+        }
+    });
+    caller_stack.push(element);
+}
+
+/**
+ * vector.push(T), for the primitive types whose values can be stored without being boxed.
+ */
+template <typename T>
+static void vec_push_unboxed(OperandStack &caller_stack, runtime_memory &mem) {
+    T value = caller_stack.pop<T>();
+    // the vector is only popped once the value is stored, to stay reachable if the value gets boxed
+    msh::obj &vec_obj = *caller_stack.peek<msh::obj *>(sizeof(msh::obj *));
+    size_t size = visit_vector(vec_obj, [](auto &vec) {
+        return vec.size();
+    });
+    store_unboxed(vec_obj, size, value, mem);
+    caller_stack.pop_reference();
+}
+
+/**
+ * Vec[T][int] = T, for the primitive types whose values can be stored without being boxed.
+ */
+template <typename T>
+static void vec_index_set_unboxed(OperandStack &caller_stack, runtime_memory &mem) {
+    T value = caller_stack.pop<T>();
+    int64_t n = caller_stack.pop_int();
+    // the vector is only popped once the value is stored, to stay reachable if the value gets boxed
+    msh::obj &vec_obj = *caller_stack.peek<msh::obj *>(sizeof(msh::obj *));
+    check_index(n, visit_vector(vec_obj, [](auto &vec) {
+                    return vec.size();
+                }));
+    store_unboxed(vec_obj, n, value, mem);
+    caller_stack.pop_reference();
+}
+
+static void expand_glob(OperandStack &caller_stack, runtime_memory &mem) {
+    const std::string &pattern = caller_stack.pop_reference().get_string();
+    size_t threads = std::min<size_t>(std::thread::hardware_concurrency(), msh::MAX_GLOB_THREADS);
+    std::vector<std::string> paths = msh::expand_glob(pattern, threads);
+
     msh::obj_vector res;
-    res.reserve(glob_result.gl_pathc);
+    res.reserve(paths.size());
     msh::obj &heap_obj = mem.emplace(std::move(res));
     caller_stack.push_reference(heap_obj);
     msh::obj_vector &vec = heap_obj.get<msh::obj_vector>();
-    for (size_t i = 0; i < glob_result.gl_pathc; ++i) {
-        vec.push_back(&mem.emplace(glob_result.gl_pathv[i]));
+    for (std::string &path : paths) {
+        // the allocation may promote the vector, that then needs to remember its young elements
+        msh::obj &elem = mem.emplace(std::move(path));
+        vec.push_back(&elem);
+        mem.write_barrier(heap_obj, vec.size() - 1, elem);
     }
-    globfree(&glob_result);
 }
 
 static void gc(OperandStack &, runtime_memory &mem) {
@@ -344,7 +621,9 @@ static void program_arguments(OperandStack &caller_stack, runtime_memory &mem) {
     msh::obj_vector &vec = obj.get<msh::obj_vector>();
     vec.reserve(pargs.size());
     for (const std::string &arg : pargs) {
-        vec.push_back(&mem.emplace(arg));
+        msh::obj &elem = mem.emplace(arg);
+        vec.push_back(&elem);
+        mem.write_barrier(obj, vec.size() - 1, elem);
     }
 }
 
@@ -359,63 +638,104 @@ static void get_fd_path(OperandStack &caller_stack, runtime_memory &mem) {
 static void process_wait(OperandStack &caller_stack, runtime_memory &) {
     pid_t pid = static_cast<pid_t>(caller_stack.pop_int());
     int status;
-    if (waitpid(pid, &status, 0) == -1) {
+    if (children.wait(pid, status) == -1) {
         throw RuntimeException("Failed to wait for process " + std::to_string(pid) + ": " + strerror(errno) + ".");
     }
 }
 
 static void process_wait_all(OperandStack &, runtime_memory &) {
-    int status;
-    while (wait(&status) > 0) {
+    children.wait_all();
+}
+
+/**
+ * Sorts the natives by name at compile time.
+ */
+template <size_t N>
+static constexpr std::array<named_native, N> sort_natives(std::array<named_native, N> natives) {
+    std::sort(natives.begin(), natives.end(), [](const named_native &a, const named_native &b) {
+        return a.name < b.name;
+    });
+    return natives;
+}
+
+static constexpr auto NATIVES = sort_natives(std::to_array<named_native>({
+    {"lang::Int::to_string", {int_to_string, 8, 8}},
+    {"lang::Float::to_string", {float_to_string, 8, 8}},
+
+    {"lang::String::concat", {str_concat, 16, 8}},
+    {"lang::String::eq", {str_eq, 16, 1}},
+    {"lang::String::split", {str_split, 16, 8}},
+    {"lang::String::bytes", {str_bytes, 8, 8}},
+    {"lang::String::len", {str_len, 8, 8}},
+    {"lang::String::[]", {str_index, 16, 8}},
+
+    {"lang::Vec::pop", {vec_pop, 8, 8}},
+    {"lang::Vec::pop_head", {vec_pop_head, 8, 8}},
+    {"lang::Vec::len", {vec_len, 8, 8}},
+    {"lang::Vec::push", {vec_push, 16, 0}},
+    {"lang::Vec::extend", {vec_extend, 16, 0}},
+    {"lang::Vec::[]", {vec_index, 16, 8}},
+    {"lang::Vec::[]=", {vec_index_set, 24, 0}},
+    {"lang::Vec::index_int", {vec_index_unboxed<int64_t>, 16, 8}},
+    {"lang::Vec::index_float", {vec_index_unboxed<double>, 16, 8}},
+    {"lang::Vec::index_byte", {vec_index_unboxed<int8_t>, 16, 1}},
+    {"lang::Vec::push_int", {vec_push_unboxed<int64_t>, 16, 0}},
+    {"lang::Vec::push_float", {vec_push_unboxed<double>, 16, 0}},
+    {"lang::Vec::push_byte", {vec_push_unboxed<int8_t>, 9, 0}},
+    {"lang::Vec::index_set_int", {vec_index_set_unboxed<int64_t>, 24, 0}},
+    {"lang::Vec::index_set_float", {vec_index_set_unboxed<double>, 24, 0}},
+    {"lang::Vec::index_set_byte", {vec_index_set_unboxed<int8_t>, 17, 0}},
+
+    {"lang::glob::expand", {expand_glob, 8, 8}},
+
+    {"std::panic", {panic, 8, 0}},
+    {"std::exit", {exit, 1, 0}},
+    {"std::env", {get_env, 8, 8}},
+    {"std::set_env", {set_env, 16, 0}},
+    {"std::read_line", {read_line, 0, 8}},
+    {"std::new_vec", {new_vec, 0, 8}},
+    {"std::some", {some, 8, 8}},
+    {"std::none", {none, 0, 8}},
+    {"std::cd", {cd, 8, 0}},
+    {"std::working_dir", {working_dir, 0, 8}},
+    {"std::home_dir", {home_dir, 8, 8}},
+    {"std::current_home_dir", {current_home_dir, 0, 8}},
+
+    {"std::memory::gc", {gc, 0, 0}},
+    {"std::memory::empty_operands", {is_operands_empty, 0, 1}},
+    {"std::memory::program_arguments", {program_arguments, 0, 8}},
+
+    {"std::convert::ceil", {ceil, 8, 8}},
+    {"std::convert::floor", {floor, 8, 8}},
+    {"std::convert::round", {round, 8, 8}},
+    {"std::convert::parse_int_radix", {parse_int_radix, 16, 8}},
+
+    {"std::process::get_fd_path", {get_fd_path, 8, 8}},
+    {"std::process::wait", {process_wait, 8, 0}},
+    {"std::process::wait_all", {process_wait_all, 0, 0}},
+    {"std::process::read_line_fd", {read_line_fd, 8, 8}},
+}));
+
+static_assert(std::adjacent_find(NATIVES.begin(), NATIVES.end(), [](const named_native &a, const named_native &b) {
+                  return a.name == b.name;
+              }) == NATIVES.end(),
+              "the names of the natives must be unique");
+
+const named_native *natives_functions_t::find(std::string_view name) const {
+    const named_native *it = std::lower_bound(begin(), end(), name, [](const named_native &native, std::string_view name) {
+        return native.name < name;
+    });
+    return it != end() && it->name == name ? it : end();
+}
+
+const native_function &natives_functions_t::at(std::string_view name) const {
+    const named_native *it = find(name);
+    if (it == end()) {
+        throw std::out_of_range("unknown native " + std::string(name));
     }
+    return it->native;
 }
 
 natives_functions_t load_natives() {
-    return natives_functions_t{
-        {"lang::Int::to_string", int_to_string},
-        {"lang::Float::to_string", float_to_string},
-
-        {"lang::String::concat", str_concat},
-        {"lang::String::eq", str_eq},
-        {"lang::String::split", str_split},
-        {"lang::String::bytes", str_bytes},
-        {"lang::String::len", str_len},
-        {"lang::String::[]", str_index},
-
-        {"lang::Vec::pop", vec_pop},
-        {"lang::Vec::pop_head", vec_pop_head},
-        {"lang::Vec::len", vec_len},
-        {"lang::Vec::push", vec_push},
-        {"lang::Vec::extend", vec_extend},
-        {"lang::Vec::[]", vec_index},
-        {"lang::Vec::[]=", vec_index_set},
-
-        {"lang::glob::expand", expand_glob},
-
-        {"std::panic", panic},
-        {"std::exit", exit},
-        {"std::env", get_env},
-        {"std::set_env", set_env},
-        {"std::read_line", read_line},
-        {"std::new_vec", new_vec},
-        {"std::some", some},
-        {"std::none", none},
-        {"std::cd", cd},
-        {"std::working_dir", working_dir},
-        {"std::home_dir", home_dir},
-        {"std::current_home_dir", current_home_dir},
-
-        {"std::memory::gc", gc},
-        {"std::memory::empty_operands", is_operands_empty},
-        {"std::memory::program_arguments", program_arguments},
-
-        {"std::convert::ceil", ceil},
-        {"std::convert::floor", floor},
-        {"std::convert::round", round},
-        {"std::convert::parse_int_radix", parse_int_radix},
-
-        {"std::process::get_fd_path", get_fd_path},
-        {"std::process::wait", process_wait},
-        {"std::process::wait_all", process_wait_all},
-    };
+    return {NATIVES.data(), NATIVES.size()};
 }
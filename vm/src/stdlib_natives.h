@@ -1,12 +1,93 @@
 #pragma once
 
 #include "memory/operand_stack.h"
+#include <cstdint>
 #include <string_view>
-#include <unordered_map>
 
 class runtime_memory;
 
-using natives_functions_t = std::unordered_map<std::string_view, void (*)(OperandStack &, runtime_memory &)>;
+using native_function_t = void (*)(OperandStack &, runtime_memory &);
 
+/**
+ * A native function, with its effect on the operand stack of its caller.
+ */
+struct native_function {
+    native_function_t function;
+
+    /**
+     * Number of bytes popped from the caller's operands.
+     */
+    uint8_t parameters_byte_count;
+
+    /**
+     * Number of bytes pushed onto the caller's operands once the parameters are popped.
+     */
+    uint8_t return_byte_count;
+};
+
+/**
+ * A native function with its fully qualified name.
+ */
+struct named_native {
+    std::string_view name;
+    native_function native;
+};
+
+/**
+ * The table of the native functions, sorted by name.
+ *
+ * The table is built at compile time, so that it is shared by all the VMs without any initialization.
+ * The position of a native in the table is its numeric identifier for the current build.
+ */
+class natives_functions_t {
+    const named_native *natives;
+    size_t count;
+
+public:
+    constexpr natives_functions_t(const named_native *natives, size_t count) : natives{natives}, count{count} {}
+
+    const named_native *begin() const {
+        return natives;
+    }
+
+    const named_native *end() const {
+        return natives + count;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    /**
+     * Gets the native function of the given identifier.
+     *
+     * @param id The position of the native in this table.
+     * @return The native function.
+     */
+    const native_function &operator[](size_t id) const {
+        return natives[id].native;
+    }
+
+    /**
+     * Finds the native function of the given name by binary search.
+     *
+     * @param name The fully qualified name of the native.
+     * @return The named native, or `end()` if there is no native of this name.
+     */
+    const named_native *find(std::string_view name) const;
+
+    /**
+     * Gets the native function of the given name.
+     *
+     * @param name The fully qualified name of the native.
+     * @return The native function.
+     * @throws std::out_of_range If there is no native of this name.
+     */
+    const native_function &at(std::string_view name) const;
+};
+
+/**
+ * Gets the table of the standard native functions.
+ */
 natives_functions_t
 load_natives();
@@ -6,7 +6,14 @@
 #include "interpreter.h"
 #include "memory/call_stack.h"
 #include "memory/gc.h"
+#include "profiler.h"
+#ifdef MOSHELL_JIT
+#include "jit.h"
+#endif
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
 
 uint8_t moshell_value_get_as_byte(moshell_value val) {
     return val.b;
@@ -24,13 +31,13 @@ moshell_object moshell_value_get_as_object(moshell_value val) {
 
     std::visit([&](auto &&data) {
         using T = std::decay_t<decltype(data)>;
-        if constexpr (std::is_same_v<T, std::string>) {
+        if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, msh::obj_rope> || std::is_same_v<T, msh::obj_slice>) {
             type = OBJ_STR;
         } else if constexpr (std::is_same_v<T, int64_t>) {
             type = OBJ_INT;
         } else if constexpr (std::is_same_v<T, double>) {
             type = OBJ_DOUBLE;
-        } else if constexpr (std::is_same_v<T, msh::obj_vector>) {
+        } else if constexpr (std::is_same_v<T, msh::obj_vector> || msh::is_unboxed_vector_v<T>) {
             type = OBJ_VEC;
         } else if constexpr (std::is_same_v<T, int8_t>) {
             type = OBJ_BYTE;
@@ -64,25 +71,34 @@ moshell_value moshell_object_unbox(moshell_object o) {
 
 const char *moshell_object_get_as_string(moshell_object o) {
     msh::obj *obj = (msh::obj *)o.val;
-    const char *str = obj->get<const std::string>().c_str();
+    const char *str = obj->get_string().c_str();
     return str;
 }
 moshell_array moshell_object_get_as_array(moshell_object o) {
     msh::obj *obj = (msh::obj *)o.val;
-    msh::obj_vector &vec = obj->get<msh::obj_vector>();
-    moshell_value *data = (moshell_value *)vec.data();
-    return moshell_array{
-        vec.size(),
-        data,
-    };
+    return std::visit([&](auto &&data) -> moshell_array {
+        using T = std::decay_t<decltype(data)>;
+        if constexpr (std::is_same_v<T, msh::obj_vector>) {
+            return {data.size(), ARRAY_OBJ, data.data()};
+        } else if constexpr (std::is_same_v<T, msh::obj_int_vector>) {
+            return {data.size(), ARRAY_INT, data.data()};
+        } else if constexpr (std::is_same_v<T, msh::obj_float_vector>) {
+            return {data.size(), ARRAY_DOUBLE, data.data()};
+        } else if constexpr (std::is_same_v<T, msh::obj_byte_vector>) {
+            return {data.size(), ARRAY_BYTE, data.data()};
+        } else {
+            throw std::bad_variant_access();
+        }
+    },
+                      obj->get_data());
 }
 
 moshell_struct moshell_object_get_as_struct(moshell_object o) {
     msh::obj *obj = (msh::obj *)o.val;
     msh::obj_struct &structure = obj->get<msh::obj_struct>();
     return moshell_struct{
-        structure.bytes.size(),
-        structure.bytes.data(),
+        structure.size(),
+        structure.data(),
     };
 }
 
@@ -91,11 +107,23 @@ struct moshell_vm_state {
     msh::loader loader;
     msh::pager pager;
     msh::heap heap;
-    CallStack thread_stack{10000};
+    CallStack thread_stack;
     msh::gc gc{heap, thread_stack, pager, loader};
-    natives_functions_t natives;
+    natives_functions_t natives = load_natives();
     size_t next_page{};
     pid_t pgid{};
+    std::unique_ptr<msh::profiler> profiler;
+#ifdef MOSHELL_JIT
+    /**
+     * the native code of the hot functions, that is freed with the VM
+     */
+    msh::jit jit;
+#endif
+
+    /**
+     * where the profile is written after each execution, from the `MOSHELL_PROFILE` environment variable
+     */
+    const char *profile_path{};
 };
 
 int moshell_exec(const char *bytes, size_t byte_count) {
@@ -108,7 +136,10 @@ int moshell_exec(const char *bytes, size_t byte_count) {
 
 moshell_vm moshell_vm_init(const char **pargs, size_t arg_count, const size_t *lens) {
     moshell_vm vm = new moshell_vm_state();
-    vm->natives = load_natives();
+    vm->profile_path = getenv("MOSHELL_PROFILE");
+    if (vm->profile_path != nullptr) {
+        moshell_vm_profiler_enable(vm);
+    }
 
     for (size_t arg_idx = 0; arg_idx < arg_count; arg_idx++) {
         std::string arg(pargs[arg_idx], lens[arg_idx]);
@@ -128,21 +159,51 @@ int moshell_vm_register(moshell_vm vm, const char *bytes, size_t byte_count) {
     return -1;
 }
 
+int moshell_vm_register_file(moshell_vm vm, const char *path) {
+    try {
+        vm->loader.load_mapped_file(path, vm->pager, vm->heap);
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    return -1;
+}
+
 moshell_value moshell_vm_get_exported(moshell_vm vm, const char *name, size_t len) {
     msh::exported_variable var = vm->loader.get_exported(std::string(name, len));
     const void *obj = *vm->pager.get_exported_value<const void *>(var);
     return {.ptr = obj};
 }
 
+int moshell_vm_function_verified(moshell_vm vm, const char *name, size_t len) {
+    auto it = vm->loader.find_function(std::string(name, len));
+    if (it == vm->loader.functions_cend()) {
+        return -1;
+    }
+    return it->second.verified;
+}
+
 int moshell_vm_run(moshell_vm vm) {
     try {
-        vm->loader.resolve_all(vm->pager);
+        vm->loader.resolve_all(vm->pager, vm->natives);
         const auto last = vm->pager.cbegin() + (vm->pager.size() - vm->next_page);
         vm->next_page = vm->pager.size();
         for (auto it = vm->pager.cbegin(); it != last; ++it) {
             const msh::memory_page &page = *it;
             runtime_memory mem{vm->heap, vm->program_args, vm->gc};
-            if (!run_unit(vm->thread_stack, vm->loader, vm->pager, page, mem, vm->natives, vm->pgid)) {
+#ifdef MOSHELL_JIT
+            msh::jit *jit = &vm->jit;
+#else
+            msh::jit *jit = nullptr;
+#endif
+            bool completed = run_unit(vm->thread_stack, vm->loader, vm->pager, page, mem, vm->natives, vm->pgid, vm->profiler.get(), jit);
+            if (vm->profile_path != nullptr) {
+                std::string folded_path = std::string(vm->profile_path) + ".folded";
+                if (moshell_vm_profiler_write(vm, vm->profile_path, folded_path.c_str()) == -1) {
+                    std::cerr << "could not write the profile in " << vm->profile_path << std::endl;
+                }
+            }
+            if (!completed) {
                 return 1;
             }
         }
@@ -167,6 +228,153 @@ void moshell_vm_free(moshell_vm vm) {
     delete vm;
 }
 
+/**
+ * Copies objects of a VM into the heap of another VM, with the objects they reference.
+ *
+ * The static strings are replaced by the static strings of the other heap,
+ * and the structures by the definitions of the other loader.
+ */
+class object_copier {
+    const msh::heap &source_heap;
+    msh::heap &heap;
+    const msh::loader &loader;
+
+    /**
+     * the copy of each copied object
+     */
+    std::unordered_map<const msh::obj *, msh::obj *> copies;
+
+    /**
+     * the copies whose references still point to the source objects
+     */
+    std::vector<msh::obj *> pending;
+
+public:
+    object_copier(const msh::heap &source_heap, msh::heap &heap, const msh::loader &loader)
+        : source_heap{source_heap}, heap{heap}, loader{loader} {
+        copies.reserve(source_heap.size());
+    }
+
+    /**
+     * Gets the copy of the given object, that only references copied objects once `copy_references` is called.
+     */
+    msh::obj *copy(const msh::obj *object) {
+        if (object == nullptr) {
+            return nullptr;
+        }
+        auto [it, inserted] = copies.try_emplace(object, nullptr);
+        if (!inserted) {
+            return it->second;
+        }
+        if (source_heap.is_interned(*object)) {
+            // the constant strings are immutable, and are referenced as mutable objects by the pages
+            std::string str = object->get<const std::string>();
+            it->second = const_cast<msh::obj *>(&heap.intern(std::move(str)));
+        } else {
+            it->second = &heap.insert(object->get_data());
+            pending.push_back(it->second);
+        }
+        return it->second;
+    }
+
+    /**
+     * Copies the objects referenced by the copies, until they all reference copies.
+     */
+    void copy_references() {
+        while (!pending.empty()) {
+            msh::obj *object = pending.back();
+            pending.pop_back();
+            std::visit([&](auto &&data) {
+                using T = std::decay_t<decltype(data)>;
+                if constexpr (std::is_same_v<T, msh::obj_vector>) {
+                    for (msh::obj *&item : data) {
+                        item = copy(item);
+                    }
+                } else if constexpr (std::is_same_v<T, msh::obj_struct>) {
+                    // both loaders have loaded the same definition
+                    data.definition = &loader.find_structure(std::string(data.definition->identifier))->second;
+                    for (size_t offset : data.definition->obj_ref_offsets) {
+                        msh::obj *field;
+                        memcpy(&field, data.data() + offset, sizeof(field));
+                        field = copy(field);
+                        memcpy(data.data() + offset, &field, sizeof(field));
+                    }
+                } else if constexpr (std::is_same_v<T, msh::obj_rope>) {
+                    data.left = copy(data.left);
+                    data.right = copy(data.right);
+                } else if constexpr (std::is_same_v<T, msh::obj_slice>) {
+                    data.parent = copy(data.parent);
+                }
+            },
+                       object->get_data());
+        }
+    }
+};
+
+moshell_vm moshell_vm_clone(moshell_vm vm) {
+    std::unique_ptr<moshell_vm_state> clone = std::make_unique<moshell_vm_state>();
+    clone->program_args = vm->program_args;
+    clone->next_page = vm->next_page;
+    clone->pgid = vm->pgid;
+    clone->profile_path = vm->profile_path;
+    if (clone->profile_path != nullptr) {
+        moshell_vm_profiler_enable(clone.get());
+    }
+
+    try {
+        clone->loader.load_units_of(vm->loader, clone->pager, clone->heap);
+        if (clone->pager.size() != vm->pager.size()) {
+            std::cerr << "could not load the pages of the cloned VM again" << std::endl;
+            return nullptr;
+        }
+        auto copy = clone->pager.begin();
+        for (auto source = vm->pager.cbegin(); source != vm->pager.cend(); ++source, ++copy) {
+            std::copy(source->bytes.begin(), source->bytes.end(), copy->bytes.begin());
+        }
+
+        object_copier copier{vm->heap, clone->heap, clone->loader};
+        for (auto it = vm->loader.exported_cbegin(); it != vm->loader.exported_cend(); ++it) {
+            const auto &[name, exported] = *it;
+            if (exported.is_obj_ref) {
+                msh::obj *object = *vm->pager.get_exported_value<msh::obj *>(exported);
+                *clone->pager.get_exported_value<msh::obj *>(clone->loader.get_exported(name)) = copier.copy(object);
+            }
+        }
+        copier.copy_references();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return nullptr;
+    }
+    return clone.release();
+}
+
+void moshell_vm_profiler_enable(moshell_vm vm) {
+    if (vm->profiler == nullptr) {
+        vm->profiler = std::make_unique<msh::profiler>();
+    }
+}
+
+int moshell_vm_profiler_write(moshell_vm vm, const char *report_path, const char *folded_path) {
+    if (vm->profiler == nullptr) {
+        return -1;
+    }
+    if (report_path != nullptr) {
+        std::ofstream report(report_path);
+        vm->profiler->write_report(report, vm->natives, vm->gc.get_stats());
+        if (!report) {
+            return -1;
+        }
+    }
+    if (folded_path != nullptr) {
+        std::ofstream folded(folded_path);
+        vm->profiler->write_folded_stacks(folded, vm->natives);
+        if (!folded) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 gc_collection_result moshell_vm_gc_collect(moshell_vm vm) {
     std::vector<const msh::obj *> gc_collect = vm->gc.collect();
     moshell_object *collected_objects = static_cast<moshell_object *>(malloc(sizeof(moshell_object) * gc_collect.size()));
@@ -184,6 +392,23 @@ void moshell_vm_gc_run(moshell_vm vm) {
     vm->gc.run();
 }
 
+void moshell_vm_gc_set_percent(moshell_vm vm, int percent) {
+    vm->gc.set_growth_percent(percent);
+}
+
+void moshell_vm_gc_set_threads(moshell_vm vm, size_t threads) {
+    vm->gc.set_mark_threads(threads);
+}
+
+void moshell_vm_gc_set_sweep_budget(moshell_vm vm, size_t objects) {
+    vm->gc.set_sweep_budget(objects);
+}
+
+moshell_gc_stats moshell_vm_gc_stats(moshell_vm vm) {
+    const msh::gc_stats &stats = vm->gc.get_stats();
+    return moshell_gc_stats{stats.collections, stats.minor_collections, stats.total_pause_ns, stats.max_pause_ns, stats.live_objects};
+}
+
 void gc_collection_result_free(gc_collection_result res) {
     free(const_cast<moshell_object *>(res.collected_objects));
 }
\ No newline at end of file
@@ -60,6 +60,18 @@ moshell_vm moshell_vm_init(const char **pargs, size_t arg_count, const size_t *l
  */
 int moshell_vm_register(moshell_vm vm, const char *bytes, size_t byte_count);
 
+/**
+ * Appends the bytecode of the given compiled file to the VM.
+ *
+ * The file is mapped in memory rather than read, and the instructions that need no decoding to host byte order
+ * are directly executed from the mapping.
+ *
+ * @param vm The VM to append the bytecode to.
+ * @param path The null-terminated path of the bytecode file.
+ * @return 0 if the registration was successful, -1 otherwise.
+ */
+int moshell_vm_register_file(moshell_vm vm, const char *path);
+
 /**
  * Executes the remaining bytecode pages in the VM.
  * VM runtime does not supports multithreading which makes this function not thread safe
@@ -85,6 +97,21 @@ void moshell_set_pgid(moshell_vm vm, pid_t pgid);
  */
 size_t moshell_vm_next_page(moshell_vm vm);
 
+/**
+ * Creates a new VM in the state of the given VM, without running any of its pages again.
+ *
+ * The units registered in the given VM are loaded again, and the values of their variables
+ * are copied along with the objects they reference, so that a VM whose standard pages have run
+ * can be cloned for each new script instead of running them again.
+ * The program arguments, the process group and the pages left to run are also copied,
+ * but not the garbage collection settings made through the API nor the profile.
+ * The given VM must not be running.
+ *
+ * @param vm The VM to clone.
+ * @return The new VM, to free with `moshell_vm_free`, or null if it could not be created.
+ */
+moshell_vm moshell_vm_clone(moshell_vm vm);
+
 /**
  * Frees the given VM.
  *
@@ -92,6 +119,28 @@ size_t moshell_vm_next_page(moshell_vm vm);
  */
 void moshell_vm_free(moshell_vm vm);
 
+/**
+ * Starts to profile the next executions of the VM.
+ *
+ * The profiler counts the executed instructions by opcode, times the function and native calls,
+ * and reports the garbage collection pauses. It is enabled from the VM creation if the
+ * `MOSHELL_PROFILE` environment variable is set to a report path, in which case the report is written
+ * at the end of each execution, along with the folded stacks in the same path suffixed by `.folded`.
+ *
+ * @param vm The VM to profile.
+ */
+void moshell_vm_profiler_enable(moshell_vm vm);
+
+/**
+ * Writes the profile of the executions of the VM so far.
+ *
+ * @param vm The profiled VM.
+ * @param report_path The null-terminated path of the human-readable report, or NULL to not write it.
+ * @param folded_path The null-terminated path of the folded stacks for flame graphs, or NULL to not write them.
+ * @return 0 if the files were written, -1 if the VM is not profiled or if a file could not be written.
+ */
+int moshell_vm_profiler_write(moshell_vm vm, const char *report_path, const char *folded_path);
+
 /**
  * A moshell value, either an i64, a unsigned byte, a double
  * or an address
@@ -123,12 +172,35 @@ typedef struct {
     const void *val;
 } moshell_object;
 
+/**
+ * The different kinds of array elements
+ * */
+typedef enum {
+    /**
+     * references to heap objects, as `moshell_value`
+     */
+    ARRAY_OBJ,
+    /**
+     * unboxed `int64_t`
+     */
+    ARRAY_INT,
+    /**
+     * unboxed `double`
+     */
+    ARRAY_DOUBLE,
+    /**
+     * unboxed `uint8_t`
+     */
+    ARRAY_BYTE
+} moshell_array_kind;
+
 /**
  * A sized array of values
  * */
 typedef struct {
     size_t size;
-    const moshell_value *data;
+    moshell_array_kind kind;
+    const void *data;
 } moshell_array;
 
 /**
@@ -143,6 +215,17 @@ typedef struct {
  * Return an exported value from its name identifier
  * */
 moshell_value moshell_vm_get_exported(moshell_vm vm, const char *name, size_t name_len);
+/**
+ * Returns whether the instructions of a loaded function have been verified,
+ * in which case they run without runtime checks.
+ * The functions are verified once the VM runs the pages that load them.
+ *
+ * @param vm The VM to query.
+ * @param name The name of the function.
+ * @param name_len The number of bytes in the name.
+ * @return 1 if the function is verified, 0 if it is not, and -1 if no function has this name.
+ * */
+int moshell_vm_function_verified(moshell_vm vm, const char *name, size_t name_len);
 /**
  * Interpret given value as an unsigned byte
  * */
@@ -189,6 +272,55 @@ moshell_struct moshell_object_get_as_struct(moshell_object obj);
  * */
 void moshell_vm_gc_run(moshell_vm vm);
 
+/**
+ * Sets the heap growth, in percent of the objects kept alive by the last collection,
+ * that triggers the next automatic garbage collection.
+ * Defaults to 100, or to the value of the `MOSHELL_GC_PERCENT` environment variable.
+ *
+ * @param vm The VM to modify.
+ * @param percent The growth percent, or a negative value to disable the automatic collections.
+ * */
+void moshell_vm_gc_set_percent(moshell_vm vm, int percent);
+
+/**
+ * Sets the number of threads that mark the live objects during the full garbage collections of large heaps.
+ * Defaults to the number of hardware threads (up to 8), or to the value of the `MOSHELL_GC_THREADS` environment variable.
+ *
+ * @param vm The VM to modify.
+ * @param threads The number of threads, where 0 and 1 mark the objects on the collecting thread only.
+ * */
+void moshell_vm_gc_set_threads(moshell_vm vm, size_t threads);
+
+/**
+ * Sets the number of objects swept by each slice of the incremental sweeps.
+ * Once set, the full garbage collections only mark the live objects, and the heap is then swept
+ * by slices before the next allocations, so that the pauses do not grow with the heap size.
+ * Defaults to 0, or to the value of the `MOSHELL_GC_SWEEP_BUDGET` environment variable.
+ *
+ * @param vm The VM to modify.
+ * @param objects The number of objects per slice, or 0 to sweep the heap during the collections.
+ * */
+void moshell_vm_gc_set_sweep_budget(moshell_vm vm, size_t objects);
+
+/**
+ * Garbage collection statistics of a VM
+ * */
+typedef struct {
+    uint64_t collections;
+    uint64_t minor_collections;
+    uint64_t total_pause_ns;
+    uint64_t max_pause_ns;
+    /**
+     * number of objects kept alive by the last collection
+     * */
+    uint64_t live_objects;
+} moshell_gc_stats;
+
+/**
+ * Return the garbage collection statistics of the VM
+ * */
+moshell_gc_stats moshell_vm_gc_stats(moshell_vm vm);
+
 /**
  * the result of a gc collection cycle
  * */
@@ -0,0 +1,140 @@
+use compiler::bytecode::{Bytecode, Opcode};
+use vm::{VmError, VM};
+
+/// A function to assemble, whose name is a constant of its page.
+pub struct Function {
+    pub name: u32,
+    pub locals_size: u32,
+    pub parameters_size: u32,
+    pub return_size: u8,
+    pub instructions: Bytecode,
+}
+
+impl Function {
+    pub fn new(name: u32, locals_size: u32, code: impl FnOnce(&mut Bytecode)) -> Self {
+        let mut instructions = Bytecode::default();
+        code(&mut instructions);
+        Self {
+            name,
+            locals_size,
+            parameters_size: 0,
+            return_size: 0,
+            instructions,
+        }
+    }
+
+    /// Sets the bytes taken by the parameters, at the start of the locals, and by the returned value.
+    pub fn signature(mut self, parameters_size: u32, return_size: u8) -> Self {
+        self.parameters_size = parameters_size;
+        self.return_size = return_size;
+        self
+    }
+
+    fn write(&self, bytes: &mut Vec<u8>) {
+        let instructions = self.instructions.bytes();
+        bytes.extend(self.name.to_be_bytes());
+        bytes.extend(self.locals_size.to_be_bytes());
+        bytes.extend(self.parameters_size.to_be_bytes());
+        bytes.push(self.return_size);
+        bytes.extend((instructions.len() as u32).to_be_bytes());
+        bytes.extend(instructions);
+        // the locals never hold objects, and there are no attributes
+        bytes.extend(0u32.to_be_bytes());
+        bytes.push(0);
+    }
+}
+
+/// A single page of bytecode, whose variables are quad-words and whose structures only hold primitives.
+pub struct Page {
+    pub constants: Vec<&'static str>,
+    /// the constant indexes of the names of the variables accessed by the functions
+    pub dynamic_symbols: Vec<u32>,
+    pub main: Function,
+    /// the constant indexes of the names of the page's variables
+    pub variables: Vec<u32>,
+    /// the constant indexes of the names of the structures, with their size
+    pub structures: Vec<(u32, u32)>,
+    pub functions: Vec<Function>,
+}
+
+impl Page {
+    pub fn new(constants: Vec<&'static str>, main: Function) -> Self {
+        Self {
+            constants,
+            dynamic_symbols: Vec::new(),
+            main,
+            variables: Vec::new(),
+            structures: Vec::new(),
+            functions: Vec::new(),
+        }
+    }
+
+    pub fn assemble(&self) -> Vec<u8> {
+        let mut bytes = Vec::new();
+        bytes.extend((self.constants.len() as u32).to_be_bytes());
+        for constant in &self.constants {
+            bytes.extend((constant.len() as u64).to_be_bytes());
+            bytes.extend(constant.as_bytes());
+        }
+        bytes.extend((self.dynamic_symbols.len() as u32).to_be_bytes());
+        for symbol in &self.dynamic_symbols {
+            bytes.extend(symbol.to_be_bytes());
+        }
+
+        self.main.write(&mut bytes);
+        let page_size = self.variables.len() as u32 * 8;
+        bytes.extend(page_size.to_be_bytes());
+        bytes.extend((self.variables.len() as u32).to_be_bytes());
+        for (i, variable) in self.variables.iter().enumerate() {
+            bytes.extend(variable.to_be_bytes());
+            bytes.extend((i as u32 * 8).to_be_bytes());
+            bytes.push(0);
+        }
+
+        bytes.extend((self.structures.len() as u32).to_be_bytes());
+        for (name, size) in &self.structures {
+            bytes.extend(name.to_be_bytes());
+            bytes.extend(size.to_be_bytes());
+            bytes.extend(0u32.to_be_bytes());
+        }
+
+        bytes.extend((self.functions.len() as u32).to_be_bytes());
+        for function in &self.functions {
+            function.write(&mut bytes);
+        }
+        bytes
+    }
+}
+
+/// The constants of the pages assembled by [`call`].
+pub const CALL_CONSTANTS: [&str; 4] = ["test::main", "test::callee", "test::result", "test::other"];
+
+/// Runs a page whose main function pushes the arguments and invokes the function named `test::callee`,
+/// then returns the quad-word it returned.
+///
+/// The constants of the page are [`CALL_CONSTANTS`], where the given functions take their names.
+pub fn call(
+    push_arguments: impl FnOnce(&mut Bytecode),
+    functions: Vec<Function>,
+) -> Result<i64, VmError> {
+    let main = Function::new(0, 0, |code| {
+        push_arguments(code);
+        code.emit_byte(Opcode::Invoke as u8);
+        code.emit_constant_ref(1);
+        code.emit_byte(Opcode::StoreQWord as u8);
+        code.emit_u32(0);
+        code.emit_byte(Opcode::Return as u8);
+    });
+    let mut page = Page::new(CALL_CONSTANTS.to_vec(), main);
+    page.dynamic_symbols.push(2);
+    page.variables.push(2);
+    page.functions = functions;
+
+    let mut vm = VM::default();
+    vm.register(&page.assemble())
+        .expect("the bytecode did not load");
+    unsafe {
+        vm.run()?;
+        Ok(vm.get_exported_var(CALL_CONSTANTS[2]).get_as_i64())
+    }
+}
@@ -0,0 +1,356 @@
+use crate::runner::Runner;
+use pretty_assertions::assert_eq;
+use vm::value::VmValue;
+
+/// Allocates enough young strings to run several minor collections.
+fn allocate_garbage(runner: &mut Runner) {
+    let collections = runner.gc_stats().minor_collections;
+    runner.eval(
+        "
+        for i in 0..20000 {
+            val garbage = $i.to_string()
+        }
+    ",
+    );
+    assert!(runner.gc_stats().minor_collections > collections);
+}
+
+#[test]
+fn split_words_survive_minor_collections() {
+    let words = (0..20000)
+        .map(|i| i.to_string())
+        .collect::<Vec<_>>()
+        .join(" ");
+    let source = format!("val words = '{words}'.split(' ')");
+    let mut runner = Runner::default();
+    // the result vector gets promoted while the words are pushed in it
+    runner.eval(&source);
+    allocate_garbage(&mut runner);
+    let res = runner.eval(
+        "
+        var matching = 0
+        for i in 0..20000 {
+            if $words[$i] == $i.to_string() {
+                $matching += 1
+            }
+        }
+        $matching
+    ",
+    );
+    assert_eq!(res, Some(VmValue::Int(20000)));
+}
+
+#[test]
+fn program_arguments_survive_minor_collections() {
+    let args = (0..20000).map(|i| format!("arg{i}")).collect();
+    let mut runner = Runner::new(args);
+    runner.eval("val args = std::memory::program_arguments()");
+    allocate_garbage(&mut runner);
+    let res = runner.eval(
+        "
+        var matching = 0
+        for i in 0..20000 {
+            if $args[$i] == 'arg' + $i.to_string() {
+                $matching += 1
+            }
+        }
+        $matching
+    ",
+    );
+    assert_eq!(res, Some(VmValue::Int(20000)));
+}
+
+#[test]
+fn glob_paths_survive_minor_collections() {
+    let dir = std::env::temp_dir().join(format!("moshell-glob-gc-{}", std::process::id()));
+    std::fs::create_dir_all(&dir).expect("could not create the glob directory");
+    let paths: Vec<String> = (0..10000)
+        .map(|i| format!("{}/f{i:05}", dir.display()))
+        .collect();
+    for path in &paths {
+        std::fs::File::create(path).expect("could not create a globbed file");
+    }
+
+    let source = format!("$(/bin/echo -n {}/*)", dir.display());
+    let mut runner = Runner::default();
+    // the expanded paths are allocated after their vector, crossing several minor collections
+    let res = runner.eval(&source);
+    std::fs::remove_dir_all(&dir).expect("could not remove the glob directory");
+    assert_eq!(res, Some(VmValue::String(paths.join(" "))));
+}
+
+#[test]
+fn young_values_in_old_structure() {
+    let mut runner = Runner::default();
+    runner.eval(
+        "
+        struct Holder {
+            name: String,
+            words: Vec[String],
+        }
+        val holder = Holder('old', std::new_vec())
+    ",
+    );
+    // the holder and its vector are promoted by the collection
+    runner.gc();
+    runner.eval(
+        "
+        $holder.name = 'young ' + 'name'
+        $holder.words = 'young words'.split(' ')
+    ",
+    );
+    allocate_garbage(&mut runner);
+    assert_eq!(runner.eval("$holder.name"), Some("young name".into()));
+    assert_eq!(
+        runner.eval("$holder.words"),
+        Some(vec!["young", "words"].into())
+    );
+}
+
+#[test]
+fn young_values_in_old_vector() {
+    let mut runner = Runner::default();
+    runner.eval("val vec = 'old'.split(' ')");
+    // the vector and its element are promoted by the collection
+    runner.gc();
+    runner.eval(
+        "
+        $vec[0] = 'young ' + 'first'
+        for i in 1..1000 {
+            $vec.push($i.to_string())
+        }
+    ",
+    );
+    allocate_garbage(&mut runner);
+    assert_eq!(runner.eval("$vec[0]"), Some("young first".into()));
+    let res = runner.eval(
+        "
+        var matching = 0
+        for i in 1..1000 {
+            if $vec[$i] == $i.to_string() {
+                $matching += 1
+            }
+        }
+        $matching
+    ",
+    );
+    assert_eq!(res, Some(VmValue::Int(999)));
+}
+
+#[test]
+fn none_in_old_vector() {
+    let mut runner = Runner::default();
+    runner.eval(
+        "
+        val options: Vec[Option[String]] = std::new_vec()
+        $options.push(std::some('old'))
+    ",
+    );
+    // the vector is promoted by the collection, so that storing into it goes through the barrier
+    runner.gc();
+    runner.eval(
+        "
+        $options.push(std::none[String]())
+        $options.push(std::some('young ' + 'option'))
+        $options[0] = std::none[String]()
+    ",
+    );
+    allocate_garbage(&mut runner);
+    assert_eq!(runner.eval("$options[0]"), None);
+    assert_eq!(runner.eval("$options[1]"), None);
+    assert_eq!(runner.eval("$options[2]"), Some("young option".into()));
+}
+
+#[test]
+fn deep_ropes_survive_collections() {
+    let mut runner = Runner::default();
+    // every concatenation wraps the previous rope, as its left then as its right piece
+    runner.eval(
+        "
+        var appended = ''
+        var prepended = ''
+        for i in 0..50000 {
+            $appended += $i.to_string() + ','
+            prepended = $i.to_string() + ',' + $prepended
+        }
+    ",
+    );
+    runner.gc();
+    allocate_garbage(&mut runner);
+
+    let appended = (0..50000).map(|i| format!("{i},")).collect::<String>();
+    let prepended = (0..50000)
+        .rev()
+        .map(|i| format!("{i},"))
+        .collect::<String>();
+    // the length is known without flattening the rope
+    assert_eq!(
+        runner.eval("$appended.len()"),
+        Some(VmValue::Int(appended.len() as i64))
+    );
+    assert_eq!(runner.eval("$appended"), Some(appended.as_str().into()));
+    assert_eq!(runner.eval("$prepended"), Some(prepended.as_str().into()));
+
+    // the flattened strings no longer reference their pieces
+    runner.gc();
+    assert_eq!(runner.eval("$appended"), Some(appended.as_str().into()));
+    assert_eq!(
+        runner.eval("$prepended + '!'"),
+        Some(VmValue::String(format!("{prepended}!")))
+    );
+}
+
+#[test]
+fn slices_of_slices() {
+    let left = "l".repeat(20);
+    let right = "r".repeat(20);
+    let parts = [format!("{left}/{right}"), format!("{right}/{left}")];
+    let source = format!("val parts = '{} {}'.split(' ')", parts[0], parts[1]);
+    let mut runner = Runner::default();
+    runner.eval(&source);
+    // the halves of the second part reference the split string
+    runner.eval("val halves = $parts[1].split('/')");
+    assert_eq!(
+        runner.eval("$parts"),
+        Some(vec![parts[0].as_str(), parts[1].as_str()].into())
+    );
+    assert_eq!(
+        runner.eval("$halves"),
+        Some(vec![right.as_str(), left.as_str()].into())
+    );
+    assert_eq!(
+        runner.eval("$halves[0].len()"),
+        Some(VmValue::Int(right.len() as i64))
+    );
+    assert_eq!(
+        runner.eval("$halves[1] + $halves[0]"),
+        Some(VmValue::String(format!("{left}{right}")))
+    );
+}
+
+#[test]
+fn slices_keep_their_parent_alive() {
+    let mut runner = Runner::default();
+    runner.eval(
+        "
+        fun halves() -> Vec[String] = {
+            var text = ''
+            for i in 0..1000 {
+                $text += 'first-half-number-' + $i.to_string() + '/second-half-number-' + $i.to_string() + ' '
+            }
+            val words = $text.split(' ')
+            val word = $words[998]
+            $word.split('/')
+        }
+        val halves = halves()
+    ",
+    );
+    // the split text is only referenced by the slices of its word
+    runner.gc();
+    allocate_garbage(&mut runner);
+    runner.gc();
+    assert_eq!(
+        runner.eval("$halves"),
+        Some(vec!["first-half-number-998", "second-half-number-998"].into())
+    );
+}
+
+#[test]
+fn parallel_marking_of_large_heap() {
+    let words = (0..70000)
+        .map(|i| i.to_string())
+        .collect::<Vec<_>>()
+        .join(" ");
+    let source = format!("val words = '{words}'.split(' ')");
+    let mut runner = Runner::default();
+    // the heap is large enough for its marking to be split across the threads
+    runner.gc_settings().set_mark_threads(4);
+    runner.eval(&source);
+    // the words are shared by several vectors, that the threads may reach at the same time
+    runner.eval(
+        "
+        val shared = std::new_vec::[Vec[String]]()
+        for i in 0..100 {
+            $shared.push($words)
+        }
+    ",
+    );
+    runner.gc();
+    allocate_garbage(&mut runner);
+    runner.gc();
+    let res = runner.eval(
+        "
+        var matching = 0
+        for i in 0..70000 {
+            val shared_words = $shared[$i % 100]
+            if $shared_words[$i] == $i.to_string() {
+                $matching += 1
+            }
+        }
+        $matching
+    ",
+    );
+    assert_eq!(res, Some(VmValue::Int(70000)));
+}
+
+#[test]
+fn promotions_while_sweeping() {
+    let words = (0..20000)
+        .map(|i| i.to_string())
+        .collect::<Vec<_>>()
+        .join(" ");
+    let source = format!("var words = '{words}'.split(' ')");
+    let mut runner = Runner::default();
+    runner.gc_settings().set_sweep_budget(64);
+    runner.eval(&source);
+    // the words are promoted, then become old garbage
+    allocate_garbage(&mut runner);
+    runner.eval("words = std::new_vec::[String]()");
+    // the collection only marks, leaving the old words to the sweep slices of the next allocations
+    runner.gc();
+    runner.eval(
+        "
+        val kept = std::new_vec::[String]()
+        for i in 0..20000 {
+            $kept.push($i.to_string())
+        }
+    ",
+    );
+    allocate_garbage(&mut runner);
+    let res = runner.eval(
+        "
+        var matching = 0
+        for i in 0..20000 {
+            if $kept[$i] == $i.to_string() {
+                $matching += 1
+            }
+        }
+        $matching
+    ",
+    );
+    assert_eq!(res, Some(VmValue::Int(20000)));
+    // the old words have been swept
+    assert!(runner.gc_stats().live_objects < 30000);
+}
+
+#[test]
+fn cloned_vm_outlives_its_source() {
+    let mut runner = Runner::default();
+    runner.eval(
+        "
+        val words = 'first second third'.split(' ')
+        fun joined() -> String = $words[0] + '-' + $words[2]
+    ",
+    );
+    // the source VM is freed, along with its heap and its loaded pages
+    runner.clone_vm();
+    allocate_garbage(&mut runner);
+    runner.gc();
+    assert_eq!(runner.eval("joined()"), Some("first-third".into()));
+    runner.eval("$words.push('fourth')");
+    runner.gc();
+    assert_eq!(
+        runner.eval("$words"),
+        Some(vec!["first", "second", "third", "fourth"].into())
+    );
+}
@@ -0,0 +1,292 @@
+//! The invoked functions are small enough to be compiled to native code on their first entry,
+//! when the VM is built with the `jit` feature and run with `MOSHELL_JIT_THRESHOLD=1`.
+//! The expected results are the ones of the interpreter, that runs them in the default build.
+
+use crate::assembler::{call, Function};
+use compiler::bytecode::{Bytecode, Opcode};
+use pretty_assertions::assert_eq;
+use vm::VmError;
+
+/// Pushes the two quad-word parameters of the compiled functions.
+fn push_locals(code: &mut Bytecode) {
+    code.emit_byte(Opcode::GetLocalQWord as u8);
+    code.emit_u32(0);
+    code.emit_byte(Opcode::GetLocalQWord as u8);
+    code.emit_u32(8);
+}
+
+/// Returns the result of the given arithmetic operation on two parameters.
+fn arithmetic(operation: Opcode) -> Function {
+    Function::new(1, 16, |code| {
+        push_locals(code);
+        code.emit_byte(operation as u8);
+        code.emit_byte(Opcode::Return as u8);
+    })
+    .signature(16, 8)
+}
+
+/// Returns the byte of the comparison of two parameters, as an integer.
+fn comparison_value(comparison: Opcode) -> Function {
+    Function::new(1, 16, |code| {
+        push_locals(code);
+        code.emit_byte(comparison as u8);
+        code.emit_byte(Opcode::ConvertByteToInt as u8);
+        code.emit_byte(Opcode::Return as u8);
+    })
+    .signature(16, 8)
+}
+
+/// Returns 1 if the comparison of two parameters holds, through the given conditional jump.
+fn branch(comparison: Opcode, jump: Opcode) -> Function {
+    let (taken, not_taken) = if jump == Opcode::IfJump {
+        (1, 0)
+    } else {
+        (0, 1)
+    };
+    Function::new(1, 16, |code| {
+        push_locals(code);
+        code.emit_byte(comparison as u8);
+        code.emit_byte(jump as u8);
+        let destination = code.emit_u32_placeholder();
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(not_taken);
+        code.emit_byte(Opcode::Return as u8);
+        let ip = code.len() as u32;
+        code.patch_u32_placeholder(destination, ip);
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(taken);
+        code.emit_byte(Opcode::Return as u8);
+    })
+    .signature(16, 8)
+}
+
+fn call_ints(a: i64, b: i64, function: Function) -> Result<i64, VmError> {
+    call(
+        |code| {
+            code.emit_byte(Opcode::PushInt as u8);
+            code.emit_int(a);
+            code.emit_byte(Opcode::PushInt as u8);
+            code.emit_int(b);
+        },
+        vec![function],
+    )
+}
+
+fn call_floats(a: f64, b: f64, function: Function) -> Result<i64, VmError> {
+    call(
+        |code| {
+            code.emit_byte(Opcode::PushFloat as u8);
+            code.emit_float(a);
+            code.emit_byte(Opcode::PushFloat as u8);
+            code.emit_float(b);
+        },
+        vec![function],
+    )
+}
+
+/// Checks the comparison of each pair as a value and as the condition of both conditional jumps.
+fn check_comparisons<T: Copy>(
+    comparisons: [(Opcode, fn(T, T) -> bool); 5],
+    pairs: &[(T, T)],
+    run: fn(T, T, Function) -> Result<i64, VmError>,
+) {
+    for (comparison, holds) in comparisons {
+        for &(a, b) in pairs {
+            let expected = Ok(holds(a, b) as i64);
+            assert_eq!(
+                run(a, b, comparison_value(comparison)),
+                expected,
+                "{comparison:?}"
+            );
+            for jump in [Opcode::IfJump, Opcode::IfNotJump] {
+                let function = branch(comparison, jump);
+                assert_eq!(run(a, b, function), expected, "{comparison:?} {jump:?}");
+            }
+        }
+    }
+}
+
+#[test]
+fn int_comparisons() {
+    check_comparisons(
+        [
+            (Opcode::IntEqual, |a, b| a == b),
+            (Opcode::IntLessThan, |a, b| a < b),
+            (Opcode::IntLessOrEqual, |a, b| a <= b),
+            (Opcode::IntGreaterThan, |a, b| a > b),
+            (Opcode::IntGreaterOrEqual, |a, b| a >= b),
+        ],
+        &[(1, 2), (2, 2), (3, 2), (i64::MIN, i64::MAX)],
+        call_ints,
+    );
+}
+
+#[test]
+fn float_comparisons() {
+    check_comparisons(
+        [
+            (Opcode::FloatEqual, |a, b| a == b),
+            (Opcode::FloatLessThan, |a, b| a < b),
+            (Opcode::FloatLessOrEqual, |a, b| a <= b),
+            (Opcode::FloatGreaterThan, |a, b| a > b),
+            (Opcode::FloatGreaterOrEqual, |a, b| a >= b),
+        ],
+        &[
+            (1.0, 2.0),
+            (2.0, 2.0),
+            (3.0, 2.0),
+            (f64::NAN, 1.0),
+            (1.0, f64::NAN),
+            (f64::NAN, f64::NAN),
+            (-0.0, 0.0),
+        ],
+        call_floats,
+    );
+}
+
+#[test]
+fn int_division() {
+    // the native code leaves the divisions by 0 and -1 to the interpreter
+    for (a, b) in [(7, 2), (-7, 2), (7, -2), (7, -1), (i64::MIN, -1), (7, 0)] {
+        let (quotient, remainder) = if b == 0 {
+            (Err(VmError::Panic), Err(VmError::Panic))
+        } else {
+            (Ok(a.wrapping_div(b)), Ok(a.wrapping_rem(b)))
+        };
+        assert_eq!(call_ints(a, b, arithmetic(Opcode::IntDiv)), quotient);
+        assert_eq!(call_ints(a, b, arithmetic(Opcode::IntMod)), remainder);
+    }
+}
+
+#[test]
+fn float_division() {
+    assert_eq!(
+        call_floats(1.0, 4.0, arithmetic(Opcode::FloatDiv)),
+        Ok(0.25f64.to_bits() as i64)
+    );
+    for zero in [0.0, -0.0] {
+        assert_eq!(
+            call_floats(1.0, zero, arithmetic(Opcode::FloatDiv)),
+            Err(VmError::Panic)
+        );
+    }
+}
+
+#[test]
+fn swap_three_quad_words() {
+    // the operands a b c become b c a, whose digits are stored back in the locals
+    let function = Function::new(1, 24, |code| {
+        for local in [0, 8, 16] {
+            code.emit_byte(Opcode::GetLocalQWord as u8);
+            code.emit_u32(local);
+        }
+        code.emit_byte(Opcode::Swap2 as u8);
+        for local in [16, 8, 0] {
+            code.emit_byte(Opcode::SetLocalQWord as u8);
+            code.emit_u32(local);
+        }
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(0);
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(100);
+        code.emit_byte(Opcode::IntMul as u8);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(8);
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(10);
+        code.emit_byte(Opcode::IntMul as u8);
+        code.emit_byte(Opcode::IntAdd as u8);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(16);
+        code.emit_byte(Opcode::IntAdd as u8);
+        code.emit_byte(Opcode::Return as u8);
+    })
+    .signature(24, 8);
+    let res = call(
+        |code| {
+            for digit in [1, 2, 3] {
+                code.emit_byte(Opcode::PushInt as u8);
+                code.emit_int(digit);
+            }
+        },
+        vec![function],
+    );
+    assert_eq!(res, Ok(231));
+}
+
+#[test]
+fn byte_to_int_sign_extension() {
+    for byte in [0x80u8, 0xFF, 0x7F, 0] {
+        let function = Function::new(1, 1, |code| {
+            code.emit_byte(Opcode::GetLocalByte as u8);
+            code.emit_u32(0);
+            code.emit_byte(Opcode::ConvertByteToInt as u8);
+            code.emit_byte(Opcode::Return as u8);
+        })
+        .signature(1, 8);
+        let res = call(
+            |code| {
+                code.emit_byte(Opcode::PushByte as u8);
+                code.emit_byte(byte);
+            },
+            vec![function],
+        );
+        assert_eq!(res, Ok(byte as i8 as i64));
+    }
+}
+
+/// Sums the quotients of the integers up to the first parameter by the second one.
+fn sum_quotients() -> Function {
+    Function::new(1, 32, |code| {
+        for local in [16, 24] {
+            code.emit_byte(Opcode::PushInt as u8);
+            code.emit_int(0);
+            code.emit_byte(Opcode::SetLocalQWord as u8);
+            code.emit_u32(local);
+        }
+        let head = code.len() as u32;
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(24);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(0);
+        code.emit_byte(Opcode::IntGreaterOrEqual as u8);
+        code.emit_byte(Opcode::IfJump as u8);
+        let end = code.emit_u32_placeholder();
+
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(16);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(24);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(8);
+        code.emit_byte(Opcode::IntDiv as u8);
+        code.emit_byte(Opcode::IntAdd as u8);
+        code.emit_byte(Opcode::SetLocalQWord as u8);
+        code.emit_u32(16);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(24);
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(1);
+        code.emit_byte(Opcode::IntAdd as u8);
+        code.emit_byte(Opcode::SetLocalQWord as u8);
+        code.emit_u32(24);
+        code.emit_byte(Opcode::Jump as u8);
+        code.emit_u32(head);
+
+        let ip = code.len() as u32;
+        code.patch_u32_placeholder(end, ip);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(16);
+        code.emit_byte(Opcode::Return as u8);
+    })
+    .signature(16, 8)
+}
+
+#[test]
+fn loop_entered_again_after_exit() {
+    // each division by -1 exits the native code, that is entered again by the backward jump of the loop
+    for divisor in [-1, 2] {
+        let expected = (0..1000).map(|i| i / divisor).sum::<i64>();
+        assert_eq!(call_ints(1000, divisor, sum_quotients()), Ok(expected));
+    }
+}
@@ -1,5 +1,10 @@
+mod assembler;
 mod errors;
 mod flow;
+mod gc;
+mod jit;
 mod objects;
 mod runner;
 mod stdlib;
+mod tail_calls;
+mod verifier;
@@ -11,6 +11,7 @@ use cli::pipeline::FileImporter;
 use compiler::externals::{CompiledReef, CompilerExternals};
 use compiler::{compile_reef, CompilerOptions};
 use parser::parse_trusted;
+use vm::gc::{GcStats, GC};
 use vm::value::VmValue;
 use vm::{VmError, VmValueFFI, VM};
 
@@ -25,10 +26,17 @@ pub struct Runner<'a> {
 
 impl Default for Runner<'_> {
     fn default() -> Self {
+        Self::new(vec![])
+    }
+}
+
+impl<'a> Runner<'a> {
+    /// Creates a runner whose VM has the given program arguments.
+    pub fn new(args: Vec<String>) -> Self {
         let mut externals = Externals::default();
         let mut compiler_externals = CompilerExternals::default();
         let mut std_importer = FileImporter::new(PathBuf::from("../lib"));
-        let mut vm = VM::default();
+        let mut vm = VM::new(args);
 
         let std_name = Name::new("std");
         let analyzer = analyze(std_name.clone(), &mut std_importer, &externals);
@@ -65,9 +73,7 @@ impl Default for Runner<'_> {
             current_page: None,
         }
     }
-}
 
-impl<'a> Runner<'a> {
     pub fn eval(&mut self, expr: &'a str) -> Option<VmValue> {
         match self.try_eval(expr) {
             Ok(v) => v,
@@ -157,6 +163,20 @@ impl<'a> Runner<'a> {
         result
     }
 
+    pub fn gc_stats(&self) -> GcStats {
+        self.vm.gc.stats()
+    }
+
+    /// Runs the next evaluations in a clone of the VM, freeing the VM it was cloned from.
+    pub fn clone_vm(&mut self) {
+        self.vm = self.vm.try_clone().expect("could not clone the VM");
+    }
+
+    /// Gets the collector of the VM, to tune its next collections.
+    pub fn gc_settings(&mut self) -> &mut GC {
+        &mut self.vm.gc
+    }
+
     fn extract_value(&self, value: VmValueFFI, value_type: TypeRef) -> Option<VmValue> {
         unsafe {
             match value_type {
@@ -188,7 +208,7 @@ impl<'a> Runner<'a> {
                             .get_as_obj()
                             .get_as_vec()
                             .into_iter()
-                            .map(|v| Some(VmValue::deduce(v)))
+                            .map(Some)
                             .collect();
                         Some(VmValue::Vec(vec))
                     }
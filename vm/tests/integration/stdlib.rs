@@ -1,7 +1,9 @@
+use crate::assembler::{Function, Page};
 use crate::runner::Runner;
+use compiler::bytecode::{Bytecode, Opcode};
 use pretty_assertions::assert_eq;
 use vm::value::VmValue;
-use vm::VmError;
+use vm::{VmError, VM};
 
 #[test]
 fn test_option_parse() {
@@ -22,3 +24,194 @@ fn test_option_parse() {
         Err(VmError::Panic)
     )
 }
+
+#[test]
+fn empty_vector_unboxed_on_first_push() {
+    let mut runner = Runner::default();
+    runner.eval("val ints = std::new_vec::[Int]()");
+    runner.gc();
+    let live_objects = runner.gc_stats().live_objects;
+    runner.eval(
+        "
+        for i in 0..1000 {
+            $ints.push($i * 2)
+        }
+    ",
+    );
+    runner.gc();
+    // the integers are stored in the vector, without one box each
+    assert!(runner.gc_stats().live_objects < live_objects + 100);
+    assert_eq!(runner.eval("$ints[999]"), Some(VmValue::Int(1998)));
+    assert_eq!(runner.eval("$ints.len()"), Some(VmValue::Int(1000)));
+}
+
+#[test]
+fn string_bytes() {
+    let mut runner = Runner::default();
+    runner.eval("val bytes = 'AB'.bytes()");
+    assert_eq!(runner.eval("$bytes"), Some(vec![65, 66].into()));
+    runner.eval(
+        "
+        $bytes.push(67)
+        $bytes[0] = 97
+    ",
+    );
+    assert_eq!(runner.eval("$bytes"), Some(vec![97, 66, 67].into()));
+}
+
+#[test]
+fn byte_vectors() {
+    let mut runner = Runner::default();
+    let flags = runner.eval(
+        "
+        val flags = std::new_vec::[Bool]()
+        $flags.push(true)
+        $flags.push(false)
+        $flags.push(true)
+        $flags[0] = false
+        $flags
+    ",
+    );
+    assert_eq!(
+        flags,
+        Some(VmValue::Vec(vec![
+            Some(VmValue::Byte(0)),
+            Some(VmValue::Byte(0)),
+            Some(VmValue::Byte(1)),
+        ]))
+    );
+    assert_eq!(runner.eval("$flags[2]"), Some(VmValue::Byte(1)));
+
+    let codes = runner.eval(
+        "
+        val codes = std::new_vec::[Exitcode]()
+        $codes.push(9.to_exitcode())
+        $codes.push(255.to_exitcode())
+        $codes.push(1.to_exitcode())
+        $codes[2] = 0.to_exitcode()
+        $codes
+    ",
+    );
+    assert_eq!(
+        codes,
+        Some(VmValue::Vec(vec![
+            Some(VmValue::Byte(9)),
+            Some(VmValue::Byte(255)),
+            Some(VmValue::Byte(0)),
+        ]))
+    );
+    assert_eq!(runner.eval("$codes[0].to_int()"), Some(VmValue::Int(9)));
+}
+
+/// The constants of the pages assembled by [`build_vector`], whose main function invokes the vector natives.
+const VECTOR_CONSTANTS: [&str; 7] = [
+    "test::main",
+    "std::new_vec",
+    "test::result",
+    "lang::Vec::push_float",
+    "lang::Vec::push",
+    "lang::Vec::push_int",
+    "lang::Vec::extend",
+];
+
+/// Runs a main function whose two quad-word locals hold vectors, and returns the elements of the first one.
+fn build_vector(code: impl FnOnce(&mut Bytecode)) -> Vec<VmValue> {
+    let main = Function::new(0, 16, |bytecode| {
+        code(bytecode);
+        bytecode.emit_byte(Opcode::GetLocalQWord as u8);
+        bytecode.emit_u32(0);
+        bytecode.emit_byte(Opcode::StoreQWord as u8);
+        bytecode.emit_u32(0);
+        bytecode.emit_byte(Opcode::Return as u8);
+    });
+    let mut page = Page::new(VECTOR_CONSTANTS.to_vec(), main);
+    page.dynamic_symbols.push(2);
+    page.variables.push(2);
+
+    let mut vm = VM::default();
+    vm.register(&page.assemble())
+        .expect("the bytecode did not load");
+    unsafe {
+        vm.run().expect("the vector was not built");
+        vm.get_exported_var(VECTOR_CONSTANTS[2])
+            .get_as_obj()
+            .get_as_vec()
+    }
+}
+
+/// Stores a new vector in the given local, then pushes each value with the given native.
+fn new_vector(code: &mut Bytecode, local: u32, push: u32, values: &[impl Fn(&mut Bytecode)]) {
+    code.emit_byte(Opcode::Invoke as u8);
+    code.emit_constant_ref(1);
+    code.emit_byte(Opcode::SetLocalQWord as u8);
+    code.emit_u32(local);
+    for value in values {
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(local);
+        value(code);
+        code.emit_byte(Opcode::Invoke as u8);
+        code.emit_constant_ref(push);
+    }
+}
+
+fn push_float(value: f64) -> impl Fn(&mut Bytecode) {
+    move |code| {
+        code.emit_byte(Opcode::PushFloat as u8);
+        code.emit_float(value);
+    }
+}
+
+fn push_int(value: i64) -> impl Fn(&mut Bytecode) {
+    move |code| {
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(value);
+    }
+}
+
+#[test]
+fn unboxed_vector_boxed_by_another_kind() {
+    let floats = [push_float(1.5), push_float(2.5)];
+
+    // a boxed integer cannot be stored among the unboxed floats
+    let pushed = build_vector(|code| {
+        new_vector(code, 0, 3, &floats);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(0);
+        push_int(7)(code);
+        code.emit_byte(Opcode::BoxQWord as u8);
+        code.emit_byte(Opcode::Invoke as u8);
+        code.emit_constant_ref(4);
+    });
+    assert_eq!(
+        pushed,
+        vec![VmValue::Double(1.5), VmValue::Double(2.5), VmValue::Int(7)]
+    );
+
+    let extended = build_vector(|code| {
+        new_vector(code, 0, 3, &floats);
+        new_vector(code, 8, 5, &[push_int(3)]);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(0);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(8);
+        code.emit_byte(Opcode::Invoke as u8);
+        code.emit_constant_ref(6);
+    });
+    assert_eq!(
+        extended,
+        vec![VmValue::Double(1.5), VmValue::Double(2.5), VmValue::Int(3)]
+    );
+
+    // an empty vector is of any type
+    let kept = build_vector(|code| {
+        new_vector(code, 0, 3, &floats);
+        new_vector(code, 8, 5, &[] as &[fn(&mut Bytecode)]);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(0);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(8);
+        code.emit_byte(Opcode::Invoke as u8);
+        code.emit_constant_ref(6);
+    });
+    assert_eq!(kept, vec![VmValue::Double(1.5), VmValue::Double(2.5)]);
+}
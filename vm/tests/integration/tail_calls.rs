@@ -0,0 +1,82 @@
+use crate::assembler::{call, Function};
+use compiler::bytecode::Opcode;
+use pretty_assertions::assert_eq;
+use vm::VmError;
+
+/// Invokes `test::callee` with the given quad-word arguments.
+fn run(arguments: &[i64], functions: Vec<Function>) -> Result<i64, VmError> {
+    call(
+        |code| {
+            for argument in arguments {
+                code.emit_byte(Opcode::PushInt as u8);
+                code.emit_int(*argument);
+            }
+        },
+        functions,
+    )
+}
+
+/// Counts down its first parameter to zero, then returns the number of invocations in its second parameter.
+fn count_down(tail: bool) -> Function {
+    Function::new(1, 16, |code| {
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(0);
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(0);
+        code.emit_byte(Opcode::IntEqual as u8);
+        code.emit_byte(Opcode::IfNotJump as u8);
+        let recurse = code.emit_u32_placeholder();
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(8);
+        code.emit_byte(Opcode::Return as u8);
+
+        let ip = code.len() as u32;
+        code.patch_u32_placeholder(recurse, ip);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(0);
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(1);
+        code.emit_byte(Opcode::IntSub as u8);
+        code.emit_byte(Opcode::GetLocalQWord as u8);
+        code.emit_u32(8);
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(1);
+        code.emit_byte(Opcode::IntAdd as u8);
+        code.emit_byte(Opcode::Invoke as u8);
+        code.emit_constant_ref(1);
+        if !tail {
+            code.emit_byte(Opcode::PushInt as u8);
+            code.emit_int(0);
+            code.emit_byte(Opcode::IntAdd as u8);
+        }
+        code.emit_byte(Opcode::Return as u8);
+    })
+    .signature(16, 8)
+}
+
+#[test]
+fn deep_tail_recursion() {
+    // the frames would not fit in the call stack if they were not replaced
+    assert_eq!(run(&[1_000_000, 0], vec![count_down(true)]), Ok(1_000_000));
+    assert_eq!(
+        run(&[1_000_000, 0], vec![count_down(false)]),
+        Err(VmError::Panic)
+    );
+}
+
+#[test]
+fn tail_invocation_returning_other_size() {
+    // the invoked function returns nothing, so the caller's frame must stay to return its own value
+    let caller = Function::new(1, 0, |code| {
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(42);
+        code.emit_byte(Opcode::Invoke as u8);
+        code.emit_constant_ref(3);
+        code.emit_byte(Opcode::Return as u8);
+    })
+    .signature(0, 8);
+    let callee = Function::new(3, 0, |code| {
+        code.emit_byte(Opcode::Return as u8);
+    });
+    assert_eq!(run(&[], vec![caller, callee]), Ok(42));
+}
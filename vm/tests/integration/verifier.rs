@@ -0,0 +1,144 @@
+use crate::assembler::{Function, Page};
+use compiler::bytecode::{Bytecode, Opcode};
+use pretty_assertions::assert_eq;
+use vm::{VmError, VM};
+
+const MAIN: &str = "test::main";
+const PAIR: &str = "test::Pair";
+
+/// Assembles a page whose main function has the given locals size and instructions,
+/// along with the `test::Pair` structure of two quad-words.
+fn assemble(locals_size: u32, code: impl FnOnce(&mut Bytecode)) -> Vec<u8> {
+    let mut page = Page::new(vec![MAIN, PAIR], Function::new(0, locals_size, code));
+    page.structures.push((1, 16));
+    page.assemble()
+}
+
+/// Runs the assembled page, returning whether its main function got verified and the result of its execution.
+fn run(bytes: &[u8]) -> (Option<bool>, Result<(), VmError>) {
+    let mut vm = VM::default();
+    vm.register(bytes).expect("the bytecode did not load");
+    let result = unsafe { vm.run() };
+    (vm.is_function_verified(MAIN), result)
+}
+
+#[test]
+fn structure_copy() {
+    let bytes = assemble(0, |code| {
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(4);
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(5);
+        code.emit_byte(Opcode::NewStruct as u8);
+        code.emit_constant_ref(1);
+        code.emit_byte(Opcode::StructCopyOperands as u8);
+        code.emit_u32(16);
+        code.emit_byte(Opcode::GetStructQWord as u8);
+        code.emit_u32(8);
+        code.emit_byte(Opcode::PopQWord as u8);
+        code.emit_byte(Opcode::Return as u8);
+    });
+    assert_eq!(run(&bytes), (Some(true), Ok(())));
+}
+
+#[test]
+fn structure_copy_underflow() {
+    let bytes = assemble(0, |code| {
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(4);
+        code.emit_byte(Opcode::NewStruct as u8);
+        code.emit_constant_ref(1);
+        code.emit_byte(Opcode::StructCopyOperands as u8);
+        code.emit_u32(16);
+        code.emit_byte(Opcode::GetStructQWord as u8);
+        code.emit_u32(8);
+        code.emit_byte(Opcode::PopQWord as u8);
+        code.emit_byte(Opcode::Return as u8);
+    });
+    assert_eq!(run(&bytes), (Some(false), Err(VmError::Panic)));
+}
+
+/// Reads a quad-word through a reference to the given local offset, in locals of 16 bytes.
+fn local_reference(offset: u32) -> Vec<u8> {
+    assemble(16, |code| {
+        code.emit_byte(Opcode::PushLocalRef as u8);
+        code.emit_u32(offset);
+        code.emit_byte(Opcode::GetRefQWord as u8);
+        code.emit_byte(Opcode::PopQWord as u8);
+        code.emit_byte(Opcode::Return as u8);
+    })
+}
+
+#[test]
+fn local_reference_in_range() {
+    assert_eq!(run(&local_reference(8)), (Some(true), Ok(())));
+}
+
+#[test]
+fn local_reference_out_of_range() {
+    assert_eq!(
+        run(&local_reference(16)),
+        (Some(false), Err(VmError::Panic))
+    );
+    // the quad-word would be read past the end of the locals
+    assert_eq!(
+        run(&local_reference(12)),
+        (Some(false), Err(VmError::Panic))
+    );
+}
+
+#[test]
+fn jump_to_instruction() {
+    let bytes = assemble(0, |code| {
+        code.emit_byte(Opcode::Jump as u8);
+        code.emit_u32(5);
+        code.emit_byte(Opcode::Return as u8);
+    });
+    assert_eq!(run(&bytes), (Some(true), Ok(())));
+}
+
+#[test]
+fn jump_out_of_function() {
+    let bytes = assemble(0, |code| {
+        code.emit_byte(Opcode::Jump as u8);
+        code.emit_u32(1000);
+        code.emit_byte(Opcode::Return as u8);
+    });
+    assert_eq!(run(&bytes), (Some(false), Err(VmError::Panic)));
+}
+
+#[test]
+fn jump_inside_instruction() {
+    let bytes = assemble(0, |code| {
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(0);
+        code.emit_byte(Opcode::PopQWord as u8);
+        // lands on the operand of the first instruction
+        code.emit_byte(Opcode::Jump as u8);
+        code.emit_u32(1);
+        code.emit_byte(Opcode::Return as u8);
+    });
+    assert_eq!(run(&bytes), (Some(false), Err(VmError::Panic)));
+}
+
+#[test]
+fn operand_stack_underflow() {
+    let bytes = assemble(0, |code| {
+        code.emit_byte(Opcode::PopQWord as u8);
+        code.emit_byte(Opcode::Return as u8);
+    });
+    assert_eq!(run(&bytes), (Some(false), Err(VmError::Panic)));
+}
+
+#[test]
+fn operand_stack_overflow() {
+    // each iteration leaves one more quad-word on the operand stack
+    let bytes = assemble(0, |code| {
+        code.emit_byte(Opcode::PushInt as u8);
+        code.emit_int(1);
+        code.emit_byte(Opcode::Jump as u8);
+        code.emit_u32(0);
+        code.emit_byte(Opcode::Return as u8);
+    });
+    assert_eq!(run(&bytes), (Some(false), Err(VmError::Panic)));
+}